@@ -82,6 +82,10 @@ DEFINE_uint32(
 DEFINE_uint32(mesh_hwmp_active_path_timeout, 30000, "HWMP Active path timeout");
 DEFINE_uint32(mesh_hwmp_rann_interval, 3000, "HWMP RANN interval");
 DEFINE_uint32(mesh_mtu, 1520, "The MTU value to set for the mesh device");
+DEFINE_uint32(
+    station_info_cache_max_age_ms,
+    1000,
+    "How long a station dump may be served to other requests");
 
 DEFINE_string(
     mesh_init_peering_allowed_macs,
@@ -99,6 +103,9 @@ extern unsigned char mgtk_tx[KEY_LEN_AES_CCMP];
 
 namespace {
 
+// Station dumps on a busy mesh take a while, but should never take this long
+const std::chrono::milliseconds kAsyncCommandTimeout{5000};
+
 const auto freq_policy_{[]() {
   std::array<nla_policy, NL80211_FREQUENCY_ATTR_MAX + 1> freq_policy_;
 
@@ -161,15 +168,104 @@ const auto mpath_policy_{[]() {
   return mpath_policy_;
 }()};
 
+// Parse an established peer from a station dump reply
+int
+parseStationInfo(
+    const GenericNetlinkMessage& msg, std::vector<StationInfo>& stationsInfo) {
+  const auto tb = msg.getAttributes<NL80211_ATTR_MAX>();
+
+  if (!tb[NL80211_ATTR_STA_INFO]) {
+    LOG(INFO) << "Station stats missing, skipping";
+    return NL_SKIP;
+  }
+
+  TabularNetlinkAttribute<NL80211_STA_INFO_MAX> sinfo{
+      tb[NL80211_ATTR_STA_INFO], stats_policy_};
+
+  if (sinfo[NL80211_STA_INFO_PLINK_STATE]) {
+    if (nla_get_u8(sinfo[NL80211_STA_INFO_PLINK_STATE]) == PLINK_ESTAB) {
+      auto mac_addr = folly::MacAddress::fromBinary(
+          {static_cast<unsigned char*>(nla_data(tb[NL80211_ATTR_MAC])),
+           ETH_ALEN});
+      uint32_t inactive_time =
+          nla_get_u32(sinfo[NL80211_STA_INFO_INACTIVE_TIME]);
+
+      int8_t rssi{0};
+      if (sinfo[NL80211_STA_INFO_SIGNAL_AVG]) {
+        rssi = static_cast<int8_t>(
+            nla_get_u8(sinfo[NL80211_STA_INFO_SIGNAL_AVG]));
+        if (rssi == 0) {
+          LOG(INFO) << "Station RSSI invalid, skipping";
+          return NL_SKIP;
+        }
+      } else {
+        LOG(INFO) << "Station RSSI missing, skipping";
+        return NL_SKIP;
+      }
+
+      uint32_t expectedThroughput{0};
+      if (sinfo[NL80211_STA_INFO_EXPECTED_THROUGHPUT]) {
+        expectedThroughput =
+            nla_get_u32(sinfo[NL80211_STA_INFO_EXPECTED_THROUGHPUT]);
+      }
+
+      bool isConnectedToGate = false;
+      if (sinfo[NL80211_STA_INFO_CONNECTED_TO_GATE]) {
+        isConnectedToGate =
+            nla_get_u8(sinfo[NL80211_STA_INFO_CONNECTED_TO_GATE]);
+      }
+
+      stationsInfo.push_back(
+          StationInfo{mac_addr,
+                      std::chrono::milliseconds{inactive_time},
+                      rssi,
+                      isConnectedToGate,
+                      expectedThroughput});
+    }
+  }
+
+  return NL_OK;
+}
+
+// Parse the metric of an active path from a mesh path dump reply
+int
+parseMeshPathMetric(
+    const GenericNetlinkMessage& msg,
+    std::unordered_map<folly::MacAddress, int32_t>& metrics) {
+  const auto tb = msg.getAttributes<NL80211_ATTR_MAX>();
+
+  if (!tb[NL80211_ATTR_MPATH_INFO]) {
+    LOG(INFO) << "mpath info missing";
+    return NL_SKIP;
+  }
+
+  TabularNetlinkAttribute<NL80211_MPATH_INFO_MAX> pinfo{
+      tb[NL80211_ATTR_MPATH_INFO], mpath_policy_};
+
+  const auto mac_addr = folly::MacAddress::fromBinary(
+      {static_cast<unsigned char*>(nla_data(tb[NL80211_ATTR_MAC])), ETH_ALEN});
+
+  // NL80211_MPATH_INFO_EXPTIME=0 means an expired path. So don't report.
+  if (nla_get_u32(pinfo[NL80211_MPATH_INFO_EXPTIME]) > 0) {
+    metrics.emplace(mac_addr, nla_get_u32(pinfo[NL80211_MPATH_INFO_METRIC]));
+  }
+
+  return NL_SKIP;
+}
+
 } // namespace
 
 Nl80211Handler::Nl80211Handler(
     fbzmq::ZmqEventLoop& zmqLoop,
     const std::string& interfaceName,
-    bool userspace_mesh_peering)
+    bool userspace_mesh_peering,
+    folly::EventBase* commandEvb)
     : interfaceName_{interfaceName},
       zmqLoop_{zmqLoop},
-      userspace_mesh_peering_{userspace_mesh_peering} {
+      userspace_mesh_peering_{userspace_mesh_peering},
+      stationInfoCache_{
+          [this]() { return dumpStationsInfo(); },
+          std::chrono::milliseconds{FLAGS_station_info_cache_max_age_ms}} {
   VLOG(8) << folly::sformat("Nl80211Handler::{}()", __func__);
 
   // We expect Nl80211Handler to be treated as a singleton, and there should not
@@ -183,6 +279,11 @@ Nl80211Handler::Nl80211Handler(
   printConfiguration();
 
   initNlSockets();
+  if (commandEvb != nullptr) {
+    commandEvb_ = commandEvb;
+    asyncCommandSocket_ = std::make_unique<AsyncGenericNetlinkSocket>(
+        commandEvb, kAsyncCommandTimeout);
+  }
   // Now that we have connected sockets, we can read interfaces from the kernel
   for (auto& netInterface : populateNetifs()) {
     const int phyIndex = netInterface.phyIndex();
@@ -366,7 +467,7 @@ Nl80211Handler::populateNetifs() {
 
   std::vector<NetInterface> netInterfaces;
 
-  GenericNetlinkSocket{}.sendAndReceive(
+  GenericNetlinkSocket::sendCommand(
       GenericNetlinkMessage{
           GenericNetlinkFamily::NL80211(), NL80211_CMD_GET_WIPHY, NLM_F_DUMP},
       [&netInterfaces](const GenericNetlinkMessage& msg) {
@@ -559,7 +660,7 @@ Nl80211Handler::createInterface(int phyIndex) {
   if (netif.maybeMacAddress) {
     nla_put(msg, NL80211_ATTR_MAC, ETH_ALEN, netif.maybeMacAddress->bytes());
   }
-  GenericNetlinkSocket{}.sendAndReceive(
+  GenericNetlinkSocket::sendCommand(
       msg, [&address](const GenericNetlinkMessage& msg) {
         const auto tb = msg.getAttributes<NL80211_ATTR_MAX>();
 
@@ -604,7 +705,7 @@ Nl80211Handler::leaveMesh(int phyIndex) {
       "ifindex: {} ",
       phyIndex,
       ifIndex);
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
 }
 
 void
@@ -626,7 +727,7 @@ Nl80211Handler::deleteInterface(const std::string& ifName) {
   GenericNetlinkMessage msg{GenericNetlinkFamily::NL80211(),
                             NL80211_CMD_DEL_INTERFACE};
   nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifIndex);
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
 }
 
 status_t
@@ -817,7 +918,7 @@ Nl80211Handler::joinMesh(int phyIndex) {
       nla_put_u32(msg, NL80211_ATTR_MCAST_RATE, multicastRate);
     }
   }
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
 }
 
 status_t
@@ -970,7 +1071,7 @@ Nl80211Handler::installKey(
 
     VLOG(8) << folly::sformat(
         "Nl80211Handler::{}(): creating key id {}", __func__, keyIdx);
-    GenericNetlinkSocket{}.sendAndReceive(msg);
+    GenericNetlinkSocket::sendCommand(msg);
   }
 
   // Set that as the key to use
@@ -990,7 +1091,7 @@ Nl80211Handler::installKey(
 
     VLOG(8) << folly::sformat(
         "Nl80211Handler::{}(): setting key id {}", __func__, keyIdx);
-    GenericNetlinkSocket{}.sendAndReceive(msg);
+    GenericNetlinkSocket::sendCommand(msg);
   }
 }
 
@@ -1029,7 +1130,7 @@ Nl80211Handler::txFrame(const NetInterface& netif, folly::ByteRange frame) {
           .toString(),
       ifIndex,
       netif.frequency);
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
   return R_SUCCESS;
 }
 
@@ -1040,7 +1141,7 @@ Nl80211Handler::getNl80211MulticastGroups() {
 
   GenericNetlinkMessage msg{GenericNetlinkFamily::NLCTRL(), CTRL_CMD_GETFAMILY};
   nla_put_string(msg, CTRL_ATTR_FAMILY_NAME, "nl80211");
-  GenericNetlinkSocket{}.sendAndReceive(
+  GenericNetlinkSocket::sendCommand(
       msg, [this](const GenericNetlinkMessage& msg) {
         const auto tb = msg.getAttributes<CTRL_ATTR_MAX>();
 
@@ -1120,7 +1221,11 @@ Nl80211Handler::setPlinkState(
   nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifIndex);
   nla_put(msg, NL80211_ATTR_MAC, ETH_ALEN, peer.bytes());
   nla_put_u8(msg, NL80211_ATTR_STA_PLINK_STATE, state);
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
+
+  if (state == PLINK_ESTAB) {
+    notifyStationEvent(StationEvent::PLINK_ESTABLISHED, peer);
+  }
 }
 
 void
@@ -1138,7 +1243,7 @@ Nl80211Handler::deleteStation(folly::MacAddress peer) {
   uint32_t ifIndex = (uint32_t)netif.maybeIfIndex.value();
   nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifIndex);
   nla_put(msg, NL80211_ATTR_MAC, ETH_ALEN, peer.bytes());
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
 }
 
 void
@@ -1168,7 +1273,7 @@ Nl80211Handler::setStationAuthenticated(
   }
 
   nla_put(msg, NL80211_ATTR_STA_FLAGS2, sizeof(flags), &flags);
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
 }
 
 status_t
@@ -1193,7 +1298,7 @@ Nl80211Handler::setMeshConfig(
     nla_put_u16(msg, NL80211_MESHCONF_HT_OPMODE, mesh.conf->ht_prot_mode);
   }
   nla_nest_end(msg, container);
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
   return R_SUCCESS;
 }
 
@@ -1443,6 +1548,43 @@ Nl80211Handler::handleDeletedPeer(const GenericNetlinkMessage& msg) {
   return R_SUCCESS;
 }
 
+void
+Nl80211Handler::addStationEventCallback(
+    std::function<void(StationEvent, folly::MacAddress)> cb) {
+  stationEventCallbacks_.push_back(std::move(cb));
+}
+
+void
+Nl80211Handler::notifyStationEvent(
+    StationEvent event, const GenericNetlinkMessage& msg) {
+  const auto tb = msg.getAttributes<NL80211_ATTR_MAX>();
+
+  if (!tb[NL80211_ATTR_IFINDEX] || !lookupMeshNetif().maybeIfIndex ||
+      nla_get_u32(tb[NL80211_ATTR_IFINDEX]) !=
+          static_cast<uint32_t>(lookupMeshNetif().maybeIfIndex.value())) {
+    return;
+  }
+  if (!tb[NL80211_ATTR_MAC] || nla_len(tb[NL80211_ATTR_MAC]) != ETH_ALEN) {
+    return;
+  }
+
+  notifyStationEvent(
+      event,
+      folly::MacAddress::fromBinary(folly::ByteRange{
+          static_cast<const unsigned char*>(nla_data(tb[NL80211_ATTR_MAC])),
+          ETH_ALEN}));
+}
+
+void
+Nl80211Handler::notifyStationEvent(
+    StationEvent event, folly::MacAddress peer) {
+  // Any station event may change what a station dump returns
+  stationInfoCache_.invalidate();
+  for (const auto& cb : stationEventCallbacks_) {
+    cb(event, peer);
+  }
+}
+
 int
 Nl80211Handler::processEvent(const GenericNetlinkMessage& msg) {
   VLOG(8) << folly::sformat("Nl80211Handler::{}()", __func__);
@@ -1529,9 +1671,15 @@ Nl80211Handler::processEvent(const GenericNetlinkMessage& msg) {
     }
     break;
 
+  case NL80211_CMD_NEW_STATION:
+    VLOG(5) << "Processing NL80211_CMD_NEW_STATION event";
+    notifyStationEvent(StationEvent::ADDED, msg);
+    break;
+
   case NL80211_CMD_DEL_STATION:
     VLOG(5) << "Processing NL80211_CMD_DEL_STATION event";
     handleDeletedPeer(msg);
+    notifyStationEvent(StationEvent::REMOVED, msg);
     break;
 
   default:
@@ -1598,7 +1746,7 @@ Nl80211Handler::createUnauthenticatedStation(
   if (elems.vht_cap) {
     nla_put(msg, NL80211_ATTR_VHT_CAPABILITY, elems.vht_cap_len, elems.vht_cap);
   }
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
 }
 
 std::ostream&
@@ -1624,7 +1772,7 @@ Nl80211Handler::getMesh() {
                             NLM_F_DUMP | NLM_F_ACK};
   uint32_t ifIndex = (uint32_t)netif.maybeIfIndex.value();
   nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifIndex);
-  GenericNetlinkSocket{}.sendAndReceive(
+  GenericNetlinkSocket::sendCommand(
       msg, [&mesh](const GenericNetlinkMessage& msg) {
         const auto tb = msg.getAttributes<NL80211_ATTR_MAX>();
 
@@ -1688,76 +1836,63 @@ Nl80211Handler::getMesh() {
   return mesh;
 }
 
+std::unique_ptr<GenericNetlinkMessage>
+Nl80211Handler::makeMeshDumpMessage(uint8_t cmd) {
+  const NetInterface& netif = lookupMeshNetif();
+
+  auto msg = std::make_unique<GenericNetlinkMessage>(
+      GenericNetlinkFamily::NL80211(), cmd, NLM_F_DUMP | NLM_F_ACK);
+  uint32_t ifIndex = (uint32_t)netif.maybeIfIndex.value();
+  nla_put_u32(*msg, NL80211_ATTR_IFINDEX, ifIndex);
+  return msg;
+}
+
 std::vector<StationInfo>
 Nl80211Handler::getStationsInfo() {
   VLOG(8) << folly::sformat("Nl80211Handler::{}()", __func__);
 
-  const NetInterface& netif = lookupMeshNetif();
-
-  std::vector<StationInfo> stationsInfo;
-
-  GenericNetlinkMessage msg{GenericNetlinkFamily::NL80211(),
-                            NL80211_CMD_GET_STATION,
-                            NLM_F_DUMP | NLM_F_ACK};
-  uint32_t ifIndex = (uint32_t)netif.maybeIfIndex.value();
-  nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifIndex);
-  GenericNetlinkSocket{}.sendAndReceive(
-      msg, [&stationsInfo](const GenericNetlinkMessage& msg) {
-        const auto tb = msg.getAttributes<NL80211_ATTR_MAX>();
+  // Waiting for the cache there would deadlock, as its dumps complete on the
+  // command event base
+  if (commandEvb_ != nullptr && commandEvb_->isInEventBaseThread()) {
+    return dumpStationsInfoSync();
+  }
+  return getStationsInfoAsync().get();
+}
 
-        if (!tb[NL80211_ATTR_STA_INFO]) {
-          LOG(INFO) << "Station stats missing, skipping";
-          return NL_SKIP;
-        }
+folly::SemiFuture<std::vector<StationInfo>>
+Nl80211Handler::getStationsInfoAsync() {
+  VLOG(8) << folly::sformat("Nl80211Handler::{}()", __func__);
 
-        TabularNetlinkAttribute<NL80211_STA_INFO_MAX> sinfo{
-            tb[NL80211_ATTR_STA_INFO], stats_policy_};
-
-        if (sinfo[NL80211_STA_INFO_PLINK_STATE]) {
-          if (nla_get_u8(sinfo[NL80211_STA_INFO_PLINK_STATE]) == PLINK_ESTAB) {
-            auto mac_addr = folly::MacAddress::fromBinary(
-                {static_cast<unsigned char*>(nla_data(tb[NL80211_ATTR_MAC])),
-                 ETH_ALEN});
-            uint32_t inactive_time =
-                nla_get_u32(sinfo[NL80211_STA_INFO_INACTIVE_TIME]);
-
-            int8_t rssi{0};
-            if (sinfo[NL80211_STA_INFO_SIGNAL_AVG]) {
-              rssi = static_cast<int8_t>(
-                  nla_get_u8(sinfo[NL80211_STA_INFO_SIGNAL_AVG]));
-              if (rssi == 0) {
-                LOG(INFO) << "Station RSSI invalid, skipping";
-                return NL_SKIP;
-              }
-            } else {
-              LOG(INFO) << "Station RSSI missing, skipping";
-              return NL_SKIP;
-            }
+  return stationInfoCache_.get();
+}
 
-            uint32_t expectedThroughput{0};
-            if (sinfo[NL80211_STA_INFO_EXPECTED_THROUGHPUT]) {
-              expectedThroughput =
-                  nla_get_u32(sinfo[NL80211_STA_INFO_EXPECTED_THROUGHPUT]);
-            }
+folly::SemiFuture<std::vector<StationInfo>>
+Nl80211Handler::dumpStationsInfo() {
+  VLOG(8) << folly::sformat("Nl80211Handler::{}()", __func__);
 
-            bool isConnectedToGate = false;
-            if (sinfo[NL80211_STA_INFO_CONNECTED_TO_GATE]) {
-              isConnectedToGate =
-                  nla_get_u8(sinfo[NL80211_STA_INFO_CONNECTED_TO_GATE]);
-            }
+  if (!asyncCommandSocket_) {
+    return dumpStationsInfoSync();
+  }
 
-            stationsInfo.push_back(
-                StationInfo{mac_addr,
-                            std::chrono::milliseconds{inactive_time},
-                            rssi,
-                            isConnectedToGate,
-                            expectedThroughput});
-          }
-        }
+  auto stationsInfo = std::make_shared<std::vector<StationInfo>>();
+  return asyncCommandSocket_
+      ->sendCommand(
+          makeMeshDumpMessage(NL80211_CMD_GET_STATION),
+          [stationsInfo](const GenericNetlinkMessage& msg) {
+            return parseStationInfo(msg, *stationsInfo);
+          })
+      .deferValue(
+          [stationsInfo](folly::Unit) { return std::move(*stationsInfo); });
+}
 
-        return NL_OK;
+std::vector<StationInfo>
+Nl80211Handler::dumpStationsInfoSync() {
+  std::vector<StationInfo> stationsInfo;
+  GenericNetlinkSocket::sendCommand(
+      *makeMeshDumpMessage(NL80211_CMD_GET_STATION),
+      [&stationsInfo](const GenericNetlinkMessage& msg) {
+        return parseStationInfo(msg, stationsInfo);
       });
-
   return stationsInfo;
 }
 
@@ -1772,45 +1907,50 @@ Nl80211Handler::getPeers() {
   return peers;
 }
 
-std::unordered_map<folly::MacAddress, int32_t>
-Nl80211Handler::getMetrics() {
+folly::SemiFuture<std::vector<folly::MacAddress>>
+Nl80211Handler::getPeersAsync() {
   VLOG(8) << folly::sformat("Nl80211Handler::{}", __func__);
 
-  const NetInterface& netif = lookupMeshNetif();
-
-  std::unordered_map<folly::MacAddress, int32_t> metrics;
-
-  GenericNetlinkMessage msg{GenericNetlinkFamily::NL80211(),
-                            NL80211_CMD_GET_MPATH,
-                            NLM_F_DUMP | NLM_F_ACK};
-  uint32_t ifIndex = (uint32_t)netif.maybeIfIndex.value();
-  nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifIndex);
-  GenericNetlinkSocket{}.sendAndReceive(
-      msg, [&metrics](const GenericNetlinkMessage& msg) {
-        const auto tb = msg.getAttributes<NL80211_ATTR_MAX>();
-
-        if (!tb[NL80211_ATTR_MPATH_INFO]) {
-          LOG(INFO) << "mpath info missing";
-          return NL_SKIP;
+  return getStationsInfoAsync().deferValue(
+      [](std::vector<StationInfo> stationsInfo) {
+        std::vector<folly::MacAddress> peers;
+        for (const auto& it : stationsInfo) {
+          peers.push_back(it.macAddress);
         }
+        return peers;
+      });
+}
 
-        TabularNetlinkAttribute<NL80211_MPATH_INFO_MAX> pinfo{
-            tb[NL80211_ATTR_MPATH_INFO], mpath_policy_};
+std::unordered_map<folly::MacAddress, int32_t>
+Nl80211Handler::getMetrics() {
+  VLOG(8) << folly::sformat("Nl80211Handler::{}", __func__);
 
-        const auto mac_addr = folly::MacAddress::fromBinary(
-            {static_cast<unsigned char*>(nla_data(tb[NL80211_ATTR_MAC])),
-             ETH_ALEN});
+  std::unordered_map<folly::MacAddress, int32_t> metrics;
+  GenericNetlinkSocket::sendCommand(
+      *makeMeshDumpMessage(NL80211_CMD_GET_MPATH),
+      [&metrics](const GenericNetlinkMessage& msg) {
+        return parseMeshPathMetric(msg, metrics);
+      });
+  return metrics;
+}
 
-        // NL80211_MPATH_INFO_EXPTIME=0 means an expired path. So don't report.
-        if (nla_get_u32(pinfo[NL80211_MPATH_INFO_EXPTIME]) > 0) {
-          metrics.emplace(
-              mac_addr, nla_get_u32(pinfo[NL80211_MPATH_INFO_METRIC]));
-        }
+folly::SemiFuture<std::unordered_map<folly::MacAddress, int32_t>>
+Nl80211Handler::getMetricsAsync() {
+  VLOG(8) << folly::sformat("Nl80211Handler::{}", __func__);
 
-        return NL_SKIP;
-      });
+  if (!asyncCommandSocket_) {
+    return folly::makeSemiFutureWith([this]() { return getMetrics(); });
+  }
 
-  return metrics;
+  auto metrics =
+      std::make_shared<std::unordered_map<folly::MacAddress, int32_t>>();
+  return asyncCommandSocket_
+      ->sendCommand(
+          makeMeshDumpMessage(NL80211_CMD_GET_MPATH),
+          [metrics](const GenericNetlinkMessage& msg) {
+            return parseMeshPathMetric(msg, *metrics);
+          })
+      .deferValue([metrics](folly::Unit) { return std::move(*metrics); });
 }
 
 void
@@ -1838,7 +1978,7 @@ Nl80211Handler::setMeshConnectedToGate(bool isConnected) {
       ifIndex,
       isConnected);
   nla_nest_end(msg, container);
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
 }
 
 void
@@ -1865,7 +2005,7 @@ Nl80211Handler::setRootMode(uint8_t mode) {
       ifIndex,
       mode);
   nla_nest_end(msg, container);
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
 }
 
 void
@@ -1893,5 +2033,5 @@ Nl80211Handler::setRssiThreshold(int32_t rssiThreshold) {
       ifIndex,
       rssiThreshold);
   nla_nest_end(msg, container);
-  GenericNetlinkSocket{}.sendAndReceive(msg);
+  GenericNetlinkSocket::sendCommand(msg);
 }
@@ -19,10 +19,15 @@
 #include <fbzmq/async/ZmqEventLoop.h>
 #include <folly/Optional.h>
 #include <folly/Portability.h>
+#include <folly/futures/Future.h>
+#include <folly/io/async/EventBase.h>
 
 #include <fbmeshd/802.11s/NetInterface.h>
+#include <fbmeshd/802.11s/StationInfo.h>
+#include <fbmeshd/802.11s/StationInfoCache.h>
 #include <fbmeshd/common/ErrorCodes.h>
 #include <fbmeshd/if/gen-cpp2/fbmeshd_types.h>
+#include <fbmeshd/nl/AsyncGenericNetlinkSocket.h>
 #include <fbmeshd/nl/GenericNetlinkMessage.h>
 #include <fbmeshd/nl/GenericNetlinkSocket.h>
 #include <fbmeshd/nl/TabularNetlinkAttribute.h>
@@ -45,12 +50,10 @@ DECLARE_uint32(mesh_hwmp_rann_interval);
 
 namespace fbmeshd {
 
-struct StationInfo {
-  folly::MacAddress macAddress;
-  std::chrono::milliseconds inactiveTime;
-  int32_t signalAvgDbm;
-  bool isConnectedToGate;
-  uint32_t expectedThroughput;
+enum class StationEvent {
+  ADDED = 0,
+  PLINK_ESTABLISHED = 1,
+  REMOVED = 2,
 };
 
 class Nl80211HandlerInterface {
@@ -72,10 +75,13 @@ class Nl80211Handler final : public Nl80211HandlerInterface {
   Nl80211Handler& operator=(Nl80211Handler&&) = delete;
 
  public:
+  // If commandEvb is given, the *Async() requests are sent on a non-blocking
+  // socket driven by it; otherwise they block the calling thread
   Nl80211Handler(
       fbzmq::ZmqEventLoop& zmqLoop,
       const std::string& interface,
-      bool userspace_mesh_peering);
+      bool userspace_mesh_peering,
+      folly::EventBase* commandEvb = nullptr);
 
   ~Nl80211Handler();
 
@@ -124,6 +130,25 @@ class Nl80211Handler final : public Nl80211HandlerInterface {
 
   FOLLY_NODISCARD std::unordered_map<folly::MacAddress, int32_t> getMetrics();
 
+  // Non-blocking variants of the above; the returned futures complete on the
+  // command event base once the kernel has finished its dump. Station info is
+  // shared through a cache, see --station_info_cache_max_age_ms.
+  FOLLY_NODISCARD folly::SemiFuture<std::vector<folly::MacAddress>>
+  getPeersAsync();
+
+  FOLLY_NODISCARD folly::SemiFuture<std::vector<StationInfo>>
+  getStationsInfoAsync();
+
+  FOLLY_NODISCARD
+  folly::SemiFuture<std::unordered_map<folly::MacAddress, int32_t>>
+  getMetricsAsync();
+
+  // Register a callback for stations being added to or removed from the mesh
+  // interface, and for peer links we establish. Callbacks run on the zmq event
+  // loop and must be registered before it starts.
+  void addStationEventCallback(
+      std::function<void(StationEvent, folly::MacAddress)> cb);
+
   // authsae has callbacks into named C functions that forward the calls to this
   // class to actually do the netlink operations that are necessary. These
   // methods must be public as a result, although they are not intended for the
@@ -157,6 +182,8 @@ class Nl80211Handler final : public Nl80211HandlerInterface {
   void initNlSockets();
   status_t handleNewCandidate(const GenericNetlinkMessage& msg);
   status_t handleDeletedPeer(const GenericNetlinkMessage& msg);
+  void notifyStationEvent(StationEvent event, const GenericNetlinkMessage& msg);
+  void notifyStationEvent(StationEvent event, folly::MacAddress peer);
 
   static void parseWiphyBands(
       NetInterface& netInterface,
@@ -180,6 +207,15 @@ class Nl80211Handler final : public Nl80211HandlerInterface {
   }
   void processResponse();
 
+  // Build a dump request for the mesh interface
+  std::unique_ptr<GenericNetlinkMessage> makeMeshDumpMessage(uint8_t cmd);
+
+  // Station dump bypassing stationInfoCache_
+  folly::SemiFuture<std::vector<StationInfo>> dumpStationsInfo();
+
+  // Station dump on the blocking command socket
+  std::vector<StationInfo> dumpStationsInfoSync();
+
   void eventDataReady();
 
   // Network interface control methods
@@ -211,6 +247,14 @@ class Nl80211Handler final : public Nl80211HandlerInterface {
   fbzmq::ZmqEventLoop& zmqLoop_;
   std::unordered_map<folly::MacAddress, int32_t> metrics_;
   bool userspace_mesh_peering_;
+  std::vector<std::function<void(StationEvent, folly::MacAddress)>>
+      stationEventCallbacks_;
+  // Declared before asyncCommandSocket_, which completes its dumps when it is
+  // destroyed
+  StationInfoCache stationInfoCache_;
+  // Completes the dumps of asyncCommandSocket_, so it must never wait for them
+  folly::EventBase* commandEvb_{nullptr};
+  std::unique_ptr<AsyncGenericNetlinkSocket> asyncCommandSocket_;
 };
 
 std::ostream& operator<<(std::ostream& out, const Nl80211Handler& nl);
@@ -0,0 +1,25 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include <folly/MacAddress.h>
+
+namespace fbmeshd {
+
+struct StationInfo {
+  folly::MacAddress macAddress;
+  std::chrono::milliseconds inactiveTime;
+  int32_t signalAvgDbm;
+  bool isConnectedToGate;
+  uint32_t expectedThroughput;
+};
+
+} // namespace fbmeshd
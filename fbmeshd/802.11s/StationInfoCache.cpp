@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "StationInfoCache.h"
+
+#include <glog/logging.h>
+
+#include <folly/executors/InlineExecutor.h>
+
+using namespace fbmeshd;
+
+StationInfoCache::StationInfoCache(
+    DumpFunction dump, std::chrono::milliseconds maxAge)
+    : dump_{std::move(dump)}, maxAge_{maxAge} {}
+
+folly::SemiFuture<std::vector<StationInfo>>
+StationInfoCache::get() {
+  auto result = folly::SemiFuture<std::vector<StationInfo>>::makeEmpty();
+  std::shared_ptr<folly::SharedPromise<std::vector<StationInfo>>> promise;
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (stations_.hasValue() &&
+        std::chrono::steady_clock::now() - updated_ < maxAge_) {
+      return folly::makeSemiFuture(*stations_);
+    }
+    // A dump started before the last invalidate() may miss the station event
+    // that caused it, so it is only joined if it is current
+    if (inFlight_ && inFlightGeneration_ == generation_) {
+      return inFlight_->getSemiFuture();
+    }
+    // A stale dump keeps running for its own waiters
+    inFlight_ =
+        std::make_shared<folly::SharedPromise<std::vector<StationInfo>>>();
+    inFlightGeneration_ = generation_;
+    promise = inFlight_;
+    result = promise->getSemiFuture();
+    generation = generation_;
+    numDumps_++;
+  }
+
+  VLOG(8) << "StationInfoCache: starting station dump";
+  // Completes on whichever thread finishes the dump
+  folly::makeSemiFutureWith(dump_)
+      .via(&folly::InlineExecutor::instance())
+      .thenTry([this, generation, promise = std::move(promise)](
+                   folly::Try<std::vector<StationInfo>>&& stations) {
+        dumpComplete(generation, promise, std::move(stations));
+      });
+  return result;
+}
+
+void
+StationInfoCache::dumpComplete(
+    uint64_t generation,
+    const std::shared_ptr<folly::SharedPromise<std::vector<StationInfo>>>&
+        promise,
+    folly::Try<std::vector<StationInfo>>&& stations) {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (inFlight_ == promise) {
+      inFlight_.reset();
+    }
+    if (stations.hasValue() && generation == generation_) {
+      stations_ = stations.value();
+      updated_ = std::chrono::steady_clock::now();
+    }
+  }
+  promise->setTry(std::move(stations));
+}
+
+void
+StationInfoCache::invalidate() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  generation_++;
+  stations_.clear();
+}
+
+uint64_t
+StationInfoCache::getNumDumps() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return numDumps_;
+}
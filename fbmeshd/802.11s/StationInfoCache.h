@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <folly/futures/Future.h>
+#include <folly/futures/SharedPromise.h>
+
+#include <fbmeshd/802.11s/StationInfo.h>
+
+namespace fbmeshd {
+
+/*
+ * Serves station info from the last station dump while it is younger than the
+ * configured max age.
+ *
+ * Requests that miss the cache while a dump is in flight wait for that dump
+ * instead of starting their own, so any number of concurrent readers cost a
+ * single dump. Station events invalidate the cache; a dump that was in flight
+ * when that happened is still handed to its waiters but not cached, and
+ * requests made after the event start a new dump instead of joining it.
+ */
+class StationInfoCache {
+ public:
+  using DumpFunction =
+      std::function<folly::SemiFuture<std::vector<StationInfo>>()>;
+
+  StationInfoCache(DumpFunction dump, std::chrono::milliseconds maxAge);
+
+  StationInfoCache() = delete;
+  StationInfoCache(const StationInfoCache&) = delete;
+  StationInfoCache(StationInfoCache&&) = delete;
+  StationInfoCache& operator=(const StationInfoCache&) = delete;
+  StationInfoCache& operator=(StationInfoCache&&) = delete;
+
+  // Safe to call from any thread
+  folly::SemiFuture<std::vector<StationInfo>> get();
+  void invalidate();
+
+  // Number of dumps started so far
+  uint64_t getNumDumps() const;
+
+ private:
+  void dumpComplete(
+      uint64_t generation,
+      const std::shared_ptr<folly::SharedPromise<std::vector<StationInfo>>>&
+          promise,
+      folly::Try<std::vector<StationInfo>>&& stations);
+
+  const DumpFunction dump_;
+  const std::chrono::milliseconds maxAge_;
+
+  mutable std::mutex mutex_;
+  folly::Optional<std::vector<StationInfo>> stations_;
+  std::chrono::steady_clock::time_point updated_;
+  // Bumped by invalidate() so that dumps started before it are not cached
+  uint64_t generation_{0};
+  // Latest dump in flight, and the generation it started at
+  std::shared_ptr<folly::SharedPromise<std::vector<StationInfo>>> inFlight_;
+  uint64_t inFlightGeneration_{0};
+  uint64_t numDumps_{0};
+};
+
+} // namespace fbmeshd
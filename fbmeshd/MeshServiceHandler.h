@@ -78,43 +78,40 @@ class MeshServiceHandler final : public thrift::MeshServiceSvIf {
     }
   }
 
+  // Peers and metrics come from non-blocking nl80211 dumps, so these wait on
+  // the thrift thread without holding up the routing event base
   void
   getPeers(
       std::vector<std::string>& returnVal,
-      std::unique_ptr<std::string> ifNamePtr) override {
+      std::unique_ptr<std::string> /* ifNamePtr */) override {
     VLOG(8) << folly::sformat("MeshServiceHandler::{}()", __func__);
-    serviceFunc<std::vector<std::string>>(
-        returnVal,
-        ifNamePtr,
-        [this](std::string&, std::vector<std::string>* returnVal) {
-          for (auto peer : nlHandler_.getPeers()) {
-            returnVal->push_back(peer.toString());
-          }
-          return true;
-        },
-        "error receiving peer list from netlink");
+    try {
+      for (const auto& peer : nlHandler_.getPeersAsync().get()) {
+        returnVal.push_back(peer.toString());
+      }
+    } catch (const std::exception&) {
+      throw(thrift::MeshServiceError("error receiving peer list from netlink"));
+    }
   }
 
   void
   getMetrics(
       thrift::PeerMetrics& returnVal,
-      std::unique_ptr<std::string> ifNamePtr) override {
+      std::unique_ptr<std::string> /* ifNamePtr */) override {
     VLOG(8) << folly::sformat("MeshServiceHandler::{}()", __func__);
-    serviceFunc<thrift::PeerMetrics>(
-        returnVal,
-        ifNamePtr,
-        [this](std::string&, thrift::PeerMetrics* returnVal) {
-          const auto metrics = nlHandler_.getMetrics();
-          std::transform(
-              metrics.begin(),
-              metrics.end(),
-              std::inserter(*returnVal, returnVal->begin()),
-              [](const auto& elem) {
-                return std::make_pair(elem.first.toString(), elem.second);
-              });
-          return true;
-        },
-        "error receiving peer metrics from netlink");
+    try {
+      const auto metrics = nlHandler_.getMetricsAsync().get();
+      std::transform(
+          metrics.begin(),
+          metrics.end(),
+          std::inserter(returnVal, returnVal.begin()),
+          [](const auto& elem) {
+            return std::make_pair(elem.first.toString(), elem.second);
+          });
+    } catch (const std::exception&) {
+      throw(
+          thrift::MeshServiceError("error receiving peer metrics from netlink"));
+    }
   }
 
   void
@@ -150,24 +147,24 @@ class MeshServiceHandler final : public thrift::MeshServiceSvIf {
     if (!routing_) {
       return;
     }
-    auto mpaths = routing_->dumpMpaths();
-    for (const auto& it : mpaths) {
+    const auto snapshot = routing_->getSnapshot();
+    for (const auto& mpath : snapshot->meshPaths) {
       ret.push_back(thrift::MpathEntry{
           apache::thrift::FragileConstructor::FRAGILE,
-          it.first.u64NBO(),
-          it.second.nextHop.u64NBO(),
-          it.second.sn,
-          it.second.metric,
+          mpath.dst.u64NBO(),
+          mpath.nextHop.u64NBO(),
+          mpath.sn,
+          mpath.metric,
           std::max(
               static_cast<uint64_t>(0),
               static_cast<uint64_t>(
                   std::chrono::duration_cast<std::chrono::milliseconds>(
-                      it.second.expTime - std::chrono::steady_clock::now())
+                      mpath.expTime - std::chrono::steady_clock::now())
                       .count())),
-          it.second.nextHopMetric,
-          it.second.hopCount,
-          it.second.isRoot,
-          it.second.isGate,
+          mpath.nextHopMetric,
+          mpath.hopCount,
+          mpath.isRoot,
+          mpath.isGate,
       });
     }
   }
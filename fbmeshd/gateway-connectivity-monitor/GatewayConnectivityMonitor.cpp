@@ -8,9 +8,16 @@
 #include "GatewayConnectivityMonitor.h"
 
 #include <time.h>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
 
+#include <folly/Chrono.h>
+#include <folly/Conv.h>
 #include <folly/FileUtil.h>
+#include <folly/String.h>
 
 #include <fbmeshd/debugfs/DebugFsWriter.h>
 #include <fbmeshd/gateway-connectivity-monitor/Socket.h>
@@ -18,6 +25,26 @@
 static constexpr folly::StringPiece statPathPrefixTemplate{
     "fbmeshd.gateway_connectivity_monitor.{}"};
 
+static constexpr folly::StringPiece interfaceSysFsTemplate{
+    "/sys/class/net/{}/{}"};
+
+// Weight of a new WAN utilization measurement in the smoothed value
+static constexpr double wanUtilizationEwmaFactor{0.25};
+
+// The advertised utilization only follows the measurement once the two are
+// this many points apart, so that noise does not reach every node's gate
+// selection
+static constexpr int gateUtilizationHysteresis{10};
+
+// Rounds of probes the WAN RTT and loss are measured over, the window holds
+// this many samples per attempt to an address
+static constexpr size_t wanQualityWindow{60};
+
+// Same as gateUtilizationHysteresis, for the WAN quality
+static constexpr int wanQualityHysteresis{5};
+
+static constexpr int wanRttPercentiles[]{50, 90, 99};
+
 using namespace fbmeshd;
 
 template <typename... Params>
@@ -31,6 +58,18 @@ void writeProcFs(
       O_WRONLY);
 }
 
+static folly::Optional<int64_t> readSysFsValue(const std::string& path) {
+  std::string value;
+  if (!folly::readFile(path.c_str(), value)) {
+    return folly::none;
+  }
+  auto result = folly::tryTo<int64_t>(folly::trimWhitespace(value));
+  if (result.hasError()) {
+    return folly::none;
+  }
+  return result.value();
+}
+
 GatewayConnectivityMonitor::GatewayConnectivityMonitor(
     folly::EventBase* evb,
     Nl80211Handler& nlHandler,
@@ -45,6 +84,9 @@ GatewayConnectivityMonitor::GatewayConnectivityMonitor(
     std::chrono::seconds maxSuppressLimit,
     unsigned int robustness,
     uint8_t setRootModeIfGate,
+    bool advertiseGateLoad,
+    uint32_t wanCapacityKbps,
+    bool advertiseWanQuality,
     Routing* routing,
     StatsClient& statsClient)
     : RouteDampener{evb,
@@ -53,56 +95,56 @@ GatewayConnectivityMonitor::GatewayConnectivityMonitor(
                     reuseLimit,
                     halfLife,
                     maxSuppressLimit},
+      evb_{evb},
       nlHandler_{nlHandler},
       monitoredInterface_{monitoredInterface},
       monitoredAddresses_{monitoredAddresses},
+      monitorInterval_{monitorInterval},
       monitorSocketTimeout_{monitorSocketTimeout},
       robustness_{robustness},
       setRootModeIfGate_{setRootModeIfGate},
+      advertiseGateLoad_{advertiseGateLoad},
+      wanCapacityKbps_{wanCapacityKbps},
+      advertiseWanQuality_{advertiseWanQuality},
       routing_{routing},
-      statsClient_{statsClient} {
+      statsClient_{statsClient},
+      wanQuality_{wanQualityWindow * std::max(robustness, 1u)} {
   // Disable reverse path filtering, i.e.
   // Do not drop packets from non-routable addresses on monitored interface
   writeProcFs("0", "/proc/sys/net/ipv4/conf/{}/rp_filter", monitoredInterface);
   writeProcFs("0", "/proc/sys/net/ipv4/conf/all/rp_filter");
 
-  // Set timer to check routes
+  // Per-address WAN stats are keyed by position, log what each one refers to
+  for (size_t i = 0; i < monitoredAddresses_.size(); i++) {
+    LOG(INFO) << "WAN probe address" << i << ": "
+              << monitoredAddresses_[i].describe();
+  }
+
+  // Set timer to check routes. The next check is scheduled once the probes
+  // complete, so rounds of probes never overlap.
   connectivityCheckTimer_ = folly::AsyncTimeout::make(
-      *evb, [ this, monitorInterval ]() mutable noexcept {
-        checkRoutesAndAdvertise();
-        connectivityCheckTimer_->scheduleTimeout(monitorInterval);
-      });
-  connectivityCheckTimer_->scheduleTimeout(monitorInterval);
+      *evb_, [this]() noexcept { probeWanConnectivity(); });
+  connectivityCheckTimer_->scheduleTimeout(monitorInterval_);
 }
 
-bool GatewayConnectivityMonitor::probeWanConnectivityRobustly() {
+void GatewayConnectivityMonitor::probeWanConnectivity() {
   VLOG(8) << folly::sformat("GatewayConnectivityMonitor::{}()", __func__);
-  for (size_t tryNum{0}; tryNum < robustness_; ++tryNum) {
-    if (probeWanConnectivity()) {
-      return true;
-    }
-  }
-  return false;
+  // All robustness_ attempts to every address run at once, so a dead WAN is
+  // detected within a single socket timeout
+  wanProbe_ = std::make_unique<WanProbe>(
+      evb_,
+      monitoredInterface_,
+      monitoredAddresses_,
+      robustness_,
+      monitorSocketTimeout_);
+  wanProbe_->start(
+      [this](const Socket::Result& result) { wanProbeComplete(result); },
+      [this]() { wanProbeFinished(); });
 }
 
-bool GatewayConnectivityMonitor::probeWanConnectivity() {
-  VLOG(8) << folly::sformat("GatewayConnectivityMonitor::{}()", __func__);
-  Socket::Result result;
-  bool connectionSucceeded = false;
-  for (const auto& monitoredAddress : monitoredAddresses_) {
-    Socket socket;
-    if ((result = socket.connect(
-             monitoredInterface_, monitoredAddress, monitorSocketTimeout_))
-            .success) {
-      VLOG(8) << "Successfully connected to " << monitoredAddress;
-      connectionSucceeded = true;
-      break;
-    } else {
-      VLOG(8) << "Failed to connect to " << monitoredAddress;
-    }
-  }
-
-  if (connectionSucceeded) {
+void GatewayConnectivityMonitor::wanProbeComplete(
+    const Socket::Result& result) {
+  if (result.success) {
     VLOG(8) << "Probing WAN connectivity succeeded";
     statsClient_.incrementSumStat(
         "fbmeshd.gateway_connectivity_monitor.probe_wan_connectivity.success");
@@ -113,7 +155,15 @@ bool GatewayConnectivityMonitor::probeWanConnectivity() {
         "fbmeshd.gateway_connectivity_monitor.probe_wan_connectivity.failed.{}",
         result.errorMsg));
   }
-  return connectionSucceeded;
+
+  checkRoutesAndAdvertise(result.success);
+}
+
+void GatewayConnectivityMonitor::wanProbeFinished() {
+  wanQuality_.addSamples(wanProbe_->getSamples());
+  updateWanQuality();
+
+  connectivityCheckTimer_->scheduleTimeout(monitorInterval_);
 }
 
 void GatewayConnectivityMonitor::setStat(const std::string& path, int value) {
@@ -137,9 +187,12 @@ void GatewayConnectivityMonitor::undampen() {
   }
 }
 
-void GatewayConnectivityMonitor::checkRoutesAndAdvertise() {
+void GatewayConnectivityMonitor::checkRoutesAndAdvertise(bool wanConnected) {
   VLOG(8) << folly::sformat("GatewayConnectivityMonitor::{}()", __func__);
-  if (probeWanConnectivityRobustly()) {
+  if (advertiseGateLoad_) {
+    updateGateLoad();
+  }
+  if (wanConnected) {
     VLOG(8) << "Successfully probed wan connectivity";
     if (!isDampened()) {
       DebugFsWriter::writeDebugStat("is_gateway", true);
@@ -177,3 +230,126 @@ void GatewayConnectivityMonitor::withdrawDefaultRoute() {
     routing_->setGatewayStatus(false);
   }
 }
+
+folly::Optional<uint32_t> GatewayConnectivityMonitor::getWanCapacityKbps()
+    const {
+  if (wanCapacityKbps_ != 0) {
+    return wanCapacityKbps_;
+  }
+  // In Mbps, -1 when the driver does not know
+  const auto speed = readSysFsValue(
+      folly::sformat(interfaceSysFsTemplate, monitoredInterface_, "speed"));
+  if (!speed || *speed <= 0) {
+    return folly::none;
+  }
+  return static_cast<uint32_t>(std::min<int64_t>(
+      *speed * 1000, std::numeric_limits<uint32_t>::max()));
+}
+
+void GatewayConnectivityMonitor::updateGateLoad() {
+  VLOG(8) << folly::sformat("GatewayConnectivityMonitor::{}()", __func__);
+  const auto capacityKbps = getWanCapacityKbps();
+  const auto rxBytes = readSysFsValue(folly::sformat(
+      interfaceSysFsTemplate, monitoredInterface_, "statistics/rx_bytes"));
+  const auto txBytes = readSysFsValue(folly::sformat(
+      interfaceSysFsTemplate, monitoredInterface_, "statistics/tx_bytes"));
+  if (!capacityKbps || !rxBytes || !txBytes) {
+    VLOG(8) << "WAN load unknown, not advertising it";
+    lastCounters_.clear();
+    if (advertisedGateLoad_ && routing_) {
+      routing_->setGateLoad(folly::none);
+    }
+    advertisedGateLoad_.clear();
+    return;
+  }
+
+  const InterfaceCounters counters{std::chrono::steady_clock::now(),
+                                   static_cast<uint64_t>(*rxBytes),
+                                   static_cast<uint64_t>(*txBytes)};
+  if (!lastCounters_) {
+    lastCounters_ = counters;
+    return;
+  }
+  const std::chrono::duration<double> elapsed{counters.time -
+                                              lastCounters_->time};
+  // Counters go backwards when the interface is reset
+  const auto rxDelta = counters.rxBytes >= lastCounters_->rxBytes
+      ? counters.rxBytes - lastCounters_->rxBytes
+      : 0;
+  const auto txDelta = counters.txBytes >= lastCounters_->txBytes
+      ? counters.txBytes - lastCounters_->txBytes
+      : 0;
+  lastCounters_ = counters;
+  if (elapsed.count() <= 0) {
+    return;
+  }
+
+  // The busier direction is the one that saturates
+  const double kbps = std::max(rxDelta, txDelta) * 8 / 1000.0 / elapsed.count();
+  const double utilization = std::min(100.0, kbps * 100 / *capacityKbps);
+  wanUtilization_ += (utilization - wanUtilization_) * wanUtilizationEwmaFactor;
+  statsClient_.setAvgStat(
+      folly::sformat(statPathPrefixTemplate, "wan_utilization"),
+      std::lround(wanUtilization_));
+
+  const auto utilizationPercent =
+      static_cast<uint8_t>(std::lround(wanUtilization_));
+  if (advertisedGateLoad_ &&
+      advertisedGateLoad_->capacityKbps == *capacityKbps &&
+      std::abs(utilizationPercent - advertisedGateLoad_->utilization) <
+          gateUtilizationHysteresis) {
+    return;
+  }
+  advertisedGateLoad_ = GateLoad{*capacityKbps, utilizationPercent};
+  if (routing_) {
+    routing_->setGateLoad(advertisedGateLoad_);
+  }
+}
+
+void GatewayConnectivityMonitor::updateWanQuality() {
+  VLOG(8) << folly::sformat("GatewayConnectivityMonitor::{}()", __func__);
+  for (const auto percentile : wanRttPercentiles) {
+    const auto rtt = wanQuality_.getRttPercentile(percentile);
+    if (rtt) {
+      statsClient_.setAvgStat(
+          folly::sformat(
+              statPathPrefixTemplate,
+              folly::sformat("wan_rtt_ms.p{}", percentile)),
+          folly::chrono::ceil<std::chrono::milliseconds>(*rtt).count());
+    }
+    // Keyed by position in the configured list, so that the set of keys is
+    // bounded and does not change with the addresses themselves
+    for (size_t i = 0; i < monitoredAddresses_.size(); i++) {
+      const auto addressRtt =
+          wanQuality_.getRttPercentile(monitoredAddresses_[i], percentile);
+      if (addressRtt) {
+        statsClient_.setAvgStat(
+            folly::sformat(
+                statPathPrefixTemplate,
+                folly::sformat("wan_rtt_ms.address{}.p{}", i, percentile)),
+            folly::chrono::ceil<std::chrono::milliseconds>(*addressRtt)
+                .count());
+      }
+    }
+  }
+  statsClient_.setAvgStat(
+      folly::sformat(statPathPrefixTemplate, "wan_loss_pct"),
+      std::lround(wanQuality_.getLossRate() * 100));
+
+  const auto quality = wanQuality_.getQuality();
+  statsClient_.setAvgStat(
+      folly::sformat(statPathPrefixTemplate, "wan_quality"), quality);
+  if (!advertiseWanQuality_ || !routing_) {
+    return;
+  }
+  // Recovering all the way is always passed on, so a healthy gate ends up
+  // with no penalty at all
+  if (advertisedWanQuality_ &&
+      (quality == *advertisedWanQuality_ ||
+       (std::abs(quality - *advertisedWanQuality_) < wanQualityHysteresis &&
+        quality != 100))) {
+    return;
+  }
+  advertisedWanQuality_ = quality;
+  routing_->setWanQuality(quality);
+}
@@ -7,13 +7,19 @@
 
 #pragma once
 
+#include <chrono>
+
+#include <folly/Optional.h>
 #include <folly/SocketAddress.h>
 #include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/EventBase.h>
 
 #include <fbmeshd/802.11s/Nl80211Handler.h>
 #include <fbmeshd/gateway-connectivity-monitor/RouteDampener.h>
+#include <fbmeshd/gateway-connectivity-monitor/Socket.h>
 #include <fbmeshd/gateway-connectivity-monitor/StatsClient.h>
+#include <fbmeshd/gateway-connectivity-monitor/WanProbe.h>
+#include <fbmeshd/gateway-connectivity-monitor/WanQualityTracker.h>
 #include <fbmeshd/routing/Routing.h>
 
 namespace fbmeshd {
@@ -34,6 +40,9 @@ class GatewayConnectivityMonitor : public RouteDampener {
       std::chrono::seconds maxSuppressLimit,
       unsigned int robustness,
       uint8_t setRootModeIfGate,
+      bool advertiseGateLoad,
+      uint32_t wanCapacityKbps,
+      bool advertiseWanQuality,
       Routing* routing,
       StatsClient& statsClient);
 
@@ -50,29 +59,64 @@ class GatewayConnectivityMonitor : public RouteDampener {
   void dampen() override;
   void undampen() override;
 
-  bool probeWanConnectivity();
-  bool probeWanConnectivityRobustly();
+  // Start a round of probes. wanProbeComplete() acts on the result as soon as
+  // it is known, wanProbeFinished() records the samples once the remaining
+  // attempts are done and schedules the next round.
+  void probeWanConnectivity();
+  void wanProbeComplete(const Socket::Result& result);
+  void wanProbeFinished();
 
-  void checkRoutesAndAdvertise();
+  void checkRoutesAndAdvertise(bool wanConnected);
 
   void advertiseDefaultRoute();
   void withdrawDefaultRoute();
 
+  // Measure the WAN utilization from the monitored interface's counters and
+  // pass it on to Routing for our PANNs
+  void updateGateLoad();
+  folly::Optional<uint32_t> getWanCapacityKbps() const;
+
+  // Export the RTT and loss of the recent rounds of probes, and pass the WAN
+  // quality on to Routing for our PANNs
+  void updateWanQuality();
+
  private:
+  folly::EventBase* evb_{nullptr};
   Nl80211Handler& nlHandler_;
 
   const std::string monitoredInterface_;
   const std::vector<folly::SocketAddress> monitoredAddresses_;
+  const std::chrono::seconds monitorInterval_;
   const std::chrono::seconds monitorSocketTimeout_;
   const unsigned int robustness_;
   const uint8_t setRootModeIfGate_;
+  const bool advertiseGateLoad_;
+  // Zero uses the link speed of the monitored interface
+  const uint32_t wanCapacityKbps_;
+  const bool advertiseWanQuality_;
   Routing* routing_{nullptr};
 
   std::unique_ptr<folly::AsyncTimeout> connectivityCheckTimer_;
+  // The last round of probes, kept until the next one starts
+  std::unique_ptr<WanProbe> wanProbe_;
 
   StatsClient& statsClient_;
 
   bool isGatewayActive_{false};
+
+  // Interface byte counters at the previous updateGateLoad()
+  struct InterfaceCounters {
+    std::chrono::steady_clock::time_point time;
+    uint64_t rxBytes{0};
+    uint64_t txBytes{0};
+  };
+  folly::Optional<InterfaceCounters> lastCounters_;
+  // Smoothed WAN utilization in percent
+  double wanUtilization_{0};
+  folly::Optional<GateLoad> advertisedGateLoad_;
+
+  WanQualityTracker wanQuality_;
+  folly::Optional<uint8_t> advertisedWanQuality_;
 };
 
 } // namespace fbmeshd
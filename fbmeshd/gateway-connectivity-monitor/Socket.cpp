@@ -27,6 +27,30 @@ Socket::connect(
     const std::string& interface,
     const folly::SocketAddress& address,
     const std::chrono::seconds& socketTimeout) {
+  auto result = startConnect(interface, address);
+  if (!result.inProgress) {
+    return result;
+  }
+
+  // Connection is in progress, wait for timeout
+  fd_set writefds;
+  FD_ZERO(&writefds);
+  FD_SET(fd, &writefds);
+
+  timeval timeout;
+  timeout.tv_sec = socketTimeout.count();
+  timeout.tv_usec = 0;
+
+  if (::select(fd + 1, nullptr, &writefds, nullptr, &timeout) == 0) {
+    return {false, "timeout"};
+  }
+
+  return finishConnect();
+}
+
+Socket::Result
+Socket::startConnect(
+    const std::string& interface, const folly::SocketAddress& address) {
   if (fd != -1) {
     return {false, "in_use"};
   }
@@ -75,19 +99,11 @@ Socket::connect(
     return {false, "not_einprogress"};
   }
 
-  // Connection is in progress, wait for timeout
-  fd_set writefds;
-  FD_ZERO(&writefds);
-  FD_SET(fd, &writefds);
-
-  timeval timeout;
-  timeout.tv_sec = socketTimeout.count();
-  timeout.tv_usec = 0;
-
-  if (::select(fd + 1, nullptr, &writefds, nullptr, &timeout) == 0) {
-    return {false, "timeout"};
-  }
+  return {false, "in_progress", true};
+}
 
+Socket::Result
+Socket::finishConnect() {
   int err;
   socklen_t err_len{sizeof(err)};
   if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) != 0) {
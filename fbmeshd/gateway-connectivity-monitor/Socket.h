@@ -21,6 +21,8 @@ class Socket final {
   struct Result {
     bool success;
     std::string errorMsg;
+    // A connect started by startConnect() has not completed yet
+    bool inProgress{false};
   };
 
   Socket() = default;
@@ -35,6 +37,17 @@ class Socket final {
       const folly::SocketAddress& address,
       const std::chrono::seconds& socketTimeout);
 
+  // Non-blocking connect: if the result is inProgress, wait for getFd() to
+  // become writable and then call finishConnect()
+  Result startConnect(
+      const std::string& interface, const folly::SocketAddress& address);
+  Result finishConnect();
+
+  int
+  getFd() const {
+    return fd;
+  }
+
  private:
   int fd{-1};
 };
@@ -35,6 +35,7 @@ void StatsClient::addStatValue(
     StatsType type) {
   VLOG(8) << folly::sformat("StatsClient::{}()", __func__);
 
+  std::lock_guard<std::mutex> lock{mutex_};
   auto it = stats_.find(key);
   if (it == stats_.end()) {
     VLOG(8) << folly::sformat("Initializing stats entry for {}...", key);
@@ -62,6 +63,11 @@ void StatsClient::incrementSumStat(const std::string& stat) {
   addStatValue(stat, 1, StatsType::SUM);
 }
 
+void StatsClient::incrementSumStat(const std::string& stat, int64_t value) {
+  VLOG(8) << folly::sformat("StatsClient::{}() sum: {}", __func__, stat);
+  addStatValue(stat, value, StatsType::SUM);
+}
+
 void StatsClient::setAvgStat(const std::string& stat, int value) {
   VLOG(8) << folly::sformat("StatsClient::{}() avg: {}", __func__, stat);
   addStatValue(stat, value, StatsType::AVG);
@@ -71,6 +77,7 @@ const std::unordered_map<std::string, int64_t> StatsClient::getStats() {
   VLOG(8) << folly::sformat("StatsClient::{}()", __func__);
   std::unordered_map<std::string, int64_t> counters;
 
+  std::lock_guard<std::mutex> lock{mutex_};
   for (auto& kv : stats_) {
     const std::string& key_ = kv.first;
 
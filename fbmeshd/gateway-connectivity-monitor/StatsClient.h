@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <mutex>
 #include <string>
 
 #include <folly/container/F14Map.h>
@@ -32,11 +33,16 @@ class StatsClient final {
   StatsClient& operator=(StatsClient&&) = delete;
 
   void incrementSumStat(const std::string& stat);
+  void incrementSumStat(const std::string& stat, int64_t value);
   void setAvgStat(const std::string& stat, int value);
 
   const std::unordered_map<std::string, int64_t> getStats();
 
  private:
+  // Stats are reported from several threads (routing, gateway connectivity
+  // monitor) and read from the thrift server thread
+  std::mutex mutex_;
+
   folly::F14FastMap<
       std::string,
       folly::MultiLevelTimeSeries<int64_t>>
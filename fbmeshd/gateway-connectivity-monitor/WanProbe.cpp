@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "WanProbe.h"
+
+#include <glog/logging.h>
+
+#include <folly/Format.h>
+
+using namespace fbmeshd;
+
+WanProbe::Attempt::Attempt(WanProbe& probe, size_t index)
+    : index{index}, probe_{probe} {}
+
+void
+WanProbe::Attempt::handlerReady(uint16_t) noexcept {
+  unregisterHandler();
+  probe_.attemptComplete(*this, socket.finishConnect());
+}
+
+WanProbe::WanProbe(
+    folly::EventBase* evb,
+    const std::string& interface,
+    const std::vector<folly::SocketAddress>& addresses,
+    size_t attemptsPerAddress,
+    std::chrono::milliseconds timeout)
+    : evb_{evb}, interface_{interface}, timeout_{timeout} {
+  for (const auto& address : addresses) {
+    for (size_t i = 0; i < attemptsPerAddress; i++) {
+      attempts_.push_back(std::make_unique<Attempt>(*this, samples_.size()));
+      samples_.push_back(Sample{address, folly::none, false});
+    }
+  }
+  timeoutTimer_ = folly::AsyncTimeout::make(*evb_, [this]() noexcept {
+    complete({false, "timeout"});
+    finish();
+  });
+}
+
+WanProbe::~WanProbe() {
+  // Sockets still connecting are closed by ~Socket()
+  for (auto& attempt : attempts_) {
+    attempt->unregisterHandler();
+  }
+}
+
+void
+WanProbe::start(Callback callback, FinishedCallback finishedCallback) {
+  VLOG(8) << folly::sformat(
+      "WanProbe::{}(attempts: {})", __func__, attempts_.size());
+  evb_->dcheckIsInEventBaseThread();
+  callback_ = std::move(callback);
+  finishedCallback_ = std::move(finishedCallback);
+  start_ = std::chrono::steady_clock::now();
+
+  if (attempts_.empty()) {
+    complete({false, "no_addresses"});
+    finish();
+    return;
+  }
+  timeoutTimer_->scheduleTimeout(timeout_);
+
+  for (auto& attempt : attempts_) {
+    const auto result = attempt->socket.startConnect(
+        interface_, samples_[attempt->index].address);
+    if (!result.inProgress) {
+      attemptComplete(*attempt, result);
+      continue;
+    }
+    attempt->initHandler(
+        evb_, folly::NetworkSocket::fromFd(attempt->socket.getFd()));
+    attempt->registerHandler(folly::EventHandler::WRITE);
+  }
+}
+
+void
+WanProbe::attemptComplete(
+    const Attempt& attempt, const Socket::Result& result) {
+  auto& sample = samples_[attempt.index];
+  if (result.success) {
+    VLOG(8) << "Successfully connected to " << sample.address;
+    sample.rtt = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_);
+    complete(result);
+  } else {
+    VLOG(8) << "Failed to connect to " << sample.address << ": "
+            << result.errorMsg;
+    sample.lost = true;
+    if (++numFailed_ == attempts_.size()) {
+      complete(result);
+    }
+  }
+  if (++numCompleted_ == attempts_.size()) {
+    finish();
+  }
+}
+
+void
+WanProbe::complete(const Socket::Result& result) {
+  if (completed_) {
+    return;
+  }
+  completed_ = true;
+  VLOG(8) << folly::sformat(
+      "WAN probe {} after {}ms",
+      result.success ? "succeeded" : "failed",
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start_)
+          .count());
+  callback_(result);
+}
+
+void
+WanProbe::finish() {
+  if (finished_) {
+    return;
+  }
+  finished_ = true;
+  timeoutTimer_->cancelTimeout();
+  for (auto& attempt : attempts_) {
+    attempt->unregisterHandler();
+  }
+  // Includes the attempts that timed out
+  for (auto& sample : samples_) {
+    if (!sample.rtt) {
+      sample.lost = true;
+    }
+  }
+  finishedCallback_();
+}
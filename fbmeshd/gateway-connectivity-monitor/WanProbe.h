@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <folly/SocketAddress.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+
+#include <fbmeshd/gateway-connectivity-monitor/Socket.h>
+
+namespace fbmeshd {
+
+/*
+ * One round of WAN connectivity probes.
+ *
+ * Every connection attempt is started at once as a non-blocking socket on the
+ * EventBase. The round succeeds with the first attempt that connects, and
+ * fails when all of them have failed or when the deadline passes, whichever
+ * comes first. A dead WAN therefore costs one timeout, not one per attempt.
+ * The remaining attempts keep running after a success, up to the deadline, so
+ * that the samples cover every attempt.
+ */
+class WanProbe {
+ public:
+  using Callback = std::function<void(const Socket::Result&)>;
+  using FinishedCallback = std::function<void()>;
+
+  /**
+   * outcome of one attempt
+   *
+   * @rtt: time to connect, if the attempt did
+   * @lost: the attempt failed, or had not completed by the deadline
+   */
+  struct Sample {
+    folly::SocketAddress address;
+    folly::Optional<std::chrono::microseconds> rtt;
+    bool lost{false};
+  };
+
+  WanProbe(
+      folly::EventBase* evb,
+      const std::string& interface,
+      const std::vector<folly::SocketAddress>& addresses,
+      size_t attemptsPerAddress,
+      std::chrono::milliseconds timeout);
+
+  WanProbe() = delete;
+  ~WanProbe();
+  WanProbe(const WanProbe&) = delete;
+  WanProbe(WanProbe&&) = delete;
+  WanProbe& operator=(const WanProbe&) = delete;
+  WanProbe& operator=(WanProbe&&) = delete;
+
+  // Start the attempts; must be called on the EventBase thread. callback is
+  // called once with the result of the round, finishedCallback once every
+  // attempt has completed or the deadline has passed, never before callback.
+  // Either may be called before start() returns, and neither may destroy the
+  // probe. On failure, errorMsg is that of the last attempt to fail, or
+  // "timeout".
+  void start(Callback callback, FinishedCallback finishedCallback);
+
+  // One sample per attempt, final once finishedCallback has been called
+  const std::vector<Sample>&
+  getSamples() const {
+    return samples_;
+  }
+
+ private:
+  class Attempt : public folly::EventHandler {
+   public:
+    Attempt(WanProbe& probe, size_t index);
+
+    void handlerReady(uint16_t events) noexcept override;
+
+    Socket socket;
+    // Index in attempts_ and samples_
+    const size_t index;
+
+   private:
+    WanProbe& probe_;
+  };
+
+  void attemptComplete(const Attempt& attempt, const Socket::Result& result);
+  void complete(const Socket::Result& result);
+  // Called once every attempt has completed or the deadline has passed
+  void finish();
+
+  folly::EventBase* evb_;
+  const std::string interface_;
+  const std::chrono::milliseconds timeout_;
+  std::vector<std::unique_ptr<Attempt>> attempts_;
+  std::vector<Sample> samples_;
+  std::chrono::steady_clock::time_point start_;
+  size_t numCompleted_{0};
+  size_t numFailed_{0};
+  bool completed_{false};
+  bool finished_{false};
+  Callback callback_;
+  FinishedCallback finishedCallback_;
+  std::unique_ptr<folly::AsyncTimeout> timeoutTimer_;
+};
+
+} // namespace fbmeshd
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "WanQualityTracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glog/logging.h>
+
+using namespace fbmeshd;
+
+namespace {
+// Weight of a new round in the smoothed quality
+const double kQualityEwmaFactor{0.25};
+
+// Percentile of the RTT the quality follows, so that a minority of slow
+// connects counts but a single outlier does not
+const double kQualityRttPercentile{90};
+} // namespace
+
+constexpr std::chrono::milliseconds WanQualityTracker::kGoodRtt;
+constexpr std::chrono::milliseconds WanQualityTracker::kBadRtt;
+constexpr double WanQualityTracker::kBadLossRate;
+
+WanQualityTracker::WanQualityTracker(size_t windowSize)
+    : windowSize_{windowSize} {
+  CHECK_GT(windowSize_, 0);
+}
+
+void
+WanQualityTracker::addSamples(const std::vector<WanProbe::Sample>& samples) {
+  bool added{false};
+  for (const auto& sample : samples) {
+    if (!sample.rtt && !sample.lost) {
+      continue;
+    }
+    auto& window = windows_[sample.address];
+    window.push_back(sample.rtt);
+    if (window.size() > windowSize_) {
+      window.pop_front();
+    }
+    added = true;
+  }
+  if (!added) {
+    return;
+  }
+
+  double rttPenalty{0};
+  const auto rtt = getRttPercentile(kQualityRttPercentile);
+  if (rtt) {
+    const std::chrono::duration<double, std::milli> excess{
+        *rtt - std::chrono::microseconds{kGoodRtt}};
+    const std::chrono::duration<double, std::milli> range{kBadRtt - kGoodRtt};
+    rttPenalty = std::min(1.0, std::max(0.0, excess / range));
+  }
+  const double lossPenalty = std::min(1.0, getLossRate() / kBadLossRate);
+  const double quality = 100 * (1 - rttPenalty) * (1 - lossPenalty);
+  quality_ += (quality - quality_) * kQualityEwmaFactor;
+}
+
+folly::Optional<std::chrono::microseconds>
+WanQualityTracker::getRttPercentile(double percentile) const {
+  std::vector<std::chrono::microseconds> rtts;
+  for (const auto& window : windows_) {
+    appendRtts(window.second, rtts);
+  }
+  return getPercentile(std::move(rtts), percentile);
+}
+
+folly::Optional<std::chrono::microseconds>
+WanQualityTracker::getRttPercentile(
+    const folly::SocketAddress& address, double percentile) const {
+  const auto window = windows_.find(address);
+  if (window == windows_.end()) {
+    return folly::none;
+  }
+  std::vector<std::chrono::microseconds> rtts;
+  appendRtts(window->second, rtts);
+  return getPercentile(std::move(rtts), percentile);
+}
+
+double
+WanQualityTracker::getLossRate() const {
+  size_t numSamples{0};
+  size_t numLost{0};
+  for (const auto& window : windows_) {
+    numSamples += window.second.size();
+    numLost += std::count(
+        window.second.begin(), window.second.end(), folly::none);
+  }
+  return numSamples == 0 ? 0 : static_cast<double>(numLost) / numSamples;
+}
+
+uint8_t
+WanQualityTracker::getQuality() const {
+  return static_cast<uint8_t>(std::lround(quality_));
+}
+
+folly::Optional<std::chrono::microseconds>
+WanQualityTracker::getPercentile(
+    std::vector<std::chrono::microseconds> rtts, double percentile) {
+  if (rtts.empty()) {
+    return folly::none;
+  }
+  const auto rank = static_cast<size_t>(
+      std::ceil(std::min(100.0, percentile) / 100 * rtts.size()));
+  const auto nth = rtts.begin() + (rank == 0 ? 0 : rank - 1);
+  std::nth_element(rtts.begin(), nth, rtts.end());
+  return *nth;
+}
+
+void
+WanQualityTracker::appendRtts(
+    const Window& window, std::vector<std::chrono::microseconds>& rtts) {
+  for (const auto& rtt : window) {
+    if (rtt) {
+      rtts.push_back(*rtt);
+    }
+  }
+}
@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <folly/SocketAddress.h>
+
+#include <fbmeshd/gateway-connectivity-monitor/WanProbe.h>
+
+namespace fbmeshd {
+
+/*
+ * Connect RTT and loss to the monitored addresses over the last rounds of WAN
+ * probes, condensed into a smoothed quality score.
+ *
+ * Each address keeps a window of its last windowSize samples, one per
+ * connection attempt; samples with neither an RTT nor a loss add none. The
+ * score starts at 100 and drops with the 90th percentile RTT, from
+ * kGoodRtt to kBadRtt, and with the loss rate, up to kBadLossRate.
+ */
+class WanQualityTracker {
+ public:
+  static constexpr std::chrono::milliseconds kGoodRtt{50};
+  static constexpr std::chrono::milliseconds kBadRtt{500};
+  static constexpr double kBadLossRate{0.2};
+
+  explicit WanQualityTracker(size_t windowSize);
+
+  // Add the samples of a round of probes
+  void addSamples(const std::vector<WanProbe::Sample>& samples);
+
+  // Nearest rank percentile of the RTTs in the window, over all addresses or
+  // to one of them, none without any RTT samples
+  folly::Optional<std::chrono::microseconds> getRttPercentile(
+      double percentile) const;
+  folly::Optional<std::chrono::microseconds> getRttPercentile(
+      const folly::SocketAddress& address, double percentile) const;
+
+  // Fraction of the samples in the window that were lost
+  double getLossRate() const;
+
+  // From 0 (unusable) to 100 (perfect)
+  uint8_t getQuality() const;
+
+ private:
+  // A sample is its RTT, or none if it was lost
+  using Window = std::deque<folly::Optional<std::chrono::microseconds>>;
+
+  static folly::Optional<std::chrono::microseconds> getPercentile(
+      std::vector<std::chrono::microseconds> rtts, double percentile);
+  static void appendRtts(
+      const Window& window, std::vector<std::chrono::microseconds>& rtts);
+
+  const size_t windowSize_;
+  std::unordered_map<folly::SocketAddress, Window> windows_;
+  double quality_{100};
+};
+
+} // namespace fbmeshd
@@ -59,6 +59,8 @@ service MeshService {
 
   list<StatCounter> dumpStats()
 
+  # Served from a snapshot of the routing state that is published at most
+  # every 100ms, so it may miss the latest PANNs
   list<MpathEntry> dumpMpath();
 }
 
@@ -71,6 +73,9 @@ struct MeshPathFramePANN {
   7: u32 metric
   8: bool isGate
   9: bool replyRequested
+  # WAN load of the originating gate, see fbmeshd::GateLoad
+  10: optional u32 gateCapacityKbps
+  11: optional u8 gateUtilization
 }
 
 /*
@@ -16,6 +16,7 @@
 #include <fbzmq/async/ZmqEventLoop.h>
 #include <folly/SocketAddress.h>
 #include <folly/init/Init.h>
+#include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/EventBase.h>
 #include <thrift/lib/cpp2/server/ThriftServer.h>
 
@@ -28,7 +29,9 @@
 #include <fbmeshd/common/Util.h>
 #include <fbmeshd/gateway-connectivity-monitor/GatewayConnectivityMonitor.h>
 #include <fbmeshd/gateway-connectivity-monitor/RouteDampener.h>
+#include <fbmeshd/nl/GenericNetlinkSocket.h>
 #include <fbmeshd/notifier/Notifier.h>
+#include <fbmeshd/rnl/NetlinkMessage.h>
 #include <fbmeshd/route-update-monitor/RouteUpdateMonitor.h>
 #include <fbmeshd/routing/MetricManager80211s.h>
 #include <fbmeshd/routing/PeriodicPinger.h>
@@ -80,6 +83,23 @@ DEFINE_uint32(
     gateway_connectivity_monitor_set_root_mode,
     0,
     "The value for root mode that should be set if we are a gate");
+DEFINE_bool(
+    gateway_connectivity_monitor_advertise_load,
+    false,
+    "Advertise the WAN capacity and utilization of the monitored interface in"
+    " our PANNs while we are a gate, so that other nodes prefer less loaded"
+    " gates");
+DEFINE_uint32(
+    gateway_connectivity_monitor_wan_capacity_kbps,
+    0,
+    "WAN capacity in kbps advertised with the gate load, 0 uses the link speed"
+    " of the monitored interface");
+DEFINE_bool(
+    gateway_connectivity_monitor_advertise_wan_quality,
+    false,
+    "Raise the metric of our PANNs while we are a gate as the RTT and loss of"
+    " the WAN probes degrade, so that other nodes move to other gates before"
+    " the WAN fails");
 
 DEFINE_uint32(
     route_dampener_penalty,
@@ -120,6 +140,25 @@ DEFINE_uint32(
     routing_root_pann_interval_ms,
     5000,
     "Routing PANN interval (ms)");
+DEFINE_bool(
+    routing_fixed_pann_format,
+    false,
+    "Send PANNs in the fixed binary format instead of thrift compact. Every"
+    " node in the mesh must be able to parse it before this is enabled.");
+DEFINE_uint32(
+    routing_tx_aggregation_window_ms,
+    0,
+    "Pack the routing frames sent to the same neighbor within this window (ms)"
+    " into one datagram, 0 disables aggregation. Every node in the mesh must be"
+    " able to parse aggregated frames before this is enabled.");
+DEFINE_uint32(
+    routing_multipath_gates,
+    1,
+    "Spread traffic to the mesh gates across a multipath route over this many"
+    " of the best gates, weighted by their metrics. 1 routes through the best"
+    " gate only. Above 1, this sets the host-wide"
+    " net.ipv6.fib_multipath_hash_policy sysctl to 1 (L4 hashing) so that"
+    " flows stay on one gate, and restores it on exit.");
 DEFINE_uint32(
     routing_metric_manager_ewma_factor_log2,
     7,
@@ -130,6 +169,22 @@ DEFINE_double(
     0.0,
     "Weight of the RSSI based metric (vs. bitrate) in the combined metric");
 
+DEFINE_uint32(
+    netlink_max_outstanding_requests,
+    rnl::kMaxOutstandingRequests,
+    "Number of route programming requests sent to the kernel ahead of their"
+    " acks");
+DEFINE_uint32(
+    netlink_ack_timeout_ms,
+    rnl::kNlMessageAckTimer.count(),
+    "How long to wait for the kernel to ack a route programming request before"
+    " failing it");
+DEFINE_bool(
+    netlink_use_nexthop_objects,
+    false,
+    "Program mesh routes through kernel nexthop objects (Linux 5.3+), so that"
+    " destinations moving to a new next hop together take a single request");
+
 DEFINE_bool(
     print_version,
     false,
@@ -160,6 +215,7 @@ constexpr auto kMetricManagerHysteresisFactorLog2{2};
 constexpr auto kMetricManagerBaseBitrate{60};
 constexpr auto kPeriodicPingerInterval{10s};
 constexpr auto kWatchdogNotifyInterval{3s};
+constexpr auto kNetlinkSocketStatsInterval{10s};
 
 } // namespace
 
@@ -202,13 +258,26 @@ int main(int argc, char* argv[]) {
 
   AuthsaeCallbackHelpers::init(evl);
 
-  Nl80211Handler nlHandler{
-      evl, FLAGS_mesh_ifname, FLAGS_enable_userspace_mesh_peering};
+  // nl80211 requests made off the main loop are served asynchronously here
+  folly::EventBase nl80211EventLoop;
+
+  Nl80211Handler nlHandler{evl,
+                           FLAGS_mesh_ifname,
+                           FLAGS_enable_userspace_mesh_peering,
+                           &nl80211EventLoop};
   auto returnValue = nlHandler.joinMeshes();
   if (returnValue != R_SUCCESS) {
     return returnValue;
   }
 
+  static constexpr auto nl80211Id{"Nl80211Commands"};
+  allThreads.emplace_back(std::thread([&nl80211EventLoop]() noexcept {
+    LOG(INFO) << "Starting Nl80211Commands thread...";
+    folly::setThreadName(nl80211Id);
+    nl80211EventLoop.loopForever();
+    LOG(INFO) << "Nl80211Commands thread stopped.";
+  }));
+
   LOG(INFO) << "Creating RouteUpdateMonitor...";
   RouteUpdateMonitor routeMonitor{&routingEventLoop, nlHandler};
 
@@ -234,13 +303,37 @@ int main(int argc, char* argv[]) {
           kPeriodicPingerInterval,
           FLAGS_mesh_ifname);
 
+  StatsClient statsClient{};
+
+  // Report how many generic netlink sockets we open; with persistent command
+  // sockets this should stay flat once every thread has made a request
+  uint64_t numNetlinkSocketsReported{0};
+  std::unique_ptr<folly::AsyncTimeout> netlinkSocketStatsTimer;
+  netlinkSocketStatsTimer = folly::AsyncTimeout::make(
+      routingEventLoop,
+      [&statsClient,
+       &numNetlinkSocketsReported,
+       &netlinkSocketStatsTimer]() noexcept {
+        const auto numNetlinkSockets = GenericNetlinkSocket::getNumCreated();
+        statsClient.incrementSumStat(
+            "fbmeshd.genl.sockets_created",
+            numNetlinkSockets - numNetlinkSocketsReported);
+        numNetlinkSocketsReported = numNetlinkSockets;
+        netlinkSocketStatsTimer->scheduleTimeout(kNetlinkSocketStatsInterval);
+      });
+  netlinkSocketStatsTimer->scheduleTimeout(kNetlinkSocketStatsInterval);
+
   std::unique_ptr<Routing> routing = std::make_unique<Routing>(
       &routingEventLoop,
       metricManager80211s.get(),
       nlHandler.lookupMeshNetif().maybeMacAddress.value(),
       FLAGS_routing_ttl,
       std::chrono::milliseconds{FLAGS_routing_active_path_timeout_ms},
-      std::chrono::milliseconds{FLAGS_routing_root_pann_interval_ms});
+      std::chrono::milliseconds{FLAGS_routing_root_pann_interval_ms},
+      FLAGS_routing_fixed_pann_format ? Routing::MeshPathFrameType::PANN_FIXED
+                                      : Routing::MeshPathFrameType::PANN,
+      std::chrono::milliseconds{FLAGS_routing_tx_aggregation_window_ms},
+      statsClient);
   std::unique_ptr<UDPRoutingPacketTransport> routingPacketTransport =
       std::make_unique<UDPRoutingPacketTransport>(
           &routingEventLoop, FLAGS_mesh_ifname, 6668, FLAGS_routing_tos);
@@ -251,6 +344,14 @@ int main(int argc, char* argv[]) {
         routingPacketTransport->sendPacket(da, std::move(buf));
       });
 
+  // Reroute around a neighbor as soon as its station goes away
+  nlHandler.addStationEventCallback(
+      [&routing](StationEvent event, folly::MacAddress peer) {
+        if (event == StationEvent::REMOVED) {
+          routing->peerDown(peer);
+        }
+      });
+
   routingPacketTransport->setReceivePacketCallback(
       [&routing](folly::MacAddress sa, std::unique_ptr<folly::IOBuf> buf) {
         routing->receivePacket(sa, std::move(buf));
@@ -261,7 +362,9 @@ int main(int argc, char* argv[]) {
   auto nlProtocolSocketEventLoop = std::make_unique<fbzmq::ZmqEventLoop>();
   std::unique_ptr<rnl::NetlinkProtocolSocket> nlProtocolSocket;
   nlProtocolSocket = std::make_unique<rnl::NetlinkProtocolSocket>(
-      nlProtocolSocketEventLoop.get());
+      nlProtocolSocketEventLoop.get(),
+      FLAGS_netlink_max_outstanding_requests,
+      std::chrono::milliseconds{FLAGS_netlink_ack_timeout_ms});
   allThreads.emplace_back(
       std::thread([&nlProtocolSocket, &nlProtocolSocketEventLoop]() {
         LOG(INFO) << "Starting NetlinkProtolSocketEvl thread...";
@@ -275,7 +378,10 @@ int main(int argc, char* argv[]) {
   LOG(INFO) << "Creating NetlinkSocket...";
   std::unique_ptr<rnl::NetlinkSocket> nlSocket =
       std::make_unique<rnl::NetlinkSocket>(
-          &evl, nullptr, std::move(nlProtocolSocket));
+          &evl,
+          nullptr,
+          std::move(nlProtocolSocket),
+          FLAGS_netlink_use_nexthop_objects);
 
   LOG(INFO) << "Creating SyncRoutes80211s...";
   std::unique_ptr<SyncRoutes80211s> syncRoutes80211s =
@@ -284,7 +390,11 @@ int main(int argc, char* argv[]) {
           routing.get(),
           nlSocket.get(),
           nlHandler.lookupMeshNetif().maybeMacAddress.value(),
-          FLAGS_mesh_ifname);
+          FLAGS_mesh_ifname,
+          FLAGS_routing_multipath_gates);
+
+  routing->setMeshPathChangeCallback(
+      [&syncRoutes80211s]() { syncRoutes80211s->scheduleSyncRoutes(); });
 
   static constexpr auto routingId{"Routing"};
   allThreads.emplace_back(std::thread([&routingEventLoop]() noexcept {
@@ -301,8 +411,6 @@ int main(int argc, char* argv[]) {
         return address;
       })};
 
-  StatsClient statsClient{};
-
   LOG(INFO) << "Creating GatewayConnectivityMonitor...";
   folly::EventBase gcmEventLoop;
   GatewayConnectivityMonitor gatewayConnectivityMonitor{
@@ -319,6 +427,9 @@ int main(int argc, char* argv[]) {
       std::chrono::seconds{FLAGS_route_dampener_max_suppress_limit},
       FLAGS_gateway_connectivity_monitor_robustness,
       static_cast<uint8_t>(FLAGS_gateway_connectivity_monitor_set_root_mode),
+      FLAGS_gateway_connectivity_monitor_advertise_load,
+      FLAGS_gateway_connectivity_monitor_wan_capacity_kbps,
+      FLAGS_gateway_connectivity_monitor_advertise_wan_quality,
       routing.get(),
       statsClient};
 
@@ -372,10 +483,13 @@ int main(int argc, char* argv[]) {
   }
 
   routing->resetSendPacketCallback();
+  routing->resetMeshPathChangeCallback();
   routingEventLoop.terminateLoopSoon();
 
   gcmEventLoop.terminateLoopSoon();
 
+  nl80211EventLoop.terminateLoopSoon();
+
   // Wait for all threads to finish
   for (auto& t : allThreads) {
     t.join();
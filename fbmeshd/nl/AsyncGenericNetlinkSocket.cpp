@@ -0,0 +1,200 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "AsyncGenericNetlinkSocket.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include <folly/Chrono.h>
+#include <folly/Format.h>
+#include <folly/String.h>
+
+using namespace fbmeshd;
+
+namespace {
+
+// Large enough for several station dumps on a busy mesh to be in flight
+const int kRxBufferSize{1024 * 1024};
+
+// Stop reading after this many receive calls to let other events run
+const size_t kMaxReceivesPerWakeup{16};
+
+} // namespace
+
+AsyncGenericNetlinkSocket::AsyncGenericNetlinkSocket(
+    folly::EventBase* evb, std::chrono::milliseconds requestTimeout)
+    : evb_{evb}, requestTimeout_{requestTimeout} {
+  sock_.setBufferSize(kRxBufferSize, 8192);
+  sock_.setNonBlocking();
+  // Replies to different requests interleave, they are matched up below
+  sock_.disableSequenceChecking();
+
+  auto& cb = sock_.getCallbackHandle();
+  cb.setValidCallback(
+      [this](const GenericNetlinkMessage& msg) { return processReply(msg); });
+  cb.setFinishCallback([this](const NetlinkMessage& msg) {
+    completeRequest(msg.getHeader()->nlmsg_seq);
+    return NL_SKIP;
+  });
+  cb.setAckCallback([this](const NetlinkMessage& msg) {
+    completeRequest(msg.getHeader()->nlmsg_seq);
+    return NL_SKIP;
+  });
+  cb.setErrorCallback([this](sockaddr_nl*, nlmsgerr* err) {
+    failRequest(
+        err->msg.nlmsg_seq,
+        folly::sformat("Netlink error ({})", folly::errnoStr(-err->error)));
+    return NL_SKIP;
+  });
+
+  requestTimer_ =
+      folly::AsyncTimeout::make(*evb_, [this]() noexcept { expireRequests(); });
+
+  initHandler(evb_, folly::NetworkSocket::fromFd(sock_.getFd()));
+  CHECK(registerHandler(
+      folly::EventHandler::READ | folly::EventHandler::PERSIST));
+}
+
+AsyncGenericNetlinkSocket::~AsyncGenericNetlinkSocket() {
+  unregisterHandler();
+  failAllRequests("Netlink socket closed");
+}
+
+folly::SemiFuture<folly::Unit>
+AsyncGenericNetlinkSocket::sendCommand(
+    std::unique_ptr<GenericNetlinkMessage> msg, ValidCallback cbValid) {
+  folly::Promise<folly::Unit> promise;
+  auto future = promise.getSemiFuture();
+  evb_->runInEventBaseThread([this,
+                              msg = std::move(msg),
+                              cbValid = std::move(cbValid),
+                              promise = std::move(promise)]() mutable {
+    send(std::move(msg), std::move(cbValid), std::move(promise));
+  });
+  return future;
+}
+
+void
+AsyncGenericNetlinkSocket::send(
+    std::unique_ptr<GenericNetlinkMessage> msg,
+    ValidCallback cbValid,
+    folly::Promise<folly::Unit> promise) {
+  const auto err = sock_.trySend(*msg);
+  if (err < 0) {
+    promise.setException(std::runtime_error(folly::sformat(
+        "Failed to send netlink message ({})", nl_geterror(err))));
+    return;
+  }
+
+  const auto seq = msg->getHeader()->nlmsg_seq;
+  VLOG(8) << folly::sformat(
+      "AsyncGenericNetlinkSocket::{}(command: {}, sequence: {})",
+      __func__,
+      static_cast<uint32_t>(msg->getGenericHeader()->cmd),
+      seq);
+  pendingRequests_[seq] = PendingRequest{std::move(cbValid),
+                                         std::move(promise),
+                                         std::chrono::steady_clock::now() +
+                                             requestTimeout_};
+  if (!requestTimer_->isScheduled()) {
+    requestTimer_->scheduleTimeout(requestTimeout_);
+  }
+}
+
+void
+AsyncGenericNetlinkSocket::handlerReady(uint16_t) noexcept {
+  for (size_t i = 0; i < kMaxReceivesPerWakeup; i++) {
+    const auto err = sock_.tryReceive(sock_.getCallbackHandle());
+    if (err == -NLE_AGAIN) {
+      return;
+    }
+    if (err == -NLE_NOMEM) {
+      // The receive buffer overflowed, any request may have lost replies
+      LOG(ERROR) << "Netlink receive buffer overflow";
+      failAllRequests("Netlink replies dropped");
+      continue;
+    }
+    if (err < 0) {
+      LOG(ERROR) << "Error receiving netlink message: " << nl_geterror(err);
+      return;
+    }
+  }
+}
+
+int
+AsyncGenericNetlinkSocket::processReply(const GenericNetlinkMessage& msg) {
+  const auto seq = msg.getHeader()->nlmsg_seq;
+  const auto it = pendingRequests_.find(seq);
+  if (it == pendingRequests_.end()) {
+    VLOG(8) << "Dropping netlink reply for unknown sequence " << seq;
+    return NL_SKIP;
+  }
+  try {
+    it->second.cbValid(msg);
+  } catch (const std::exception& e) {
+    failRequest(seq, e.what());
+  }
+  return NL_OK;
+}
+
+void
+AsyncGenericNetlinkSocket::completeRequest(uint32_t seq) {
+  const auto it = pendingRequests_.find(seq);
+  if (it == pendingRequests_.end()) {
+    return;
+  }
+  auto promise = std::move(it->second.promise);
+  pendingRequests_.erase(it);
+  promise.setValue();
+}
+
+void
+AsyncGenericNetlinkSocket::failRequest(uint32_t seq, const std::string& error) {
+  const auto it = pendingRequests_.find(seq);
+  if (it == pendingRequests_.end()) {
+    return;
+  }
+  auto promise = std::move(it->second.promise);
+  pendingRequests_.erase(it);
+  promise.setException(std::runtime_error(
+      folly::sformat("{} (sequence: {})", error, seq)));
+}
+
+void
+AsyncGenericNetlinkSocket::failAllRequests(const std::string& error) {
+  auto pendingRequests = std::move(pendingRequests_);
+  pendingRequests_.clear();
+  for (auto& it : pendingRequests) {
+    it.second.promise.setException(std::runtime_error(
+        folly::sformat("{} (sequence: {})", error, it.first)));
+  }
+}
+
+void
+AsyncGenericNetlinkSocket::expireRequests() {
+  const auto now = std::chrono::steady_clock::now();
+  auto nextDeadline = std::chrono::steady_clock::time_point::max();
+  for (auto it = pendingRequests_.begin(); it != pendingRequests_.end();) {
+    if (it->second.deadline > now) {
+      nextDeadline = std::min(nextDeadline, it->second.deadline);
+      ++it;
+      continue;
+    }
+    LOG(WARNING) << "Netlink request timed out (sequence: " << it->first
+                 << ")";
+    auto promise = std::move(it->second.promise);
+    it = pendingRequests_.erase(it);
+    promise.setException(std::runtime_error("Netlink request timed out"));
+  }
+  if (!pendingRequests_.empty()) {
+    requestTimer_->scheduleTimeout(
+        folly::chrono::ceil<std::chrono::milliseconds>(nextDeadline - now));
+  }
+}
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+#include <folly/futures/Future.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+
+#include <fbmeshd/nl/GenericNetlinkMessage.h>
+#include <fbmeshd/nl/GenericNetlinkSocket.h>
+
+namespace fbmeshd {
+
+/*
+ * Generic netlink command socket driven by an EventBase.
+ *
+ * Requests can be issued from any thread and are sent right away, so several
+ * of them may be in flight at once. Replies are matched to their request by
+ * sequence number as they arrive, and a request completes when the kernel acks
+ * it or ends its dump. Requests that get no answer within the request timeout,
+ * or whose replies the kernel dropped, fail instead of stalling the socket.
+ */
+class AsyncGenericNetlinkSocket : public folly::EventHandler {
+ public:
+  using ValidCallback = std::function<int(const GenericNetlinkMessage&)>;
+
+  AsyncGenericNetlinkSocket(
+      folly::EventBase* evb, std::chrono::milliseconds requestTimeout);
+
+  // Must be destroyed on the event base thread or once its loop has stopped;
+  // outstanding requests fail
+  ~AsyncGenericNetlinkSocket() override;
+  AsyncGenericNetlinkSocket(const AsyncGenericNetlinkSocket&) = delete;
+  AsyncGenericNetlinkSocket(AsyncGenericNetlinkSocket&&) = delete;
+  AsyncGenericNetlinkSocket& operator=(const AsyncGenericNetlinkSocket&) =
+      delete;
+  AsyncGenericNetlinkSocket& operator=(AsyncGenericNetlinkSocket&&) = delete;
+
+  // Send msg and call cbValid on the event base thread for each reply
+  folly::SemiFuture<folly::Unit> sendCommand(
+      std::unique_ptr<GenericNetlinkMessage> msg, ValidCallback cbValid);
+
+ private:
+  struct PendingRequest {
+    ValidCallback cbValid;
+    folly::Promise<folly::Unit> promise;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  void handlerReady(uint16_t events) noexcept override;
+
+  void send(
+      std::unique_ptr<GenericNetlinkMessage> msg,
+      ValidCallback cbValid,
+      folly::Promise<folly::Unit> promise);
+
+  int processReply(const GenericNetlinkMessage& msg);
+  void completeRequest(uint32_t seq);
+  void failRequest(uint32_t seq, const std::string& error);
+  void failAllRequests(const std::string& error);
+  void expireRequests();
+
+  folly::EventBase* evb_;
+  const std::chrono::milliseconds requestTimeout_;
+  GenericNetlinkSocket sock_;
+  std::unordered_map<uint32_t, PendingRequest> pendingRequests_;
+  std::unique_ptr<folly::AsyncTimeout> requestTimer_;
+};
+
+} // namespace fbmeshd
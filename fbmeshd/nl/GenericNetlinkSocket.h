@@ -7,6 +7,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+
 #include <netlink/errno.h> // @manual
 #include <netlink/genl/ctrl.h> // @manual
 #include <netlink/genl/genl.h> // @manual
@@ -27,9 +32,56 @@ class GenericNetlinkSocket : public NetlinkSocket<GenericNetlinkMessage> {
     CHECK_EQ(err, 0) << nl_geterror(err);
 
     setBufferSize(8192, 8192);
+    numCreated().fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Send msg on the calling thread's persistent command socket and process
+  // the replies. The socket is replaced after a failed request, as replies to
+  // it may still be queued.
+  static void
+  sendCommand(
+      const GenericNetlinkMessage& msg,
+      const std::function<int(const GenericNetlinkMessage&)>& cbValid) {
+    auto& sock = getCommandSocket();
+    if (!sock) {
+      sock = std::make_unique<GenericNetlinkSocket>();
+      // Large enough for a station dump on a busy mesh
+      sock->setBufferSize(kCommandSocketRxBufferSize, 8192);
+    }
+    try {
+      sock->sendAndReceive(msg, cbValid);
+    } catch (const std::exception&) {
+      sock.reset();
+      throw;
+    }
+  }
+
+  static void
+  sendCommand(const GenericNetlinkMessage& msg) {
+    sendCommand(msg, [](const auto&) { return NL_OK; });
+  }
+
+  // Number of generic netlink sockets created by this process
+  static uint64_t
+  getNumCreated() {
+    return numCreated().load(std::memory_order_relaxed);
   }
 
  private:
+  static constexpr int kCommandSocketRxBufferSize{256 * 1024};
+
+  static std::unique_ptr<GenericNetlinkSocket>&
+  getCommandSocket() {
+    thread_local std::unique_ptr<GenericNetlinkSocket> sock;
+    return sock;
+  }
+
+  static std::atomic<uint64_t>&
+  numCreated() {
+    static std::atomic<uint64_t> numCreated{0};
+    return numCreated;
+  }
+
   int
   resolveGenericNetlinkFamily(const std::string& name) {
     int id = genl_ctrl_resolve(sock_, name.c_str());
@@ -53,12 +53,7 @@ class NetlinkSocket {
 
   void
   send(const NetlinkMessageType& msg) const {
-    int err;
-
-    // Send
-    do {
-      err = nl_send_auto(sock_, msg);
-    } while (err == -NLE_INTR);
+    const auto err = trySend(msg);
     CHECK_GE(err, 0) << nl_geterror(err);
 
     const auto msgHeader = msg.getHeader();
@@ -68,6 +63,15 @@ class NetlinkSocket {
              << "; sequence: " << msgHeader->nlmsg_seq << ")";
   }
 
+  int
+  trySend(const NetlinkMessageType& msg) const {
+    int err;
+    do {
+      err = nl_send_auto(sock_, msg);
+    } while (err == -NLE_INTR);
+    return err;
+  }
+
   void
   receive(const std::function<int(const NetlinkMessageType&)>& cbValid) const {
     NetlinkCallbackHandle<NetlinkMessageType> cb;
@@ -147,6 +151,12 @@ class NetlinkSocket {
     nl_socket_disable_seq_check(sock_);
   }
 
+  void
+  setNonBlocking() const {
+    int err = nl_socket_set_nonblocking(sock_);
+    CHECK_EQ(err, 0) << nl_geterror(err);
+  }
+
   FOLLY_NODISCARD int
   getFd() const {
     int fd = nl_socket_get_fd(sock_);
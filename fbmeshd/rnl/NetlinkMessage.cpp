@@ -7,6 +7,8 @@
 
 #include "fbmeshd/rnl/NetlinkMessage.h"
 
+#include <algorithm>
+#include <cstring>
 #include <thread>
 #include <vector>
 
@@ -24,21 +26,77 @@ namespace rnl {
 
 uint32_t gSequenceNumber{0};
 
-NetlinkMessage::NetlinkMessage()
-    : msghdr(reinterpret_cast<struct nlmsghdr*>(msg.data())),
-      promise_(std::make_unique<folly::Promise<int>>()) {}
+namespace {
+using NlBuffer = std::array<char, kMaxNlPayloadSize>;
 
-NetlinkMessage::NetlinkMessage(int type)
-    : msghdr(reinterpret_cast<struct nlmsghdr*>(msg.data())),
-      promise_(std::make_unique<folly::Promise<int>>()) {
+// Encoding buffers kept for reuse, per thread as messages are encoded and
+// queued on the caller's thread. Enough for the few a thread encodes at once.
+constexpr size_t kMaxPooledBuffers{8};
+thread_local std::vector<std::unique_ptr<NlBuffer>> bufferPool;
+
+std::unique_ptr<NlBuffer>
+acquireBuffer() {
+  if (bufferPool.empty()) {
+    return std::make_unique<NlBuffer>();
+  }
+  auto buffer = std::move(bufferPool.back());
+  bufferPool.pop_back();
+  return buffer;
+}
+
+void
+releaseBuffer(std::unique_ptr<NlBuffer> buffer) {
+  if (!buffer || bufferPool.size() >= kMaxPooledBuffers) {
+    return;
+  }
+  // Encoding relies on a zeroed buffer
+  buffer->fill(0);
+  bufferPool.push_back(std::move(buffer));
+}
+} // namespace
+
+NetlinkMessage::NetlinkMessage() : buffer_(acquireBuffer()) {
+  msghdr_ = reinterpret_cast<struct nlmsghdr*>(buffer_->data());
+}
+
+NetlinkMessage::NetlinkMessage(int type) : NetlinkMessage() {
   // initialize netlink header
-  msghdr->nlmsg_len = NLMSG_LENGTH(0);
-  msghdr->nlmsg_type = type;
+  msghdr_->nlmsg_len = NLMSG_LENGTH(0);
+  msghdr_->nlmsg_type = type;
+}
+
+NetlinkMessage::~NetlinkMessage() {
+  releaseBuffer(std::move(buffer_));
 }
 
 struct nlmsghdr*
 NetlinkMessage::getMessagePtr() {
-  return msghdr;
+  return msghdr_;
+}
+
+void
+NetlinkMessage::packInto(std::vector<char>& arena) {
+  if (!buffer_) {
+    return;
+  }
+  // At least the header, which is filled in when the message is sent. The
+  // aligned length keeps the next message in the arena aligned too.
+  const uint32_t len = std::max<uint32_t>(
+      NLMSG_HDRLEN,
+      std::min<uint32_t>(NLMSG_ALIGN(msghdr_->nlmsg_len), kMaxNlPayloadSize));
+  arenaOffset_ = arena.size();
+  arena.insert(arena.end(), buffer_->data(), buffer_->data() + len);
+  msghdr_ = nullptr;
+  size_ = len;
+  releaseBuffer(std::move(buffer_));
+}
+
+void
+NetlinkMessage::attachArena(std::shared_ptr<std::vector<char>> arena) {
+  CHECK(!buffer_) << "Netlink message attached before it was packed";
+  CHECK_LE(arenaOffset_ + size_, arena->size());
+  arena_ = std::move(arena);
+  msghdr_ = reinterpret_cast<struct nlmsghdr*>(arena_->data() + arenaOffset_);
 }
 
 void
@@ -48,7 +106,7 @@ NetlinkMessage::updateBytesReceived(uint16_t bytes) {
 
 uint32_t
 NetlinkMessage::getDataLength() const {
-  return msghdr->nlmsg_len;
+  return msghdr_->nlmsg_len;
 }
 
 struct rtattr*
@@ -108,12 +166,12 @@ NetlinkMessage::addAttributes(
 
 folly::Future<int>
 NetlinkMessage::getFuture() {
-  return promise_->getFuture();
+  return promise_.getFuture();
 }
 
 void
 NetlinkMessage::setReturnStatus(int status) {
-  promise_->setValue(status);
+  promise_.setValue(status);
 }
 
 // get Message Type
@@ -128,12 +186,17 @@ NetlinkMessage::setMessageType(NetlinkMessage::MessageType type) {
   messageType_ = type;
 }
 
-NetlinkProtocolSocket::NetlinkProtocolSocket(fbzmq::ZmqEventLoop* evl)
-    : evl_(evl) {
-  nlMessageTimer_ = fbzmq::ZmqTimeout::make(evl_, [this]() noexcept {
-    VLOG(8) << "Did not receive last ack " << lastSeqNo_;
-    sendNetlinkMessage();
-  });
+NetlinkProtocolSocket::NetlinkProtocolSocket(
+    fbzmq::ZmqEventLoop* evl,
+    size_t maxOutstandingRequests,
+    std::chrono::milliseconds ackTimeout)
+    : evl_(evl),
+      maxOutstandingRequests_(maxOutstandingRequests),
+      ackTimeout_(ackTimeout),
+      recvBuffer_(kNlRecvBufferSize) {
+  CHECK_GT(maxOutstandingRequests_, 0);
+  ackTimer_ =
+      fbzmq::ZmqTimeout::make(evl_, [this]() noexcept { expireRequests(); });
 }
 
 void
@@ -151,6 +214,8 @@ NetlinkProtocolSocket::init() {
   if (setsockopt(nlSock_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0) {
     LOG(FATAL) << "Netlink socket set recv buffer failed.";
   };
+  // NETLINK_NO_ENOBUFS is left off: an overrun has to be reported to
+  // recover from the events it dropped
 
   // set the source address
   ::memset(&saddr_, 0, sizeof(saddr_));
@@ -167,6 +232,16 @@ NetlinkProtocolSocket::init() {
     LOG(FATAL) << "Failed to bind netlink socket: " << folly::errnoStr(errno);
   };
 
+  init(nlSock_);
+}
+
+void
+NetlinkProtocolSocket::init(int fd) {
+  if (pid_ == UINT_MAX) {
+    pid_ = static_cast<int>(
+        std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  }
+  nlSock_ = fd;
   evl_->addSocketFd(nlSock_, ZMQ_POLLIN, [this](int) noexcept {
     try {
       recvNetlinkMessage();
@@ -196,16 +271,46 @@ NetlinkProtocolSocket::setNeighborEventCB(
 }
 
 void
-NetlinkProtocolSocket::processAck(uint32_t ack) {
-  if (ack == lastSeqNo_) {
-    VLOG(8) << "Last ack received " << ack;
-    // cancel active message timer
-    if (nlMessageTimer_->isScheduled()) {
-      nlMessageTimer_->cancelTimeout();
+NetlinkProtocolSocket::setOverrunCB(std::function<void()> overrunCB) {
+  overrunCB_ = overrunCB;
+}
+
+void
+NetlinkProtocolSocket::scheduleAckTimer() {
+  if (ackDeadlines_.empty()) {
+    return;
+  }
+  ackTimer_->scheduleTimeout(std::max(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          ackDeadlines_.top().first - std::chrono::steady_clock::now()),
+      std::chrono::milliseconds{0}));
+}
+
+void
+NetlinkProtocolSocket::expireRequests() {
+  const auto now = std::chrono::steady_clock::now();
+  while (!ackDeadlines_.empty() && ackDeadlines_.top().first <= now) {
+    const auto deadline = ackDeadlines_.top();
+    ackDeadlines_.pop();
+    auto it = nlSeqNoMap_.find(deadline.second);
+    if (it == nlSeqNoMap_.end()) {
+      // already acked
+      continue;
     }
-    // continue sending next set of messages
-    sendNetlinkMessage();
+    if (it->second.ackDeadline > deadline.first) {
+      // a multipart response is still arriving
+      ackDeadlines_.emplace(it->second.ackDeadline, deadline.second);
+      continue;
+    }
+    VLOG(8) << "Did not receive ack for seq " << deadline.second;
+    it->second.request->setReturnStatus(-ETIMEDOUT);
+    nlSeqNoMap_.erase(it);
+    ++timeouts_;
+    ++errors_;
   }
+  scheduleAckTimer();
+  // send the requests waiting for the slots that were freed
+  sendNetlinkMessage();
 }
 
 void
@@ -214,13 +319,23 @@ NetlinkProtocolSocket::sendNetlinkMessage() {
     struct sockaddr_nl nladdr = {
         .nl_family = AF_NETLINK, .nl_pad = 0, .nl_pid = 0, .nl_groups = 0};
     uint32_t count{0};
-    uint32_t iovSize = std::min(msgQueue_.size(), kMaxIovMsg);
+    if (nlSeqNoMap_.size() >= maxOutstandingRequests_) {
+      // topped up again as acks arrive
+      return;
+    }
+    uint32_t iovSize = std::min(
+        {msgQueue_.size(),
+         kMaxIovMsg,
+         maxOutstandingRequests_ - nlSeqNoMap_.size()});
 
     if (!iovSize) {
       return;
     }
 
     auto iov = std::make_unique<struct iovec[]>(iovSize);
+    std::vector<uint32_t> seqNos;
+    seqNos.reserve(iovSize);
+    const auto ackDeadline = std::chrono::steady_clock::now() + ackTimeout_;
 
     while (count < iovSize && !msgQueue_.empty()) {
       auto m = std::move(msgQueue_.front());
@@ -240,11 +355,12 @@ NetlinkProtocolSocket::sendNetlinkMessage() {
       }
 
       // Add seq number -> netlink request mapping
-      nlSeqNoMap_.insert({gSequenceNumber, std::move(m)});
+      nlSeqNoMap_.insert(
+          {gSequenceNumber, PendingRequest{std::move(m), ackDeadline}});
+      seqNos.push_back(gSequenceNumber);
       count++;
     }
-    lastSeqNo_ = gSequenceNumber;
-    VLOG(8) << "Last seq sent:" << lastSeqNo_;
+    VLOG(8) << "Last seq sent:" << gSequenceNumber;
 
     auto outMsg = std::make_unique<struct msghdr>();
     outMsg->msg_name = &nladdr;
@@ -256,22 +372,31 @@ NetlinkProtocolSocket::sendNetlinkMessage() {
     auto status = sendmsg(nlSock_, outMsg.get(), 0);
 
     if (status < 0) {
-      LOG(ERROR) << "Error sending on NL socket "
-                 << folly::errnoStr(std::abs(status))
+      const int err = errno;
+      LOG(ERROR) << "Error sending on NL socket " << folly::errnoStr(err)
                  << " Number of messages:" << outMsg->msg_iovlen;
       ++errors_;
+      // None of these will be acked, fail them rather than hold their slots
+      // until they time out
+      for (const auto seqNo : seqNos) {
+        setReturnStatusValue(seqNo, -err);
+      }
+      return;
     }
 
-    // Schedule timer to wait for acks and send next set of messages
-    nlMessageTimer_->scheduleTimeout(
-        std::chrono::milliseconds(kNlMessageAckTimer));
+    for (const auto seqNo : seqNos) {
+      ackDeadlines_.emplace(ackDeadline, seqNo);
+    }
+    if (!ackTimer_->isScheduled()) {
+      scheduleAckTimer();
+    }
   });
 }
 
 void
 NetlinkProtocolSocket::setReturnStatusValue(uint32_t seq, int status) {
   try {
-    auto request = nlSeqNoMap_.at(seq);
+    auto request = nlSeqNoMap_.at(seq).request;
     request->setReturnStatus(status);
     // Remove mapping
     nlSeqNoMap_.erase(seq);
@@ -281,10 +406,9 @@ NetlinkProtocolSocket::setReturnStatusValue(uint32_t seq, int status) {
 }
 
 void
-NetlinkProtocolSocket::processMessage(
-    const std::array<char, kMaxNlPayloadSize>& rxMsg, uint32_t bytesRead) {
+NetlinkProtocolSocket::processMessage(const char* data, uint32_t bytesRead) {
   // first netlink message header
-  struct nlmsghdr* nlh = (struct nlmsghdr*)rxMsg.data();
+  const struct nlmsghdr* nlh = reinterpret_cast<const struct nlmsghdr*>(data);
   do {
     if (!NLMSG_OK(nlh, bytesRead)) {
       break;
@@ -292,23 +416,36 @@ NetlinkProtocolSocket::processMessage(
 
     VLOG(8) << "Received Netlink message of type " << nlh->nlmsg_type
             << " seq no " << nlh->nlmsg_seq;
+    if (nlh->nlmsg_flags & NLM_F_MULTI) {
+      // the response to a dump is still arriving
+      auto it = nlSeqNoMap_.find(nlh->nlmsg_seq);
+      if (it != nlSeqNoMap_.end()) {
+        it->second.ackDeadline = std::chrono::steady_clock::now() + ackTimeout_;
+      }
+    }
     switch (nlh->nlmsg_type) {
     case RTM_NEWROUTE:
     case RTM_DELROUTE: {
-      // next RTM message to be processed
-      auto rtmMessage = std::make_unique<NetlinkRouteMessage>();
-      auto route = rtmMessage->parseMessage(nlh);
+      auto route = NetlinkRouteMessage::parseMessage(nlh);
       if (nlSeqNoMap_.count(nlh->nlmsg_seq) > 0) {
         // Synchronous event - do not generate route events
         routeCache_.emplace_back(route);
       }
     } break;
 
+    case RTM_NEWNEXTHOP:
+    case RTM_DELNEXTHOP: {
+      auto object = NetlinkNextHopMessage::parseMessage(nlh);
+      if (nlSeqNoMap_.count(nlh->nlmsg_seq) > 0) {
+        // Synchronous event - nexthop events are not subscribed to
+        nextHopObjectCache_.emplace_back(std::move(object));
+      }
+    } break;
+
     case RTM_DELLINK:
     case RTM_NEWLINK: {
       // process link information received from netlink
-      auto linkMessage = std::make_unique<NetlinkLinkMessage>();
-      rnl::Link link = linkMessage->parseMessage(nlh);
+      rnl::Link link = NetlinkLinkMessage::parseMessage(nlh);
 
       if (nlSeqNoMap_.count(nlh->nlmsg_seq) > 0) {
         // Synchronous event - do not generate link events
@@ -323,15 +460,14 @@ NetlinkProtocolSocket::processMessage(
     case RTM_DELADDR:
     case RTM_NEWADDR: {
       // process interface address information received from netlink
-      auto addrMessage = std::make_unique<NetlinkAddrMessage>();
-      rnl::IfAddress addr = addrMessage->parseMessage(nlh);
+      rnl::IfAddress addr = NetlinkAddrMessage::parseMessage(nlh);
 
       if (!addr.getPrefix().has_value()) {
         break;
       }
       if (nlSeqNoMap_.count(nlh->nlmsg_seq) > 0) {
         // Response to a corresponding request
-        auto request = nlSeqNoMap_.at(nlh->nlmsg_seq);
+        auto request = nlSeqNoMap_.at(nlh->nlmsg_seq).request;
         if (request->getMessageType() ==
             NetlinkMessage::MessageType::GET_ALL_ADDRS) {
           // Message in response to get addresses, store in address cache
@@ -360,8 +496,7 @@ NetlinkProtocolSocket::processMessage(
     case RTM_DELNEIGH:
     case RTM_NEWNEIGH: {
       // process neighbor information received from netlink
-      auto neighMessage = std::make_unique<NetlinkNeighborMessage>();
-      rnl::Neighbor neighbor = neighMessage->parseMessage(nlh);
+      rnl::Neighbor neighbor = NetlinkNeighborMessage::parseMessage(nlh);
 
       if (nlSeqNoMap_.count(nlh->nlmsg_seq) > 0) {
         // Synchronous event - do not generate neighbor events
@@ -386,7 +521,6 @@ NetlinkProtocolSocket::processMessage(
       if (ack->error == 0) {
         ++acks_;
       }
-      processAck(ack->msg.nlmsg_seq);
     } break;
 
     case NLMSG_NOOP:
@@ -394,7 +528,6 @@ NetlinkProtocolSocket::processMessage(
 
     case NLMSG_DONE: {
       // End of multipart message
-      processAck(nlh->nlmsg_seq);
       setReturnStatusValue(nlh->nlmsg_seq, 0);
     } break;
 
@@ -403,25 +536,64 @@ NetlinkProtocolSocket::processMessage(
       ++errors_;
     }
   } while ((nlh = NLMSG_NEXT(nlh, bytesRead)));
+
+  // top up the window with the slots freed by this batch of acks
+  sendNetlinkMessage();
 }
 
 void
 NetlinkProtocolSocket::recvNetlinkMessage() {
-  // messages buffer
-  std::array<char, kMaxNlPayloadSize> recvMsg = {};
-
-  int32_t bytesRead = ::recv(nlSock_, recvMsg.data(), kMaxNlPayloadSize, 0);
-  VLOG(8) << "Message received with size: " << bytesRead;
-
-  if (bytesRead < 0) {
-    if (errno == EINTR || errno == EAGAIN) {
+  for (size_t i = 0; i < kMaxRecvPerPoll; ++i) {
+    // MSG_TRUNC makes recv return the full length of a datagram that did
+    // not fit
+    const auto bytesRead = ::recv(
+        nlSock_,
+        recvBuffer_.data(),
+        recvBuffer_.size(),
+        MSG_DONTWAIT | MSG_TRUNC);
+    VLOG(8) << "Message received with size: " << bytesRead;
+
+    if (bytesRead < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == ENOBUFS) {
+        // The kernel dropped messages for us, the socket is usable again
+        LOG(WARNING) << "Netlink socket receive buffer overrun";
+        handleOverrun();
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        VLOG(8) << "Error in netlink socket receive: " << bytesRead
+                << " err: " << folly::errnoStr(std::abs(errno));
+      }
       return;
     }
-    VLOG(8) << "Error in netlink socket receive: " << bytesRead
-              << " err: " << folly::errnoStr(std::abs(errno));
-    return;
+
+    const auto bufferSize = recvBuffer_.size();
+    if (static_cast<size_t>(bytesRead) <= bufferSize) {
+      processMessage(recvBuffer_.data(), static_cast<uint32_t>(bytesRead));
+      continue;
+    }
+
+    // The messages that fit are complete, the rest is lost
+    LOG(WARNING) << "Netlink datagram of " << bytesRead
+                 << " bytes truncated to " << bufferSize;
+    processMessage(recvBuffer_.data(), static_cast<uint32_t>(bufferSize));
+    recvBuffer_.resize(bytesRead);
+    handleOverrun();
+  }
+}
+
+void
+NetlinkProtocolSocket::handleOverrun() {
+  ++overruns_;
+  ++errors_;
+  // Lost acks are left to time out. Dumps are not lost, the kernel waits for
+  // room to send them.
+  if (overrunCB_) {
+    overrunCB_();
   }
-  processMessage(recvMsg, static_cast<uint32_t>(bytesRead));
 }
 
 uint32_t
@@ -434,6 +606,16 @@ NetlinkProtocolSocket::getAckCount() const {
   return acks_;
 }
 
+uint32_t
+NetlinkProtocolSocket::getTimeoutCount() const {
+  return timeouts_;
+}
+
+uint32_t
+NetlinkProtocolSocket::getOverrunCount() const {
+  return overruns_;
+}
+
 NetlinkProtocolSocket::~NetlinkProtocolSocket() {
   VLOG(8) << "Closing netlink socket.";
   close(nlSock_);
@@ -441,7 +623,19 @@ NetlinkProtocolSocket::~NetlinkProtocolSocket() {
 
 void
 NetlinkProtocolSocket::addNetlinkMessage(
-    std::vector<std::unique_ptr<NetlinkMessage>> nlmsgs) {
+    std::vector<std::unique_ptr<NetlinkMessage>> nlmsgs,
+    std::vector<char> arena) {
+  // On the caller's thread, whose pool the encoding buffers came from
+  for (auto& nlmsg : nlmsgs) {
+    nlmsg->packInto(arena);
+  }
+  // The arena grew one request at a time, drop the spare capacity
+  arena.shrink_to_fit();
+  const auto sharedArena =
+      std::make_shared<std::vector<char>>(std::move(arena));
+  for (auto& nlmsg : nlmsgs) {
+    nlmsg->attachArena(sharedArena);
+  }
   evl_->runImmediatelyOrInEventLoop(
       [this, nlmsgs = std::move(nlmsgs)]() mutable {
         auto queueSize = msgQueue_.size();
@@ -454,10 +648,8 @@ NetlinkProtocolSocket::addNetlinkMessage(
             break;
           }
         }
-        // call send messages API if no timers are scheduled
-        if (!nlMessageTimer_->isScheduled()) {
-          sendNetlinkMessage();
-        }
+        // sends as many as the window has room for
+        sendNetlinkMessage();
       });
   return;
 }
@@ -478,6 +670,11 @@ NetlinkProtocolSocket::getReturnStatus(
   if (std::move(all).wait(timeout)) {
     // Collect statuses from individual futures
     for (const auto& future : futures) {
+      if (std::abs(future.value()) == ETIMEDOUT &&
+          ignoredErrors.count(ETIMEDOUT) == 0) {
+        LOG(ERROR) << "One or more Netlink requests were not acked";
+        return ResultCode::TIMEOUT;
+      }
       if (std::abs(future.value()) != 0 &&
           ignoredErrors.count(std::abs(future.value())) == 0) {
         // Not one of the ignored errors, log
@@ -514,6 +711,7 @@ NetlinkProtocolSocket::addRoute(const rnl::Route& route) {
 ResultCode
 NetlinkProtocolSocket::addRoutes(const std::vector<rnl::Route> routes) {
   std::vector<std::unique_ptr<NetlinkMessage>> msg;
+  std::vector<char> arena;
   std::vector<folly::Future<int>> futures;
 
   for (const auto& route : routes) {
@@ -526,13 +724,15 @@ NetlinkProtocolSocket::addRoutes(const std::vector<rnl::Route> routes) {
     }
     if (status == ResultCode::SUCCESS) {
       futures.emplace_back(rtmMsg->getFuture());
+      // not to hold an encoding buffer per route until the batch is queued
+      rtmMsg->packInto(arena);
       msg.emplace_back(std::move(rtmMsg));
     } else {
       LOG(ERROR) << "Error adding route " << route.str();
     }
   }
   if (msg.size()) {
-    addNetlinkMessage(std::move(msg));
+    addNetlinkMessage(std::move(msg), std::move(arena));
   }
   return getReturnStatus(
       futures, std::unordered_set<int>{EEXIST}, kNlRequestTimeout);
@@ -594,6 +794,7 @@ ResultCode
 NetlinkProtocolSocket::deleteRoutes(
     const std::vector<rnl::Route> routes) {
   std::vector<std::unique_ptr<NetlinkMessage>> msg;
+  std::vector<char> arena;
   std::vector<folly::Future<int>> futures;
 
   for (const auto& route : routes) {
@@ -606,13 +807,14 @@ NetlinkProtocolSocket::deleteRoutes(
     }
     if (status == ResultCode::SUCCESS) {
       futures.emplace_back(rtmMsg->getFuture());
+      rtmMsg->packInto(arena);
       msg.emplace_back(std::move(rtmMsg));
     } else {
       LOG(ERROR) << "Error deleting route " << route.str();
     }
   }
   if (msg.size()) {
-    addNetlinkMessage(std::move(msg));
+    addNetlinkMessage(std::move(msg), std::move(arena));
   }
   // Ignore EEXIST, ESRCH, EINVAL errors in delete operation
   return getReturnStatus(
@@ -621,6 +823,122 @@ NetlinkProtocolSocket::deleteRoutes(
       kNlRequestTimeout);
 }
 
+std::vector<int>
+NetlinkProtocolSocket::deleteAndAddRoutes(
+    const std::vector<rnl::Route>& delRoutes,
+    const std::vector<rnl::Route>& addRoutes) {
+  std::vector<std::unique_ptr<NetlinkMessage>> msg;
+  std::vector<char> arena;
+  // Requests that could not even be encoded keep an empty Optional
+  std::vector<folly::Optional<folly::Future<int>>> futures;
+  const std::unordered_set<int> ignoredDelErrors{EEXIST, ESRCH, EINVAL};
+  const std::unordered_set<int> ignoredAddErrors{EEXIST};
+
+  for (const auto& route : delRoutes) {
+    auto rtmMsg = std::make_unique<rnl::NetlinkRouteMessage>();
+    if (rtmMsg->deleteRoute(route) == ResultCode::SUCCESS) {
+      futures.emplace_back(rtmMsg->getFuture());
+      rtmMsg->packInto(arena);
+      msg.emplace_back(std::move(rtmMsg));
+    } else {
+      LOG(ERROR) << "Error deleting route " << route.str();
+      futures.emplace_back();
+    }
+  }
+  for (const auto& route : addRoutes) {
+    auto rtmMsg = std::make_unique<rnl::NetlinkRouteMessage>();
+    if (rtmMsg->addRoute(route) == ResultCode::SUCCESS) {
+      futures.emplace_back(rtmMsg->getFuture());
+      rtmMsg->packInto(arena);
+      msg.emplace_back(std::move(rtmMsg));
+    } else {
+      LOG(ERROR) << "Error adding route " << route.str();
+      futures.emplace_back();
+    }
+  }
+  if (msg.size()) {
+    VLOG(8) << "Submitting " << msg.size() << " route requests in one batch";
+    addNetlinkMessage(std::move(msg), std::move(arena));
+  }
+
+  // Wait for every ack up to the batch timeout, then read out each request
+  const auto deadline = std::chrono::steady_clock::now() + kNlRequestTimeout;
+  std::vector<int> statuses;
+  statuses.reserve(futures.size());
+  for (size_t i = 0; i < futures.size(); ++i) {
+    auto& future = futures[i];
+    if (!future) {
+      statuses.push_back(EINVAL);
+      continue;
+    }
+    future->wait(std::max(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()),
+        std::chrono::milliseconds{0}));
+    if (!future->isReady() || !future->hasValue()) {
+      statuses.push_back(ETIMEDOUT);
+      continue;
+    }
+    const int err = std::abs(future->value());
+    const auto& ignoredErrors =
+        i < delRoutes.size() ? ignoredDelErrors : ignoredAddErrors;
+    statuses.push_back(ignoredErrors.count(err) ? 0 : err);
+  }
+  return statuses;
+}
+
+ResultCode
+NetlinkProtocolSocket::addNextHopObjects(
+    const std::vector<rnl::NextHopObject>& objects) {
+  std::vector<std::unique_ptr<NetlinkMessage>> msg;
+  std::vector<char> arena;
+  std::vector<folly::Future<int>> futures;
+
+  for (const auto& object : objects) {
+    auto nhMsg = std::make_unique<rnl::NetlinkNextHopMessage>();
+    nhMsg->setMessageType(NetlinkMessage::MessageType::ADD_NEXTHOP);
+    ResultCode status{ResultCode::SUCCESS};
+    if ((status = nhMsg->addNextHopObject(object)) != ResultCode::SUCCESS) {
+      // later objects may depend on this one, send none of them
+      LOG(ERROR) << "Error adding nexthop object " << object.id;
+      return status;
+    }
+    futures.emplace_back(nhMsg->getFuture());
+    nhMsg->packInto(arena);
+    msg.emplace_back(std::move(nhMsg));
+  }
+  if (msg.size()) {
+    addNetlinkMessage(std::move(msg), std::move(arena));
+  }
+  return getReturnStatus(
+      futures, std::unordered_set<int>{}, kNlRequestTimeout);
+}
+
+ResultCode
+NetlinkProtocolSocket::deleteNextHopObjects(const std::vector<uint32_t>& ids) {
+  std::vector<std::unique_ptr<NetlinkMessage>> msg;
+  std::vector<char> arena;
+  std::vector<folly::Future<int>> futures;
+
+  for (const auto id : ids) {
+    auto nhMsg = std::make_unique<rnl::NetlinkNextHopMessage>();
+    nhMsg->setMessageType(NetlinkMessage::MessageType::DEL_NEXTHOP);
+    if (nhMsg->deleteNextHopObject(id) == ResultCode::SUCCESS) {
+      futures.emplace_back(nhMsg->getFuture());
+      nhMsg->packInto(arena);
+      msg.emplace_back(std::move(nhMsg));
+    } else {
+      LOG(ERROR) << "Error deleting nexthop object " << id;
+    }
+  }
+  if (msg.size()) {
+    addNetlinkMessage(std::move(msg), std::move(arena));
+  }
+  // Ignore ENOENT, the object is already gone
+  return getReturnStatus(
+      futures, std::unordered_set<int>{ENOENT}, kNlRequestTimeout);
+}
+
 ResultCode
 NetlinkProtocolSocket::addIfAddress(const rnl::IfAddress& ifAddr) {
   auto addrMsg = std::make_unique<rnl::NetlinkAddrMessage>();
@@ -728,4 +1046,24 @@ NetlinkProtocolSocket::getAllRoutes() {
   return std::move(routeCache_);
 }
 
+folly::Optional<std::vector<rnl::NextHopObject>>
+NetlinkProtocolSocket::getAllNextHopObjects() {
+  nextHopObjectCache_.clear();
+  auto nhMsg = std::make_unique<rnl::NetlinkNextHopMessage>();
+  std::vector<folly::Future<int>> futures;
+  futures.emplace_back(nhMsg->getFuture());
+  nhMsg->init(RTM_GETNEXTHOP);
+  nhMsg->setMessageType(NetlinkMessage::MessageType::GET_ALL_NEXTHOPS);
+  std::vector<std::unique_ptr<NetlinkMessage>> msg;
+  msg.emplace_back(std::move(nhMsg));
+  addNetlinkMessage(std::move(msg));
+  // Kernels without nexthop objects reject the dump, with EOPNOTSUPP
+  if (getReturnStatus(futures, std::unordered_set<int>{}, kNlRequestTimeout) !=
+      ResultCode::SUCCESS) {
+    nextHopObjectCache_.clear();
+    return folly::none;
+  }
+  return std::move(nextHopObjectCache_);
+}
+
 } // namespace rnl
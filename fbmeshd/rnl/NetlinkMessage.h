@@ -7,7 +7,12 @@
 
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <queue>
+#include <vector>
 
 #include <limits.h>
 #include <linux/lwtunnel.h>
@@ -29,9 +34,20 @@ class NetlinkSocket;
 
 constexpr uint16_t kMaxNlPayloadSize{4096};
 constexpr uint32_t kNetlinkSockRecvBuf{1 * 1024 * 1024};
+// Initial size of the buffer datagrams are received into. The kernel fills
+// dump responses up to the largest buffer it has seen us receive with,
+// capped at 32 KiB, so each recv gets a whole batch of routes.
+constexpr size_t kNlRecvBufferSize{32 * 1024};
+// Most datagrams received per wakeup, so that a dump does not hold up the
+// rest of the event loop
+constexpr size_t kMaxRecvPerPoll{64};
 
 constexpr uint32_t kMaxNlMessageQueue{126001};
 constexpr size_t kMaxIovMsg{500};
+// Default bound on the requests sent to the kernel and not acked yet
+constexpr size_t kMaxOutstandingRequests{500};
+// Default time to wait for the ack of a request, or for the next part of the
+// response to a dump
 constexpr std::chrono::milliseconds kNlMessageAckTimer{1000};
 constexpr std::chrono::milliseconds kNlRequestTimeout{30000};
 
@@ -50,11 +66,17 @@ enum class ResultCode {
   NO_IP
 };
 
+/*
+ * A request is encoded into a kMaxNlPayloadSize buffer taken from a per-thread
+ * pool, then packed by packInto() into an arena shared with the rest of its
+ * batch. A queued batch takes a single allocation the size of what it encodes
+ * to, rather than a page or an allocation per request.
+ */
 class NetlinkMessage {
  public:
   NetlinkMessage();
 
-  virtual ~NetlinkMessage() = default;
+  virtual ~NetlinkMessage();
 
   // construct message with type
   NetlinkMessage(int type);
@@ -65,8 +87,13 @@ class NetlinkMessage {
   // get current length
   uint32_t getDataLength() const;
 
-  // Buffer to create message
-  std::array<char, kMaxNlPayloadSize> msg = {};
+  // Append the message to arena and return the encoding buffer to the pool.
+  // The message cannot be encoded further after this, and cannot be read
+  // until attachArena() is called with the final arena.
+  void packInto(std::vector<char>& arena);
+
+  // Point the message at its bytes in arena, which it shares ownership of
+  void attachArena(std::shared_ptr<std::vector<char>> arena);
 
   // update size of message received
   void updateBytesReceived(uint16_t bytes);
@@ -92,7 +119,10 @@ class NetlinkMessage {
     GET_ALL_ROUTES,
     GET_ROUTE,
     ADD_ROUTE,
-    DEL_ROUTE
+    DEL_ROUTE,
+    GET_ALL_NEXTHOPS,
+    ADD_NEXTHOP,
+    DEL_NEXTHOP
   } messageType_;
 
   // get Message Type
@@ -116,30 +146,49 @@ class NetlinkMessage {
   struct rtattr* addSubAttributes(
       struct rtattr* rta, int type, const void* data, uint32_t len) const;
 
+  // pointer to the netlink message header
+  struct nlmsghdr* msghdr_{nullptr};
+
  private:
   // disable copy, assign constructores
   NetlinkMessage(NetlinkMessage const&) = delete;
   NetlinkMessage& operator=(NetlinkMessage const&) = delete;
 
-  // pointer to the netlink message header
-  struct nlmsghdr* const msghdr{nullptr};
+  // Buffer the message is encoded into, from the pool, until packInto()
+  std::unique_ptr<std::array<char, kMaxNlPayloadSize>> buffer_;
+
+  // Batch arena the message is packed into, and its offset there
+  std::shared_ptr<std::vector<char>> arena_;
+  size_t arenaOffset_{0};
 
   // size available for adding messages,
   // in case of rx message, it contains bytes received
   uint32_t size_{kMaxNlPayloadSize};
 
   // Promise to relay the status code received from kernel
-  std::unique_ptr<folly::Promise<int>> promise_{nullptr};
+  folly::Promise<int> promise_;
 };
 
 class NetlinkProtocolSocket {
  public:
-  explicit NetlinkProtocolSocket(fbzmq::ZmqEventLoop* evl);
+  // Up to maxOutstandingRequests requests are sent ahead of their acks. A
+  // request whose ack does not arrive within ackTimeout fails with ETIMEDOUT
+  // and frees its slot for the next one.
+  explicit NetlinkProtocolSocket(
+      fbzmq::ZmqEventLoop* evl,
+      size_t maxOutstandingRequests = kMaxOutstandingRequests,
+      std::chrono::milliseconds ackTimeout = kNlMessageAckTimer);
 
   // create socket and add to eventloop
   void init();
 
-  // receive messages from netlink socket
+  // add the given socket to eventloop instead, e.g. one end of a
+  // SOCK_SEQPACKET socketpair whose other end plays the kernel in tests and
+  // benchmarks
+  void init(int fd);
+
+  // receive the datagrams queued on the netlink socket and process the
+  // messages in each
   void recvNetlinkMessage();
 
   // send message to netlink socket
@@ -157,9 +206,14 @@ class NetlinkProtocolSocket {
   void setNeighborEventCB(
       std::function<void(rnl::Neighbor, bool)> neighborEventCB);
 
-  // process message
-  void processMessage(
-      const std::array<char, kMaxNlPayloadSize>& rxMsg, uint32_t bytesRead);
+  // Set callback for when events may have been lost, because the socket
+  // receive buffer overran or a datagram did not fit the receive buffer.
+  // Called on the event loop of this socket; the caller should dump what it
+  // tracks from events again.
+  void setOverrunCB(std::function<void()> overrunCB);
+
+  // process the messages in a datagram, in place
+  void processMessage(const char* data, uint32_t bytesRead);
 
   // synchronous add route and nexthop paths
   ResultCode addRoute(const rnl::Route& route);
@@ -179,14 +233,35 @@ class NetlinkProtocolSocket {
   // synchronous delete a list of given IP or label routes
   ResultCode deleteRoutes(const std::vector<rnl::Route> routes);
 
+  // synchronous delete and add of the given IP routes, submitted as a single
+  // batch of requests with all deletes queued ahead of the adds. Returns the
+  // status of every request, deletes first then adds, in the order given:
+  // 0 on success (ignoring the same errors as deleteRoute/addRoute), the
+  // errno reported by the kernel, or ETIMEDOUT if no ack was received
+  std::vector<int> deleteAndAddRoutes(
+      const std::vector<rnl::Route>& delRoutes,
+      const std::vector<rnl::Route>& addRoutes);
+
+  // synchronous add or replace of the given nexthop objects, submitted as a
+  // single batch in the order given, so that group members can precede
+  // their group
+  ResultCode addNextHopObjects(const std::vector<rnl::NextHopObject>& objects);
+
+  // synchronous delete of the given nexthop objects, ignoring those that do
+  // not exist
+  ResultCode deleteNextHopObjects(const std::vector<uint32_t>& ids);
+
   // synchronous add interface address
   ResultCode addIfAddress(const rnl::IfAddress& ifAddr);
 
   // synchronous delete interface address
   ResultCode deleteIfAddress(const rnl::IfAddress& ifAddr);
 
-  // add netlink message to the queue
-  void addNetlinkMessage(std::vector<std::unique_ptr<NetlinkMessage>> nlmsg);
+  // add netlink messages to the queue. Messages already packed into arena
+  // stay there; the others are packed into it as well.
+  void addNetlinkMessage(
+      std::vector<std::unique_ptr<NetlinkMessage>> nlmsg,
+      std::vector<char> arena = {});
 
   // get netlink request statuses
   ResultCode getReturnStatus(
@@ -200,6 +275,12 @@ class NetlinkProtocolSocket {
   // ack count
   uint32_t getAckCount() const;
 
+  // count of requests that timed out waiting for their ack
+  uint32_t getTimeoutCount() const;
+
+  // count of times events may have been lost, see setOverrunCB()
+  uint32_t getOverrunCount() const;
+
   // get all link interfaces from kernel using Netlink
   std::vector<rnl::Link> getAllLinks();
 
@@ -212,6 +293,10 @@ class NetlinkProtocolSocket {
   // get all routes from kernel using Netlink
   std::vector<rnl::Route> getAllRoutes();
 
+  // get all nexthop objects from kernel using Netlink, none if the kernel
+  // does not support them
+  folly::Optional<std::vector<rnl::NextHopObject>> getAllNextHopObjects();
+
  private:
   NetlinkProtocolSocket(NetlinkProtocolSocket const&) = delete;
   NetlinkProtocolSocket& operator=(NetlinkProtocolSocket const&) = delete;
@@ -225,18 +310,30 @@ class NetlinkProtocolSocket {
 
   std::function<void(rnl::Neighbor, bool)> neighborEventCB_;
 
+  std::function<void()> overrunCB_;
+
   // netlink message queue
   std::queue<std::unique_ptr<NetlinkMessage>> msgQueue_;
 
-  // timer to send a burst of netlink messages
-  std::unique_ptr<fbzmq::ZmqTimeout> nlMessageTimer_{nullptr};
+  // bounds on outstanding requests, see constructor
+  const size_t maxOutstandingRequests_;
+  const std::chrono::milliseconds ackTimeout_;
+
+  // timer for the earliest ack deadline
+  std::unique_ptr<fbzmq::ZmqTimeout> ackTimer_{nullptr};
+
+  // fail the requests whose ack deadline passed
+  void expireRequests();
 
-  // process ack message
-  void processAck(uint32_t ack);
+  // count an overrun and let the owner resync
+  void handleOverrun();
 
   // netlink socket
   int nlSock_{-1};
 
+  // reused for every datagram received, grown if one does not fit
+  std::vector<char> recvBuffer_;
+
   // PID Of the endpoint
   uint32_t pid_{UINT_MAX};
 
@@ -249,11 +346,32 @@ class NetlinkProtocolSocket {
   // NLMSG acks
   uint32_t acks_{0};
 
-  // last sent sequence number
-  uint32_t lastSeqNo_;
+  // requests that timed out
+  uint32_t timeouts_{0};
+
+  // receive buffer overruns and truncated datagrams
+  uint32_t overruns_{0};
+
+  struct PendingRequest {
+    std::shared_ptr<NetlinkMessage> request;
+    // pushed back by each part of a multipart response
+    std::chrono::steady_clock::time_point ackDeadline;
+  };
+
+  // Sequence number -> outstanding NetlinkMesage request Map
+  std::unordered_map<uint32_t, PendingRequest> nlSeqNoMap_;
+
+  // Min-heap of (ack deadline, seq). Entries are not removed when the ack
+  // arrives or the deadline moves; they are checked against nlSeqNoMap_ when
+  // they come up.
+  std::priority_queue<
+      std::pair<std::chrono::steady_clock::time_point, uint32_t>,
+      std::vector<std::pair<std::chrono::steady_clock::time_point, uint32_t>>,
+      std::greater<std::pair<std::chrono::steady_clock::time_point, uint32_t>>>
+      ackDeadlines_;
 
-  // Sequence number -> NetlinkMesage request Map
-  std::unordered_map<uint32_t, std::shared_ptr<NetlinkMessage>> nlSeqNoMap_;
+  // schedule ackTimer_ for the earliest entry in ackDeadlines_
+  void scheduleAckTimer();
 
   // Set ack status value to promise in the netlink request message
   void setReturnStatusValue(uint32_t seq, int ackStatus);
@@ -267,5 +385,6 @@ class NetlinkProtocolSocket {
   std::vector<rnl::IfAddress> addressCache_{};
   std::vector<rnl::Neighbor> neighborCache_{};
   std::vector<rnl::Route> routeCache_{};
+  std::vector<rnl::NextHopObject> nextHopObjectCache_{};
 };
 } // namespace rnl
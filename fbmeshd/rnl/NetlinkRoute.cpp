@@ -7,14 +7,13 @@
 
 #include "fbmeshd/rnl/NetlinkRoute.h"
 
+#include <limits>
+
 #include <fbmeshd/rnl/NetlinkMessage.h>
 
 namespace rnl {
 
-NetlinkRouteMessage::NetlinkRouteMessage() {
-  // get pointer to NLMSG header
-  msghdr_ = getMessagePtr();
-}
+NetlinkRouteMessage::NetlinkRouteMessage() = default;
 
 void
 NetlinkRouteMessage::init(
@@ -104,7 +103,8 @@ NetlinkRouteMessage::addIpNexthop(
     rtnh->rtnh_ifindex = path.getIfIndex().value();
   }
   rtnh->rtnh_flags = 0;
-  rtnh->rtnh_hops = 0;
+  // The kernel stores the weight minus one, weight 0 means unset
+  rtnh->rtnh_hops = path.getWeight() ? path.getWeight() - 1 : 0;
 
   // RTA_GATEWAY
   auto const via = path.getGateway();
@@ -368,7 +368,7 @@ NetlinkRouteMessage::showMultiPathAttribues(
 
 folly::Expected<folly::IPAddress, folly::IPAddressFormatError>
 NetlinkRouteMessage::parseIp(
-    const struct rtattr* ipAttr, unsigned char family) const {
+    const struct rtattr* ipAttr, unsigned char family) {
   if (family == AF_INET) {
     struct in_addr* addr4 = reinterpret_cast<in_addr*> RTA_DATA(ipAttr);
     return folly::IPAddressV4::fromLong(addr4->s_addr);
@@ -382,7 +382,7 @@ NetlinkRouteMessage::parseIp(
 }
 
 folly::Optional<std::vector<int32_t>>
-NetlinkRouteMessage::parseMplsLabels(const struct rtattr* routeAttr) const {
+NetlinkRouteMessage::parseMplsLabels(const struct rtattr* routeAttr) {
   const struct rtattr* mplsAttr =
       reinterpret_cast<struct rtattr*> RTA_DATA(routeAttr);
   int mplsAttrLen = RTA_PAYLOAD(routeAttr);
@@ -411,7 +411,7 @@ void
 NetlinkRouteMessage::parseNextHopAttribute(
     const struct rtattr* routeAttr,
     unsigned char family,
-    rnl::NextHopBuilder& nhBuilder) const {
+    rnl::NextHopBuilder& nhBuilder) {
   switch (routeAttr->rta_type) {
   case RTA_GATEWAY: {
     // Gateway address
@@ -467,7 +467,7 @@ NetlinkRouteMessage::parseNextHopAttribute(
 
 void
 NetlinkRouteMessage::setMplsAction(
-    rnl::NextHopBuilder& nhBuilder, unsigned char family) const {
+    rnl::NextHopBuilder& nhBuilder, unsigned char family) {
   // Inferring MPLS action from nexthop fields
   if (nhBuilder.getPushLabels() != folly::none) {
     nhBuilder.setLabelAction(fbmeshd::thrift::MplsActionCode::PUSH);
@@ -487,7 +487,7 @@ NetlinkRouteMessage::setMplsAction(
 }
 
 rnl::Route
-NetlinkRouteMessage::parseMessage(const struct nlmsghdr* nlmsg) const {
+NetlinkRouteMessage::parseMessage(const struct nlmsghdr* nlmsg) {
   rnl::RouteBuilder routeBuilder;
   // For single next hop in the route
   rnl::NextHopBuilder nhBuilder;
@@ -533,6 +533,12 @@ NetlinkRouteMessage::parseMessage(const struct nlmsghdr* nlmsg) const {
       routeBuilder.setPriority(*(reinterpret_cast<int*> RTA_DATA(routeAttr)));
     } break;
 
+    case RTA_NH_ID: {
+      // the kernel also reports the next hops the object resolves to
+      routeBuilder.setNextHopId(
+          *(reinterpret_cast<uint32_t*> RTA_DATA(routeAttr)));
+    } break;
+
     // Nexthop attributes
     case RTA_GATEWAY:
     case RTA_OIF:
@@ -567,7 +573,7 @@ NetlinkRouteMessage::parseMessage(const struct nlmsghdr* nlmsg) const {
 
 std::vector<rnl::NextHop>
 NetlinkRouteMessage::parseNextHops(
-    const struct rtattr* routeAttrMP, unsigned char family) const {
+    const struct rtattr* routeAttrMP, unsigned char family) {
   std::vector<rnl::NextHop> nextHops;
   struct rtnexthop* nh =
       reinterpret_cast<struct rtnexthop*> RTA_DATA(routeAttrMP);
@@ -576,6 +582,11 @@ NetlinkRouteMessage::parseNextHops(
   do {
     rnl::NextHopBuilder nhBuilder;
     nhBuilder.setIfIndex(nh->rtnh_ifindex);
+    // The kernel stores the weight minus one, see addIpNexthop()
+    nhBuilder.setWeight(
+        nh->rtnh_hops < std::numeric_limits<uint8_t>::max()
+            ? nh->rtnh_hops + 1
+            : nh->rtnh_hops);
     const struct rtattr* routeAttr;
     auto routeAttrLen = nh->rtnh_len - sizeof(*nh);
     // process all route attributes
@@ -638,6 +649,16 @@ NetlinkRouteMessage::addRoute(const rnl::Route& route) {
     };
   }
 
+  // A nexthop object stands in for the route's own next hops
+  if (route.getNextHopId()) {
+    const uint32_t nextHopId = route.getNextHopId().value();
+    return addAttributes(
+        RTA_NH_ID,
+        reinterpret_cast<const char*>(&nextHopId),
+        sizeof(nextHopId),
+        msghdr_);
+  }
+
   return addNextHops(route);
 }
 
@@ -722,11 +743,165 @@ NetlinkRouteMessage::deleteLabelRoute(const rnl::Route& route) {
   return status;
 }
 
-NetlinkLinkMessage::NetlinkLinkMessage() {
-  // get pointer to NLMSG header
-  msghdr_ = getMessagePtr();
+NetlinkNextHopMessage::NetlinkNextHopMessage() = default;
+
+void
+NetlinkNextHopMessage::init(int type) {
+  if (type != RTM_NEWNEXTHOP && type != RTM_DELNEXTHOP &&
+      type != RTM_GETNEXTHOP) {
+    LOG(ERROR) << "Incorrect Netlink message type";
+    return;
+  }
+  // initialize netlink header
+  msghdr_->nlmsg_len = NLMSG_LENGTH(sizeof(struct nhmsg));
+  msghdr_->nlmsg_type = type;
+  msghdr_->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+
+  if (type == RTM_GETNEXTHOP) {
+    // Get all nexthop objects
+    msghdr_->nlmsg_flags |= NLM_F_DUMP;
+  }
+
+  if (type == RTM_NEWNEXTHOP) {
+    // Replacing an object repoints the routes using it
+    msghdr_->nlmsg_flags |= NLM_F_CREATE | NLM_F_REPLACE;
+  }
+
+  // intialize the nexthop message header
+  auto nlmsgAlen = NLMSG_ALIGN(sizeof(struct nlmsghdr));
+  nhmsg_ = reinterpret_cast<struct nhmsg*>((char*)msghdr_ + nlmsgAlen);
+}
+
+ResultCode
+NetlinkNextHopMessage::addNextHopObject(const rnl::NextHopObject& object) {
+  if (object.id == 0 || object.nextHop.has_value() == !object.group.empty()) {
+    LOG(ERROR) << "Nexthop object needs an ID and one next hop or a group";
+    return ResultCode::FAIL;
+  }
+
+  init(RTM_NEWNEXTHOP);
+  nhmsg_->nh_protocol = object.protocolId;
+
+  ResultCode status{ResultCode::SUCCESS};
+  if ((status = addAttributes(
+           NHA_ID,
+           reinterpret_cast<const char*>(&object.id),
+           sizeof(object.id),
+           msghdr_)) != ResultCode::SUCCESS) {
+    return status;
+  }
+
+  if (!object.group.empty()) {
+    VLOG(8) << "Adding nexthop group " << object.id << " of "
+            << object.group.size();
+    // Groups have no family of their own
+    nhmsg_->nh_family = AF_UNSPEC;
+    std::vector<struct nexthop_grp> group(object.group.size());
+    for (size_t i = 0; i < object.group.size(); ++i) {
+      group[i].id = object.group[i].first;
+      // The kernel stores the weight minus one, as for RTA_MULTIPATH
+      group[i].weight =
+          object.group[i].second ? object.group[i].second - 1 : 0;
+    }
+    return addAttributes(
+        NHA_GROUP,
+        reinterpret_cast<const char*>(group.data()),
+        group.size() * sizeof(struct nexthop_grp),
+        msghdr_);
+  }
+
+  const auto& nextHop = object.nextHop.value();
+  VLOG(8) << "Adding nexthop " << object.id << " " << nextHop.str();
+  const auto ifIndex = nextHop.getIfIndex();
+  const auto gateway = nextHop.getGateway();
+  if (!ifIndex.has_value() || !gateway.has_value()) {
+    LOG(ERROR) << "Nexthop IP not provided";
+    return ResultCode::NO_NEXTHOP_IP;
+  }
+  nhmsg_->nh_family = gateway->family();
+
+  const uint32_t oif = ifIndex.value();
+  if ((status = addAttributes(
+           NHA_OIF,
+           reinterpret_cast<const char*>(&oif),
+           sizeof(oif),
+           msghdr_)) != ResultCode::SUCCESS) {
+    return status;
+  }
+  return addAttributes(
+      NHA_GATEWAY,
+      reinterpret_cast<const char*>(gateway->bytes()),
+      gateway->byteCount(),
+      msghdr_);
+}
+
+ResultCode
+NetlinkNextHopMessage::deleteNextHopObject(uint32_t id) {
+  VLOG(8) << "Deleting nexthop " << id;
+  init(RTM_DELNEXTHOP);
+  nhmsg_->nh_family = AF_UNSPEC;
+  return addAttributes(
+      NHA_ID, reinterpret_cast<const char*>(&id), sizeof(id), msghdr_);
+}
+
+rnl::NextHopObject
+NetlinkNextHopMessage::parseMessage(const struct nlmsghdr* nlmsg) {
+  rnl::NextHopObject object;
+  rnl::NextHopBuilder nhBuilder;
+  bool isNextHop{false};
+
+  const struct nhmsg* const nhEntry =
+      reinterpret_cast<struct nhmsg*>(NLMSG_DATA(nlmsg));
+  object.protocolId = nhEntry->nh_protocol;
+
+  const struct rtattr* nhAttr =
+      reinterpret_cast<const struct rtattr*>(
+          reinterpret_cast<const char*>(nhEntry) +
+          NLMSG_ALIGN(sizeof(struct nhmsg)));
+  int nhAttrLen = NLMSG_PAYLOAD(nlmsg, sizeof(struct nhmsg));
+  // process all nexthop attributes
+  for (; RTA_OK(nhAttr, nhAttrLen); nhAttr = RTA_NEXT(nhAttr, nhAttrLen)) {
+    switch (nhAttr->rta_type) {
+    case NHA_ID: {
+      object.id = *(reinterpret_cast<const uint32_t*> RTA_DATA(nhAttr));
+    } break;
+
+    case NHA_GROUP: {
+      const auto* group =
+          reinterpret_cast<const struct nexthop_grp*> RTA_DATA(nhAttr);
+      const size_t size = RTA_PAYLOAD(nhAttr) / sizeof(struct nexthop_grp);
+      for (size_t i = 0; i < size; ++i) {
+        object.group.emplace_back(group[i].id, group[i].weight + 1);
+      }
+    } break;
+
+    case NHA_OIF: {
+      isNextHop = true;
+      nhBuilder.setIfIndex(
+          *(reinterpret_cast<const uint32_t*> RTA_DATA(nhAttr)));
+    } break;
+
+    case NHA_GATEWAY: {
+      // 4 or 16 bytes, by family
+      const auto gateway = folly::IPAddress::tryFromBinary(folly::ByteRange(
+          reinterpret_cast<const uint8_t*> RTA_DATA(nhAttr),
+          RTA_PAYLOAD(nhAttr)));
+      if (gateway.hasValue()) {
+        isNextHop = true;
+        nhBuilder.setGateway(gateway.value());
+      }
+    } break;
+    }
+  }
+
+  if (isNextHop) {
+    object.nextHop = nhBuilder.build();
+  }
+  return object;
 }
 
+NetlinkLinkMessage::NetlinkLinkMessage() = default;
+
 void
 NetlinkLinkMessage::init(int type, uint32_t linkFlags) {
   if (type != RTM_NEWLINK && type != RTM_DELLINK && type != RTM_GETLINK) {
@@ -752,7 +927,7 @@ NetlinkLinkMessage::init(int type, uint32_t linkFlags) {
 }
 
 rnl::Link
-NetlinkLinkMessage::parseMessage(const struct nlmsghdr* nlmsg) const {
+NetlinkLinkMessage::parseMessage(const struct nlmsghdr* nlmsg) {
   rnl::LinkBuilder builder;
   const struct ifinfomsg* const linkEntry =
       reinterpret_cast<struct ifinfomsg*>(NLMSG_DATA(nlmsg));
@@ -777,10 +952,7 @@ NetlinkLinkMessage::parseMessage(const struct nlmsghdr* nlmsg) const {
   return link;
 }
 
-NetlinkAddrMessage::NetlinkAddrMessage() {
-  // get pointer to NLMSG header
-  msghdr_ = getMessagePtr();
-}
+NetlinkAddrMessage::NetlinkAddrMessage() = default;
 
 void
 NetlinkAddrMessage::init(int type) {
@@ -851,7 +1023,7 @@ NetlinkAddrMessage::addOrDeleteIfAddress(
 }
 
 rnl::IfAddress
-NetlinkAddrMessage::parseMessage(const struct nlmsghdr* nlmsg) const {
+NetlinkAddrMessage::parseMessage(const struct nlmsghdr* nlmsg) {
   rnl::IfAddressBuilder builder;
   const struct ifaddrmsg* const addrEntry =
       reinterpret_cast<struct ifaddrmsg*>(NLMSG_DATA(nlmsg));
@@ -894,10 +1066,7 @@ NetlinkAddrMessage::parseMessage(const struct nlmsghdr* nlmsg) const {
   return addr;
 }
 
-NetlinkNeighborMessage::NetlinkNeighborMessage() {
-  // get pointer to NLMSG header
-  msghdr_ = getMessagePtr();
-}
+NetlinkNeighborMessage::NetlinkNeighborMessage() = default;
 
 void
 NetlinkNeighborMessage::init(int type, uint32_t neighFlags) {
@@ -922,7 +1091,7 @@ NetlinkNeighborMessage::init(int type, uint32_t neighFlags) {
 }
 
 rnl::Neighbor
-NetlinkNeighborMessage::parseMessage(const struct nlmsghdr* nlmsg) const {
+NetlinkNeighborMessage::parseMessage(const struct nlmsghdr* nlmsg) {
   rnl::NeighborBuilder builder;
   const struct ndmsg* const neighEntry =
       reinterpret_cast<struct ndmsg*>(NLMSG_DATA(nlmsg));
@@ -27,6 +27,36 @@
 #define MPLS_IPTUNNEL_DST 1
 #endif
 
+// Kernel nexthop objects appeared in Linux 5.3; the ABI is stable, so define
+// what we use when building against older headers
+#if __has_include(<linux/nexthop.h>)
+#include <linux/nexthop.h>
+#else
+#define RTM_NEWNEXTHOP 104
+#define RTM_DELNEXTHOP 105
+#define RTM_GETNEXTHOP 106
+#define RTA_NH_ID 30
+#define NHA_ID 1
+#define NHA_GROUP 2
+#define NHA_OIF 5
+#define NHA_GATEWAY 6
+
+struct nhmsg {
+  unsigned char nh_family;
+  unsigned char nh_scope;
+  unsigned char nh_protocol;
+  unsigned char resvd;
+  unsigned int nh_flags;
+};
+
+struct nexthop_grp {
+  __u32 id;
+  __u8 weight;
+  __u8 resvd1;
+  __u16 resvd2;
+};
+#endif
+
 namespace rnl {
 
 constexpr uint16_t kMaxLabels{16};
@@ -67,8 +97,8 @@ class NetlinkRouteMessage final : public NetlinkMessage {
   // encode MPLS label, returns in network order
   uint32_t encodeLabel(uint32_t label, bool bos) const;
 
-  // process netlink route message
-  rnl::Route parseMessage(const struct nlmsghdr* nlmsg) const;
+  // process netlink route message, in place
+  static rnl::Route parseMessage(const struct nlmsghdr* nlmsg);
 
  private:
   // print ancillary data
@@ -81,26 +111,26 @@ class NetlinkRouteMessage final : public NetlinkMessage {
   void showMultiPathAttribues(const struct rtattr* const rta) const;
 
   // parse IP address
-  folly::Expected<folly::IPAddress, folly::IPAddressFormatError> parseIp(
-      const struct rtattr* ipAttr, unsigned char family) const;
+  static folly::Expected<folly::IPAddress, folly::IPAddressFormatError>
+  parseIp(const struct rtattr* ipAttr, unsigned char family);
 
   // process netlink next hops
-  std::vector<rnl::NextHop> parseNextHops(
-      const struct rtattr* routeAttrMultipath, unsigned char family) const;
+  static std::vector<rnl::NextHop> parseNextHops(
+      const struct rtattr* routeAttrMultipath, unsigned char family);
 
   // parse NextHop Attributes
-  void parseNextHopAttribute(
+  static void parseNextHopAttribute(
       const struct rtattr* routeAttr,
       unsigned char family,
-      rnl::NextHopBuilder& nhBuilder) const;
+      rnl::NextHopBuilder& nhBuilder);
 
   // parse MPLS labels
-  folly::Optional<std::vector<int32_t>> parseMplsLabels(
-      const struct rtattr* routeAttr) const;
+  static folly::Optional<std::vector<int32_t>> parseMplsLabels(
+      const struct rtattr* routeAttr);
 
   // set mpls action based on nexthop fields
-  void setMplsAction(
-      rnl::NextHopBuilder& nhBuilder, unsigned char family) const;
+  static void setMplsAction(
+      rnl::NextHopBuilder& nhBuilder, unsigned char family);
 
   // pointer to route message header
   struct rtmsg* rtmsg_{nullptr};
@@ -138,9 +168,6 @@ class NetlinkRouteMessage final : public NetlinkMessage {
       const rnl::NextHop& path,
       const rnl::Route& route) const;
 
-  // pointer to the netlink message header
-  struct nlmsghdr* msghdr_{nullptr};
-
   // for via nexthop
   struct NextHop {
     uint16_t addrFamily;
@@ -153,6 +180,28 @@ class NetlinkRouteMessage final : public NetlinkMessage {
   } __attribute__((__packed__));
 };
 
+class NetlinkNextHopMessage final : public NetlinkMessage {
+ public:
+  NetlinkNextHopMessage();
+
+  // initiallize nexthop message with default params
+  void init(int type);
+
+  // add or replace a nexthop object, single or group
+  ResultCode addNextHopObject(const rnl::NextHopObject& object);
+
+  // delete a nexthop object. Deleting an object also deletes the routes
+  // using it, and removes it from the groups it is a member of.
+  ResultCode deleteNextHopObject(uint32_t id);
+
+  // parse Netlink nexthop message, in place
+  static rnl::NextHopObject parseMessage(const struct nlmsghdr* nlh);
+
+ private:
+  // pointer to nexthop message header
+  struct nhmsg* nhmsg_{nullptr};
+};
+
 class NetlinkLinkMessage final : public NetlinkMessage {
  public:
   NetlinkLinkMessage();
@@ -160,15 +209,12 @@ class NetlinkLinkMessage final : public NetlinkMessage {
   // initiallize link message with default params
   void init(int type, uint32_t flags);
 
-  // parse Netlink Link message
-  rnl::Link parseMessage(const struct nlmsghdr* nlh) const;
+  // parse Netlink Link message, in place
+  static rnl::Link parseMessage(const struct nlmsghdr* nlh);
 
  private:
   // pointer to link message header
   struct ifinfomsg* ifinfomsg_{nullptr};
-
-  // pointer to the netlink message header
-  struct nlmsghdr* msghdr_{nullptr};
 };
 
 class NetlinkAddrMessage final : public NetlinkMessage {
@@ -178,8 +224,8 @@ class NetlinkAddrMessage final : public NetlinkMessage {
   // initiallize address message with default params
   void init(int type);
 
-  // parse Netlink Address message
-  rnl::IfAddress parseMessage(const struct nlmsghdr* nlh) const;
+  // parse Netlink Address message, in place
+  static rnl::IfAddress parseMessage(const struct nlmsghdr* nlh);
 
   // create netlink message to add/delete interface address
   // type - RTM_NEWADDR or RTM_DELADDR
@@ -189,9 +235,6 @@ class NetlinkAddrMessage final : public NetlinkMessage {
  private:
   // pointer to interface message header
   struct ifaddrmsg* ifaddrmsg_{nullptr};
-
-  // pointer to the netlink message header
-  struct nlmsghdr* msghdr_{nullptr};
 };
 
 class NetlinkNeighborMessage final : public NetlinkMessage {
@@ -201,15 +244,12 @@ class NetlinkNeighborMessage final : public NetlinkMessage {
   // initiallize neighbor message with default params
   void init(int type, uint32_t flags);
 
-  // parse Netlink Neighbor message
-  rnl::Neighbor parseMessage(const struct nlmsghdr* nlh) const;
+  // parse Netlink Neighbor message, in place
+  static rnl::Neighbor parseMessage(const struct nlmsghdr* nlh);
 
  private:
   // pointer to neighbor message header
   struct ndmsg* ndmsg_{nullptr};
-
-  // pointer to the netlink message header
-  struct nlmsghdr* msghdr_{nullptr};
 };
 
 } // namespace rnl
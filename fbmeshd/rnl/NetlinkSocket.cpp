@@ -7,14 +7,28 @@
 
 #include "fbmeshd/rnl/NetlinkSocket.h"
 
+#include <sys/utsname.h>
+
+#include <cstdio>
+
+#include <folly/String.h>
+
 #include <fbmeshd/if/gen-cpp2/fbmeshd_constants.h>
 
 namespace rnl {
 
+namespace {
+// First kernel version that replaces IPv6 routes in place, multipath ones
+// included
+const int kMinV6RouteReplaceKernelMajor{4};
+const int kMinV6RouteReplaceKernelMinor{11};
+} // namespace
+
 NetlinkSocket::NetlinkSocket(
     fbzmq::ZmqEventLoop* evl,
     EventsHandler* handler,
-    std::unique_ptr<rnl::NetlinkProtocolSocket> nlSock)
+    std::unique_ptr<rnl::NetlinkProtocolSocket> nlSock,
+    bool useNextHopObjects)
     : evl_(evl), handler_(handler), nlSock_(std::move(nlSock)) {
   CHECK(evl_ != nullptr) << "Missing event loop.";
 
@@ -69,9 +83,31 @@ NetlinkSocket::NetlinkSocket(
     });
   });
 
+  // Events may have been lost, catch up once, however many overruns
+  nlSock_->setOverrunCB([this]() noexcept {
+    if (resyncScheduled_.exchange(true)) {
+      return;
+    }
+    evl_->runInEventLoop([this]() noexcept {
+      resyncScheduled_ = false;
+      try {
+        doResyncEvents();
+      } catch (std::exception const& err) {
+        LOG(ERROR) << "error resyncing after lost NL events: "
+                   << folly::exceptionStr(err);
+      }
+    });
+  });
+
   // need to reload routes from kernel to avoid re-adding existing route
   // type of exception in NetlinkSocket
   updateRouteCache();
+
+  initV6RouteReplace();
+
+  if (useNextHopObjects) {
+    initNextHopObjects();
+  }
 }
 
 NetlinkSocket::~NetlinkSocket() {
@@ -180,6 +216,92 @@ NetlinkSocket::doHandleNeighborEvent(
   }
 }
 
+void
+NetlinkSocket::doResyncEvents() {
+  LOG(INFO) << "Resyncing links, addresses and neighbors after lost events";
+
+  auto oldLinks = links_;
+  for (auto& link : nlSock_->getAllLinks()) {
+    auto oldLink = oldLinks.find(link.getLinkName());
+    if (oldLink != oldLinks.end()) {
+      const bool changed = oldLink->second.isUp != link.isUp() ||
+          oldLink->second.ifIndex != link.getIfIndex();
+      oldLinks.erase(oldLink);
+      if (!changed) {
+        continue;
+      }
+    }
+    doHandleLinkEvent(std::move(link), true);
+  }
+  // Links that are gone are reported down
+  for (const auto& oldLink : oldLinks) {
+    if (oldLink.second.isUp) {
+      doHandleLinkEvent(
+          LinkBuilder()
+              .setLinkName(oldLink.first)
+              .setIfIndex(oldLink.second.ifIndex)
+              .setFlags(0)
+              .build(),
+          true);
+    }
+  }
+
+  std::unordered_map<std::string, std::unordered_set<folly::CIDRNetwork>>
+      oldNetworks;
+  for (const auto& link : links_) {
+    oldNetworks.emplace(link.first, link.second.networks);
+  }
+  for (auto& ifAddr : nlSock_->getAllIfAddresses()) {
+    if (!ifAddr.getPrefix().has_value()) {
+      continue;
+    }
+    const auto ifName = getIfName(ifAddr.getIfIndex()).get();
+    if (oldNetworks[ifName].erase(ifAddr.getPrefix().value()) == 0) {
+      doHandleAddrEvent(std::move(ifAddr), true);
+    }
+  }
+  for (const auto& networks : oldNetworks) {
+    const auto link = links_.find(networks.first);
+    if (link == links_.end()) {
+      continue;
+    }
+    for (const auto& network : networks.second) {
+      doHandleAddrEvent(
+          IfAddressBuilder()
+              .setIfIndex(link->second.ifIndex)
+              .setPrefix(network)
+              .setValid(false)
+              .build(),
+          true);
+    }
+  }
+
+  auto oldNeighbors = neighbors_;
+  for (auto& neighbor : nlSock_->getAllNeighbors()) {
+    const auto key = std::make_pair(
+        getIfName(neighbor.getIfIndex()).get(), neighbor.getDestination());
+    auto oldNeighbor = oldNeighbors.find(key);
+    bool changed = neighbor.isReachable();
+    if (oldNeighbor != oldNeighbors.end()) {
+      changed = !(oldNeighbor->second == neighbor);
+      oldNeighbors.erase(oldNeighbor);
+    }
+    if (changed) {
+      doHandleNeighborEvent(std::move(neighbor), true);
+    }
+  }
+  // Neighbors that are gone are reported unreachable
+  for (const auto& oldNeighbor : oldNeighbors) {
+    doHandleNeighborEvent(
+        NeighborBuilder()
+            .setIfIndex(oldNeighbor.second.getIfIndex())
+            .setDestination(oldNeighbor.second.getDestination())
+            .setState(NUD_FAILED, true)
+            .build(),
+        true);
+  }
+}
+
 void
 NetlinkSocket::doUpdateRouteCache(Route route, bool updateUnicastRoute) {
   // Skip cached route entries and any routes not in the main table
@@ -431,6 +553,13 @@ NetlinkSocket::getMplsRouteCount() const {
 
 void
 NetlinkSocket::doAddUpdateUnicastRoute(Route route) {
+  if (nextHopObjectsEnabled_) {
+    // Nexthop objects are managed per batch, this is a batch of one
+    const auto protocolId = route.getProtocolId();
+    doUpdateUnicastRoutes(protocolId, {std::move(route)}, {});
+    return;
+  }
+
   checkUnicastRoute(route);
 
   const auto& dest = route.getDestination();
@@ -438,40 +567,25 @@ NetlinkSocket::doAddUpdateUnicastRoute(Route route) {
   // Create new set of nexthops to be programmed. Existing + New ones
   auto& unicastRoutes = unicastRoutesCache_[route.getProtocolId()];
   auto iter = unicastRoutes.find(dest);
-  // if user did not speicify priority
-  if (!route.getPriority()) {
-    const auto routePair =
-        fbmeshd::thrift::fbmeshd_constants::protocolIdtoPriority().find(
-            route.getProtocolId());
-    if (routePair ==
-        fbmeshd::thrift::fbmeshd_constants::protocolIdtoPriority()
-            .end()) {
-      route.setPriority(fbmeshd::thrift::fbmeshd_constants::
-                            kUnknownProtAdminDistance());
-    } else {
-      route.setPriority(routePair->second);
-    }
-  }
+  setDefaultPriority(route);
   // Same route
   if (iter != unicastRoutes.end() && iter->second == route) {
     return;
   }
 
-  if (dest.first.isV6()) {
-    // We need to explicitly add new V6 routes & remove old routes
-    // With IPv6, if new route being requested has different properties
-    // (like gateway or metric or..) the existing one will not be replaced,
-    // instead a new route will be created, which may cause underlying kernel
-    // crash when releasing netdevices
-    if (iter != unicastRoutes.end()) {
-      int err{0};
+  // Unless the kernel can replace the old V6 route in place, we need to
+  // explicitly remove it & add the new one. Otherwise, if the new route has
+  // different properties (like gateway or metric or..) the existing one will
+  // not be replaced, instead a new route will be created, which may cause
+  // underlying kernel crash when releasing netdevices
+  if (iter != unicastRoutes.end() && !canReplaceRoute(iter->second, route)) {
+    int err{0};
 
-      err = static_cast<int>(nlSock_->deleteRoute(iter->second));
+    err = static_cast<int>(nlSock_->deleteRoute(iter->second));
 
-      if (0 != err) {
-        throw rnl::NlException(folly::sformat(
-            "Failed to delete route\n{}\nError: {}", iter->second.str(), err));
-      }
+    if (0 != err) {
+      throw rnl::NlException(folly::sformat(
+          "Failed to delete route\n{}\nError: {}", iter->second.str(), err));
     }
   }
 
@@ -528,6 +642,24 @@ NetlinkSocket::delRoute(Route route) {
   return future;
 }
 
+void
+NetlinkSocket::setDefaultPriority(Route& route) const {
+  // if user did not speicify priority
+  if (!route.getPriority()) {
+    const auto routePair =
+        fbmeshd::thrift::fbmeshd_constants::protocolIdtoPriority().find(
+            route.getProtocolId());
+    if (routePair ==
+        fbmeshd::thrift::fbmeshd_constants::protocolIdtoPriority()
+            .end()) {
+      route.setPriority(fbmeshd::thrift::fbmeshd_constants::
+                            kUnknownProtAdminDistance());
+    } else {
+      route.setPriority(routePair->second);
+    }
+  }
+}
+
 void
 NetlinkSocket::checkUnicastRoute(const Route& route) {
   const auto& prefix = route.getDestination();
@@ -590,6 +722,13 @@ NetlinkSocket::doAddUpdateMplsRoute(Route mplsRoute) {
 
 void
 NetlinkSocket::doDeleteUnicastRoute(Route route) {
+  if (nextHopObjectsEnabled_) {
+    // Nexthop objects are managed per batch, this is a batch of one
+    const auto protocolId = route.getProtocolId();
+    doUpdateUnicastRoutes(protocolId, {}, {std::move(route)});
+    return;
+  }
+
   checkUnicastRoute(route);
 
   const auto& prefix = route.getDestination();
@@ -725,27 +864,168 @@ NetlinkSocket::doSyncUnicastRoutes(uint8_t protocolId, NlUnicastRoutes syncDb) {
   auto& unicastRoutes = unicastRoutesCache_[protocolId];
 
   // Go over routes that are not in new routeDb, delete
-  std::unordered_set<folly::CIDRNetwork> toDelete;
+  std::vector<Route> toDelete;
   for (auto const& kv : unicastRoutes) {
     if (syncDb.find(kv.first) == syncDb.end()) {
-      toDelete.insert(kv.first);
+      toDelete.push_back(kv.second);
     }
   }
-  // Delete routes from kernel
-  VLOG(8) << "Sync: number of routes to delete: " << toDelete.size();
-  for (auto it = toDelete.begin(); it != toDelete.end(); ++it) {
-    auto const& prefix = *it;
-    auto iter = unicastRoutes.find(prefix);
+
+  // Go over routes in new routeDb, update/add
+  std::vector<Route> toAdd;
+  for (auto& kv : syncDb) {
+    toAdd.push_back(std::move(kv.second));
+  }
+
+  doUpdateUnicastRoutes(protocolId, std::move(toAdd), std::move(toDelete));
+}
+
+folly::Future<folly::Unit>
+NetlinkSocket::updateUnicastRoutes(
+    uint8_t protocolId,
+    std::vector<Route> toAdd,
+    std::vector<Route> toDelete) {
+  folly::Promise<folly::Unit> promise;
+  auto future = promise.getFuture();
+
+  evl_->runImmediatelyOrInEventLoop([this,
+                                     p = std::move(promise),
+                                     add = std::move(toAdd),
+                                     del = std::move(toDelete),
+                                     protocolId]() mutable {
+    try {
+      doUpdateUnicastRoutes(protocolId, std::move(add), std::move(del));
+      p.setValue();
+    } catch (std::exception const& ex) {
+      LOG(ERROR) << "Error updating unicast routes: "
+                 << folly::exceptionStr(ex);
+      p.setException(ex);
+    }
+  });
+  return future;
+}
+
+void
+NetlinkSocket::doUpdateUnicastRoutes(
+    uint8_t protocolId,
+    std::vector<Route> toAdd,
+    std::vector<Route> toDelete) {
+  auto& unicastRoutes = unicastRoutesCache_[protocolId];
+
+  // Deletes go by the cached route, which knows its nexthop object
+  std::vector<Route> delRoutes;
+  for (const auto& route : toDelete) {
+    checkUnicastRoute(route);
+    auto iter = unicastRoutes.find(route.getDestination());
     if (iter == unicastRoutes.end()) {
+      LOG(ERROR) << "Trying to delete non-existing prefix "
+                 << folly::IPAddress::networkToString(route.getDestination());
       continue;
     }
-    doDeleteUnicastRoute(iter->second);
+    delRoutes.push_back(iter->second);
   }
 
-  // Go over routes in new routeDb, update/add
-  VLOG(8) << "Sync: number of routes to add: " << syncDb.size();
-  for (auto& kv : syncDb) {
-    doAddUpdateUnicastRoute(kv.second);
+  std::vector<Route> addRoutes;
+  for (auto& route : toAdd) {
+    checkUnicastRoute(route);
+    setDefaultPriority(route);
+    auto iter = unicastRoutes.find(route.getDestination());
+    if (iter != unicastRoutes.end() && iter->second == route) {
+      continue;
+    }
+    addRoutes.push_back(std::move(route));
+  }
+
+  std::vector<uint32_t> unusedNextHopIds;
+  if (nextHopObjectsEnabled_) {
+    repointNextHopObjects(protocolId, addRoutes, unusedNextHopIds);
+  }
+
+  // As in doAddUpdateUnicastRoute, V6 routes the kernel cannot replace in
+  // place have their old version deleted first.
+  std::vector<NextHopObject> newObjects;
+  for (auto& route : addRoutes) {
+    auto iter = unicastRoutes.find(route.getDestination());
+    if (iter != unicastRoutes.end() && !canReplaceRoute(iter->second, route)) {
+      delRoutes.push_back(iter->second);
+    }
+    acquireNextHopObject(route, newObjects);
+  }
+  if (!newObjects.empty() &&
+      nlSock_->addNextHopObjects(newObjects) != ResultCode::SUCCESS) {
+    LOG(ERROR) << "Failed to add " << newObjects.size()
+               << " nexthop objects, programming next hops inline";
+    std::unordered_set<uint32_t> newIds;
+    for (const auto& object : newObjects) {
+      newIds.insert(object.id);
+    }
+    for (auto& route : addRoutes) {
+      if (route.getNextHopId() && newIds.count(*route.getNextHopId())) {
+        releaseNextHopObject(route.getNextHopId(), unusedNextHopIds);
+        route.setNextHopId(folly::none);
+      }
+    }
+  }
+
+  VLOG(8) << "Number of routes to delete: " << delRoutes.size()
+          << ", to add/update: " << addRoutes.size();
+  if (delRoutes.empty() && addRoutes.empty()) {
+    deleteNextHopObjects(unusedNextHopIds);
+    return;
+  }
+
+  // Program everything in one batch and update the cache per route
+  const auto statuses = nlSock_->deleteAndAddRoutes(delRoutes, addRoutes);
+  CHECK_EQ(statuses.size(), delRoutes.size() + addRoutes.size());
+
+  std::vector<std::string> failures;
+  for (size_t i = 0; i < delRoutes.size(); ++i) {
+    const auto& prefix = delRoutes[i].getDestination();
+    if (statuses[i] != 0) {
+      LOG(ERROR) << "Failed to delete route "
+                 << folly::IPAddress::networkToString(prefix)
+                 << " Error: " << folly::errnoStr(statuses[i]);
+      failures.push_back(folly::sformat(
+          "del {}: {}",
+          folly::IPAddress::networkToString(prefix),
+          statuses[i]));
+      continue;
+    }
+    auto iter = unicastRoutes.find(prefix);
+    if (iter != unicastRoutes.end()) {
+      releaseNextHopObject(iter->second.getNextHopId(), unusedNextHopIds);
+      unicastRoutes.erase(iter);
+    }
+  }
+  for (size_t i = 0; i < addRoutes.size(); ++i) {
+    const auto err = statuses[delRoutes.size() + i];
+    auto& route = addRoutes[i];
+    const auto prefix = route.getDestination();
+    if (err != 0) {
+      LOG(ERROR) << "Could not add route\n"
+                 << route.str() << "\nError: " << folly::errnoStr(err);
+      failures.push_back(folly::sformat(
+          "add {}: {}", folly::IPAddress::networkToString(prefix), err));
+      releaseNextHopObject(route.getNextHopId(), unusedNextHopIds);
+      continue;
+    }
+    auto iter = unicastRoutes.find(prefix);
+    if (iter != unicastRoutes.end()) {
+      releaseNextHopObject(iter->second.getNextHopId(), unusedNextHopIds);
+      unicastRoutes.erase(iter);
+    }
+    unicastRoutes.emplace(prefix, std::move(route));
+  }
+
+  // Only once no route uses them any more
+  deleteNextHopObjects(unusedNextHopIds);
+
+  if (!failures.empty()) {
+    throw rnl::NlException(folly::sformat(
+        "Failed to program {} of {} routes: {}",
+        failures.size(),
+        statuses.size(),
+        folly::join(", ", failures)));
   }
 }
 
@@ -1144,6 +1424,299 @@ NetlinkSocket::updateRouteCache() {
   }
 }
 
+void
+NetlinkSocket::initNextHopObjects() {
+  auto objects = nlSock_->getAllNextHopObjects();
+  if (!objects) {
+    LOG(WARNING) << "Kernel does not support nexthop objects, programming "
+                 << "next hops inline";
+    return;
+  }
+  nextHopObjectsEnabled_ = true;
+
+  std::unordered_map<uint32_t, NextHopObject> existing;
+  for (auto& object : objects.value()) {
+    usedNextHopIds_.insert(object.id);
+    existing.emplace(object.id, std::move(object));
+  }
+
+  // Adopt the objects cached routes use, e.g. left by a previous run, so that
+  // they are deleted along with the last of those routes. They are not
+  // shared with new routes, as what they resolve to is not known reliably.
+  for (const auto& protocolRoutes : unicastRoutesCache_) {
+    for (const auto& kv : protocolRoutes.second) {
+      const auto id = kv.second.getNextHopId();
+      if (!id) {
+        continue;
+      }
+      const auto objectIter = existing.find(id.value());
+      if (objectIter == existing.end()) {
+        continue;
+      }
+      auto& state = nextHopObjects_[id.value()];
+      if (state.refCount == 0) {
+        state.protocolId = objectIter->second.protocolId;
+        for (const auto& member : objectIter->second.group) {
+          state.memberIds.push_back(member.first);
+        }
+      }
+      ++state.refCount;
+    }
+  }
+  LOG(INFO) << "Using nexthop objects, " << existing.size()
+            << " found in the kernel, " << nextHopObjects_.size()
+            << " used by cached routes";
+}
+
+bool
+NetlinkSocket::usesNextHopObjects() const {
+  return nextHopObjectsEnabled_;
+}
+
+bool
+NetlinkSocket::replacesV6Routes() const {
+  return v6RouteReplaceSupported_;
+}
+
+void
+NetlinkSocket::initV6RouteReplace() {
+  struct utsname uts;
+  int major{0};
+  int minor{0};
+  if (uname(&uts) != 0 ||
+      std::sscanf(uts.release, "%d.%d", &major, &minor) != 2) {
+    LOG(WARNING) << "Unknown kernel version, deleting IPv6 routes before "
+                 << "updating them";
+    return;
+  }
+  v6RouteReplaceSupported_ = major > kMinV6RouteReplaceKernelMajor ||
+      (major == kMinV6RouteReplaceKernelMajor &&
+       minor >= kMinV6RouteReplaceKernelMinor);
+  LOG(INFO) << "Kernel " << uts.release
+            << (v6RouteReplaceSupported_
+                    ? " replaces IPv6 routes in place"
+                    : " does not replace IPv6 routes in place, deleting them "
+                      "before updating them");
+}
+
+bool
+NetlinkSocket::canReplaceRoute(const Route& old, const Route& route) const {
+  // IPv4 routes are always replaced in place
+  if (!route.getDestination().first.isV6()) {
+    return true;
+  }
+  // An IPv6 route is only replaced by one with the same metric, otherwise the
+  // kernel adds a second route. Kernels before 4.11 also append to or replace
+  // a single path of a multipath IPv6 route instead of replacing it whole.
+  return v6RouteReplaceSupported_ && old.getPriority() == route.getPriority();
+}
+
+bool
+NetlinkSocket::isNextHopObjectEligible(const Route& route) const {
+  if (route.getType() != RTN_UNICAST || route.getNextHops().empty()) {
+    return false;
+  }
+  // Only plain gateways, no MPLS
+  for (const auto& nextHop : route.getNextHops()) {
+    if (!nextHop.getIfIndex() || !nextHop.getGateway() ||
+        nextHop.getLabelAction()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+NetlinkSocket::acquireNextHopObject(
+    Route& route, std::vector<NextHopObject>& newObjects) {
+  route.setNextHopId(folly::none);
+  if (!nextHopObjectsEnabled_ || !isNextHopObjectEligible(route)) {
+    return;
+  }
+
+  auto& ids = nextHopObjectIds_[route.getProtocolId()];
+  auto idIter = ids.find(route.getNextHops());
+  if (idIter == ids.end()) {
+    const auto id = allocateNextHopId();
+    auto& state = nextHopObjects_[id];
+    state.protocolId = route.getProtocolId();
+    state.nextHops = route.getNextHops();
+    state.memberIds = makeNextHopObjects(
+        id, route.getProtocolId(), route.getNextHops(), newObjects);
+    idIter = ids.emplace(route.getNextHops(), id).first;
+  }
+  ++nextHopObjects_.at(idIter->second).refCount;
+  route.setNextHopId(idIter->second);
+}
+
+void
+NetlinkSocket::releaseNextHopObject(
+    folly::Optional<uint32_t> id, std::vector<uint32_t>& unusedIds) {
+  if (!id) {
+    return;
+  }
+  auto iter = nextHopObjects_.find(id.value());
+  if (iter == nextHopObjects_.end() || --iter->second.refCount > 0) {
+    return;
+  }
+
+  auto& state = iter->second;
+  // Deleting a group before its members
+  unusedIds.push_back(id.value());
+  unusedIds.insert(
+      unusedIds.end(), state.memberIds.begin(), state.memberIds.end());
+  auto& ids = nextHopObjectIds_[state.protocolId];
+  auto idIter = ids.find(state.nextHops);
+  if (idIter != ids.end() && idIter->second == id.value()) {
+    ids.erase(idIter);
+  }
+  nextHopObjects_.erase(iter);
+}
+
+void
+NetlinkSocket::repointNextHopObjects(
+    uint8_t protocolId,
+    std::vector<Route>& routes,
+    std::vector<uint32_t>& unusedIds) {
+  auto& unicastRoutes = unicastRoutesCache_[protocolId];
+  auto& ids = nextHopObjectIds_[protocolId];
+
+  // Indices in 'routes' of the updates to the routes of each object, and the
+  // objects some of whose routes change in more than their next hops, or to
+  // different next hops
+  std::unordered_map<uint32_t, std::vector<size_t>> moves;
+  std::unordered_set<uint32_t> mixedMoves;
+  for (size_t i = 0; i < routes.size(); ++i) {
+    const auto iter = unicastRoutes.find(routes[i].getDestination());
+    if (iter == unicastRoutes.end() || !iter->second.getNextHopId()) {
+      continue;
+    }
+    const auto id = iter->second.getNextHopId().value();
+    auto moved = iter->second;
+    moved.setNextHops(routes[i].getNextHops());
+    auto& move = moves[id];
+    if (!(moved == routes[i]) || !isNextHopObjectEligible(routes[i]) ||
+        (!move.empty() &&
+         routes[move.front()].getNextHops() != routes[i].getNextHops())) {
+      mixedMoves.insert(id);
+    }
+    move.push_back(i);
+  }
+
+  std::vector<bool> repointed(routes.size(), false);
+  for (const auto& move : moves) {
+    const auto id = move.first;
+    const auto objectIter = nextHopObjects_.find(id);
+    if (mixedMoves.count(id) || objectIter == nextHopObjects_.end() ||
+        objectIter->second.refCount != move.second.size()) {
+      continue;
+    }
+    auto& state = objectIter->second;
+    const auto& nextHops = routes[move.second.front()].getNextHops();
+    // Adopted objects are not repointed, and routes are not moved onto
+    // objects that already exist
+    const auto idIter = ids.find(state.nextHops);
+    if (idIter == ids.end() || idIter->second != id || ids.count(nextHops)) {
+      continue;
+    }
+    // The kernel does not turn a single next hop into a group or back
+    if ((state.nextHops.size() == 1) != (nextHops.size() == 1)) {
+      continue;
+    }
+
+    std::vector<NextHopObject> objects;
+    auto memberIds = makeNextHopObjects(id, protocolId, nextHops, objects);
+    if (nlSock_->addNextHopObjects(objects) != ResultCode::SUCCESS) {
+      // The routes are updated one by one instead
+      LOG(ERROR) << "Failed to repoint nexthop object " << id;
+      unusedIds.insert(unusedIds.end(), memberIds.begin(), memberIds.end());
+      continue;
+    }
+    VLOG(8) << "Repointed nexthop object " << id << " of "
+            << move.second.size() << " routes";
+
+    // The old members are out of the group now
+    unusedIds.insert(
+        unusedIds.end(), state.memberIds.begin(), state.memberIds.end());
+    ids.erase(idIter);
+    ids.emplace(nextHops, id);
+    state.nextHops = nextHops;
+    state.memberIds = std::move(memberIds);
+    for (const auto i : move.second) {
+      auto& route = routes[i];
+      route.setNextHopId(id);
+      const auto prefix = route.getDestination();
+      unicastRoutes.erase(prefix);
+      unicastRoutes.emplace(prefix, std::move(route));
+      repointed[i] = true;
+    }
+  }
+
+  std::vector<Route> remaining;
+  for (size_t i = 0; i < routes.size(); ++i) {
+    if (!repointed[i]) {
+      remaining.push_back(std::move(routes[i]));
+    }
+  }
+  routes.swap(remaining);
+}
+
+std::vector<uint32_t>
+NetlinkSocket::makeNextHopObjects(
+    uint32_t id,
+    uint8_t protocolId,
+    const NextHopSet& nextHops,
+    std::vector<NextHopObject>& objects) {
+  NextHopObject object;
+  object.id = id;
+  object.protocolId = protocolId;
+  if (nextHops.size() == 1) {
+    object.nextHop = *nextHops.begin();
+    objects.push_back(std::move(object));
+    return {};
+  }
+
+  std::vector<uint32_t> memberIds;
+  for (const auto& nextHop : nextHops) {
+    NextHopObject member;
+    member.id = allocateNextHopId();
+    member.protocolId = protocolId;
+    member.nextHop = nextHop;
+    memberIds.push_back(member.id);
+    object.group.emplace_back(member.id, nextHop.getWeight());
+    objects.push_back(std::move(member));
+  }
+  objects.push_back(std::move(object));
+  return memberIds;
+}
+
+uint32_t
+NetlinkSocket::allocateNextHopId() {
+  do {
+    // 0 asks the kernel to pick an ID
+    if (++lastNextHopId_ == 0) {
+      ++lastNextHopId_;
+    }
+  } while (usedNextHopIds_.count(lastNextHopId_));
+  usedNextHopIds_.insert(lastNextHopId_);
+  return lastNextHopId_;
+}
+
+void
+NetlinkSocket::deleteNextHopObjects(const std::vector<uint32_t>& ids) {
+  if (ids.empty()) {
+    return;
+  }
+  if (nlSock_->deleteNextHopObjects(ids) != ResultCode::SUCCESS) {
+    // Keep their IDs reserved, they may still exist
+    LOG(ERROR) << "Failed to delete " << ids.size() << " nexthop objects";
+    return;
+  }
+  for (const auto id : ids) {
+    usedNextHopIds_.erase(id);
+  }
+}
+
 void
 NetlinkSocket::subscribeEvent(NetlinkEventType event) {
   if (event >= MAX_EVENT_TYPE) {
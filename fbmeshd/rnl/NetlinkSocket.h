@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include <boost/variant.hpp>
 #include <fbzmq/async/ZmqEventLoop.h>
 #ifdef USE_CONCURRENT
@@ -61,6 +63,26 @@ struct PrefixCmp {
  *   reason to anyway) Internally, the user provided Handler funcs and get*()
  *   methods both update the same cache, which we protect by
  *   serializing calls into a single eventloop.
+ *
+ * For nexthop objects:
+ *   With useNextHopObjects, and a kernel that supports them (Linux 5.3+),
+ *   unicast routes over gateways are programmed through kernel nexthop
+ *   objects, one per distinct set of next hops and protocol, shared by all
+ *   the routes over it. When a batch of updates moves every route of an
+ *   object to the same new next hops, the object is replaced instead of the
+ *   routes, in one request however many routes use it. Objects are deleted
+ *   with the last route using them. Callers keep passing routes with their
+ *   next hops; the cached routes also carry their object ID.
+ *
+ * For lost events:
+ *   If the netlink socket overruns and events are lost, links, addresses and
+ *   neighbors are dumped again and handlers see the changes they missed.
+ *
+ * For route updates:
+ *   Routes are updated in place with NLM_F_REPLACE. The kernel replaces an
+ *   IPv6 route only if table and metric match; on kernels where it does not
+ *   replace in place at all, as probed at startup, or when the metric
+ *   changes, the old IPv6 route is deleted before the new one is added.
  */
 class NetlinkSocket {
  public:
@@ -169,7 +191,8 @@ class NetlinkSocket {
   explicit NetlinkSocket(
       fbzmq::ZmqEventLoop* evl,
       EventsHandler* handler = nullptr,
-      std::unique_ptr<rnl::NetlinkProtocolSocket> nlSock = nullptr);
+      std::unique_ptr<rnl::NetlinkProtocolSocket> nlSock = nullptr,
+      bool useNextHopObjects = false);
 
   virtual ~NetlinkSocket();
 
@@ -219,6 +242,18 @@ class NetlinkSocket {
   virtual folly::Future<folly::Unit> syncUnicastRoutes(
       uint8_t protocolId, NlUnicastRoutes newRouteDb);
 
+  /**
+   * Add/update 'toAdd' and delete 'toDelete', unicast routes of the given
+   * protocol, as a single batch. Other routes are left alone. As with
+   * syncUnicastRoutes, a failure to program some routes does not stop the
+   * others and is reported once at the end.
+   * @throws rnl::NlException
+   */
+  virtual folly::Future<folly::Unit> updateUnicastRoutes(
+      uint8_t protocolId,
+      std::vector<Route> toAdd,
+      std::vector<Route> toDelete);
+
   /**
    * Sync MPLS label routes. Delete label routes not in 'MplsRouteDb' and
    * add the routes not present in kernel
@@ -372,6 +407,14 @@ class NetlinkSocket {
   void registerNeighborListener(
       std::function<void(const NeighborUpdate& neighborUpdate)> callback);
 
+  // Whether unicast routes are programmed through nexthop objects; false if
+  // not requested or not supported by the kernel
+  bool usesNextHopObjects() const;
+
+  // Whether IPv6 routes are updated by replacing them in place, as opposed to
+  // deleting the old route first; decided from the kernel version
+  bool replacesV6Routes() const;
+
  private:
   void doHandleRouteEvent(
       Route route, bool runHandler, bool updateUnicastRoute);
@@ -382,6 +425,10 @@ class NetlinkSocket {
 
   void doHandleNeighborEvent(Neighbor neighbor, bool runHandler);
 
+  // After events were lost, dump links, addresses and neighbors again and
+  // handle what changed as if the events had arrived
+  void doResyncEvents();
+
   void doUpdateRouteCache(Route route, bool updateUnicastRoute = false);
 
   void doAddUpdateUnicastRoute(Route route);
@@ -398,12 +445,65 @@ class NetlinkSocket {
 
   void doSyncUnicastRoutes(uint8_t protocolId, NlUnicastRoutes syncDb);
 
+  void doUpdateUnicastRoutes(
+      uint8_t protocolId,
+      std::vector<Route> toAdd,
+      std::vector<Route> toDelete);
+
+  // Probe the kernel for nexthop objects and adopt those the cached routes
+  // already use
+  void initNextHopObjects();
+
+  // Whether the route can be programmed through a nexthop object
+  bool isNextHopObjectEligible(const Route& route) const;
+
+  // Point the route at the object for its next hops, if eligible, appending
+  // the kernel objects to create if there is none yet to 'newObjects'
+  void acquireNextHopObject(
+      Route& route, std::vector<NextHopObject>& newObjects);
+
+  // Drop a reference to an object; when it was the last one, append the
+  // object, followed by its group members, to 'unusedIds'
+  void releaseNextHopObject(
+      folly::Optional<uint32_t> id, std::vector<uint32_t>& unusedIds);
+
+  // Replace the objects all of whose routes move to the same new next hops,
+  // and take those routes out of 'routes'. Replaced group members are
+  // appended to 'unusedIds'.
+  void repointNextHopObjects(
+      uint8_t protocolId,
+      std::vector<Route>& routes,
+      std::vector<uint32_t>& unusedIds);
+
+  // Append the kernel objects for 'nextHops' under 'id' to 'objects', members
+  // first, and return the IDs of the members of a group
+  std::vector<uint32_t> makeNextHopObjects(
+      uint32_t id,
+      uint8_t protocolId,
+      const NextHopSet& nextHops,
+      std::vector<NextHopObject>& objects);
+
+  uint32_t allocateNextHopId();
+
+  // Check that the running kernel replaces IPv6 routes in place. The behavior
+  // is not probed, as that would mean changing live routes.
+  void initV6RouteReplace();
+
+  // Whether 'route' can replace the cached route 'old' to the same
+  // destination in the kernel without 'old' being deleted first
+  bool canReplaceRoute(const Route& old, const Route& route) const;
+
+  void deleteNextHopObjects(const std::vector<uint32_t>& ids);
+
   void doSyncLinkRoutes(uint8_t protocolId, NlLinkRoutes syncDb);
 
   void checkMulticastRoute(const Route& route);
 
   void checkUnicastRoute(const Route& route);
 
+  // Fill in the admin distance of the route's protocol if none was given
+  void setDefaultPriority(Route& route) const;
+
   void doSyncIfAddress(
       int ifIndex, std::vector<rnl::IfAddress> addrs, int family, int scope);
 
@@ -461,6 +561,37 @@ class NetlinkSocket {
   std::mutex neighborListenerMutex_;
   std::function<void(const NeighborUpdate& neighborUpdate)> neighborListener_{
       nullptr};
+
+  // A resync after lost events is queued on evl_
+  std::atomic<bool> resyncScheduled_{false};
+
+  // Set by initV6RouteReplace()
+  bool v6RouteReplaceSupported_{false};
+
+  bool nextHopObjectsEnabled_{false};
+
+  struct NextHopObjectState {
+    uint8_t protocolId{0};
+    // Empty for objects adopted from the kernel
+    NextHopSet nextHops;
+    std::vector<uint32_t> memberIds;
+    // Cached routes using the object
+    size_t refCount{0};
+  };
+
+  // Objects in use by cached routes, by ID
+  std::unordered_map<uint32_t, NextHopObjectState> nextHopObjects_;
+
+  // protocolId => next hops => ID of the object routes over them share
+  std::unordered_map<
+      uint8_t,
+      std::unordered_map<NextHopSet, uint32_t, NextHopSetHash>>
+      nextHopObjectIds_;
+
+  // IDs not to allocate: ours, including group members, and any found in the
+  // kernel at startup
+  std::unordered_set<uint32_t> usedNextHopIds_;
+  uint32_t lastNextHopId_{0};
 };
 
 } // namespace rnl
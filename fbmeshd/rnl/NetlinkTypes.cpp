@@ -7,6 +7,7 @@
 
 #include "fbmeshd/rnl/NetlinkTypes.h"
 
+#include <algorithm>
 #include <set>
 
 #include <glog/logging.h>
@@ -148,6 +149,17 @@ RouteBuilder::getMplsLabel() const {
   return mplsLabel_;
 }
 
+RouteBuilder&
+RouteBuilder::setNextHopId(uint32_t nextHopId) {
+  nextHopId_ = nextHopId;
+  return *this;
+}
+
+folly::Optional<uint32_t>
+RouteBuilder::getNextHopId() const {
+  return nextHopId_;
+}
+
 RouteBuilder&
 RouteBuilder::setType(uint8_t type) {
   type_ = type;
@@ -311,6 +323,7 @@ RouteBuilder::reset() {
   advMss_.reset();
   nextHops_.clear();
   routeIfName_.reset();
+  nextHopId_.reset();
 }
 
 Route::Route(const RouteBuilder& builder)
@@ -328,7 +341,8 @@ Route::Route(const RouteBuilder& builder)
       nextHops_(builder.getNextHops()),
       dst_(builder.getDestination()),
       routeIfName_(builder.getRouteIfName()),
-      mplsLabel_(builder.getMplsLabel()) {}
+      mplsLabel_(builder.getMplsLabel()),
+      nextHopId_(builder.getNextHopId()) {}
 
 Route::~Route() {
   if (route_) {
@@ -365,6 +379,7 @@ Route::operator=(Route&& other) noexcept {
   routeIfName_ = std::move(other.routeIfName_);
   family_ = std::move(other.family_);
   mplsLabel_ = std::move(other.mplsLabel_);
+  nextHopId_ = std::move(other.nextHopId_);
   if (route_) {
     rtnl_route_put(route_);
     route_ = nullptr;
@@ -409,6 +424,7 @@ Route::operator=(const Route& other) {
   routeIfName_ = other.routeIfName_;
   family_ = other.family_;
   mplsLabel_ = other.mplsLabel_;
+  nextHopId_ = other.nextHopId_;
   // Free our route_ if any
   if (route_) {
     rtnl_route_put(route_);
@@ -477,6 +493,11 @@ Route::getMplsLabel() const {
   return mplsLabel_;
 }
 
+folly::Optional<uint32_t>
+Route::getNextHopId() const {
+  return nextHopId_;
+}
+
 folly::Optional<uint8_t>
 Route::getTos() const {
   return tos_;
@@ -568,6 +589,9 @@ Route::str() const {
   if (advMss_) {
     result += folly::sformat(", advmss {}", advMss_.value());
   }
+  if (nextHopId_) {
+    result += folly::sformat(", nhid {}", nextHopId_.value());
+  }
   for (auto const& nextHop : nextHops_) {
     result += "\n  " + nextHop.str();
   }
@@ -686,6 +710,16 @@ Route::setPriority(uint32_t priority) {
   priority_ = priority;
 }
 
+void
+Route::setNextHops(NextHopSet nextHops) {
+  nextHops_ = std::move(nextHops);
+}
+
+void
+Route::setNextHopId(folly::Optional<uint32_t> nextHopId) {
+  nextHopId_ = nextHopId;
+}
+
 /*=================================NextHop====================================*/
 
 NextHop
@@ -809,7 +843,8 @@ bool
 operator==(const NextHop& lhs, const NextHop& rhs) {
   return lhs.getIfIndex() == rhs.getIfIndex() &&
       lhs.getGateway() == rhs.getGateway() &&
-      lhs.getWeight() == rhs.getWeight() &&
+      std::max<uint8_t>(lhs.getWeight(), 1) ==
+      std::max<uint8_t>(rhs.getWeight(), 1) &&
       lhs.getLabelAction() == rhs.getLabelAction() &&
       lhs.getSwapLabel() == rhs.getSwapLabel() &&
       lhs.getPushLabels() == rhs.getPushLabels() &&
@@ -825,7 +860,17 @@ NextHopHash::operator()(const NextHop& nh) const {
   if (nh.getGateway().has_value()) {
     res += std::hash<std::string>()(nh.getGateway().value().str());
   }
-  res += std::hash<std::string>()(std::to_string(nh.getWeight()));
+  res += std::hash<std::string>()(
+      std::to_string(std::max<uint8_t>(nh.getWeight(), 1)));
+  return res;
+}
+
+size_t
+NextHopSetHash::operator()(const NextHopSet& nextHops) const {
+  size_t res = 0;
+  for (const auto& nh : nextHops) {
+    res += NextHopHash()(nh);
+  }
   return res;
 }
 
@@ -144,7 +144,7 @@ class NextHop final {
  private:
   folly::Optional<int> ifIndex_;
   folly::Optional<folly::IPAddress> gateway_;
-  uint8_t weight_{0}; // default weight is 0
+  uint8_t weight_{0}; // default weight is 0, which counts as 1
   folly::Optional<fbmeshd::thrift::MplsActionCode> labelAction_;
   folly::Optional<uint32_t> swapLabel_;
   folly::Optional<std::vector<int32_t>> pushLabels_;
@@ -158,6 +158,11 @@ struct NextHopHash {
 };
 
 using NextHopSet = std::unordered_set<NextHop, NextHopHash>;
+
+// Independent of the iteration order of the set
+struct NextHopSetHash {
+  size_t operator()(const rnl::NextHopSet& nextHops) const;
+};
 /**
  * Values for core fields
  * ============================
@@ -229,6 +234,12 @@ class RouteBuilder {
   RouteBuilder& setMplsLabel(uint32_t mplsLabel);
 
   folly::Optional<uint32_t> getMplsLabel() const;
+
+  // Kernel nexthop object the route uses instead of its own next hops
+  RouteBuilder& setNextHopId(uint32_t nextHopId);
+
+  folly::Optional<uint32_t> getNextHopId() const;
+
   // Required, default RTN_UNICAST
   RouteBuilder& setType(uint8_t type = RTN_UNICAST);
 
@@ -307,6 +318,7 @@ class RouteBuilder {
   folly::Optional<int> routeIfIndex_; // for multicast or link route
   folly::Optional<std::string> routeIfName_; // for multicast or linkroute
   folly::Optional<uint32_t> mplsLabel_;
+  folly::Optional<uint32_t> nextHopId_;
 };
 
 // Wrapper class for rtnl_route
@@ -327,6 +339,12 @@ class Route final {
 
   folly::Optional<uint32_t> getMplsLabel() const;
 
+  // Set if the route is programmed through a kernel nexthop object. When
+  // set, the kernel is given only the ID; getNextHops() still describes what
+  // the object resolves to. Not compared by operator==, as a route over the
+  // same next hops is the same route however it is programmed.
+  folly::Optional<uint32_t> getNextHopId() const;
+
   uint8_t getType() const;
 
   uint8_t getRouteTable() const;
@@ -353,6 +371,10 @@ class Route final {
 
   void setPriority(uint32_t priority);
 
+  void setNextHops(NextHopSet nextHops);
+
+  void setNextHopId(folly::Optional<uint32_t> nextHopId);
+
   std::string str() const;
 
   /**
@@ -388,10 +410,25 @@ class Route final {
   struct rtnl_route* route_{nullptr};
   struct rtnl_route* routeKey_{nullptr};
   folly::Optional<uint32_t> mplsLabel_;
+  folly::Optional<uint32_t> nextHopId_;
 };
 
 bool operator==(const Route& lhs, const Route& rhs);
 
+/**
+ * Kernel nexthop object (Linux 5.3+, see ip-nexthop(8)): a single next hop,
+ * or a group of other objects. Routes refer to one by ID, so replacing the
+ * object repoints all of them at once.
+ */
+struct NextHopObject {
+  uint32_t id{0};
+  uint8_t protocolId{DEFAULT_PROTOCOL_ID};
+  // Gateway and interface of a single next hop
+  folly::Optional<NextHop> nextHop;
+  // (member ID, weight) of a group; weights from 1, 0 counts as 1
+  std::vector<std::pair<uint32_t, uint8_t>> group;
+};
+
 class IfAddress;
 class IfAddressBuilder final {
  public:
@@ -9,6 +9,7 @@
 #include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <fbzmq/async/ZmqEventLoop.h>
 #include <fbzmq/zmq/Zmq.h>
@@ -537,6 +538,114 @@ TEST_F(NlMessageFixture, IpRouteMultipleNextHops) {
   EXPECT_FALSE(checkRouteInKernelRoutes(kernelRoutes, route));
 }
 
+TEST_F(NlMessageFixture, IpRouteWeightedNextHops) {
+  // Add IPv6 route with weighted next hops and check that it reads back equal
+  // to what was programmed, weights included
+
+  std::vector<rnl::NextHop> paths;
+  paths.push_back(rnl::NextHopBuilder{}
+                      .setGateway(ipAddrY1V6)
+                      .setIfIndex(ifIndexZ)
+                      .setWeight(1)
+                      .build());
+  paths.push_back(rnl::NextHopBuilder{}
+                      .setGateway(ipAddrY2V6)
+                      .setIfIndex(ifIndexZ)
+                      .setWeight(16)
+                      .build());
+  auto route = buildRoute(kRouteProtoId, ipPrefix1, folly::none, paths);
+
+  EXPECT_EQ(ResultCode::SUCCESS, nlSock->addRoute(route));
+  EXPECT_EQ(0, nlSock->getErrorCount());
+  auto kernelRoutes = nlSock->getAllRoutes();
+  EXPECT_TRUE(checkRouteInKernelRoutes(kernelRoutes, route));
+
+  EXPECT_EQ(ResultCode::SUCCESS, nlSock->deleteRoute(route));
+  kernelRoutes = nlSock->getAllRoutes();
+  EXPECT_FALSE(checkRouteInKernelRoutes(kernelRoutes, route));
+}
+
+TEST_F(NlMessageFixture, IpRouteNextHopObject) {
+  // Add IPv6 route through a group of two nexthop objects, then repoint it by
+  // replacing the group with a single member
+
+  if (!nlSock->getAllNextHopObjects().has_value()) {
+    SKIP() << "Kernel does not support nexthop objects";
+    return;
+  }
+
+  const uint32_t kMemberId1{1001};
+  const uint32_t kMemberId2{1002};
+  const uint32_t kGroupId{1003};
+  auto nh1 = buildNextHop(
+      folly::none, folly::none, folly::none, ipAddrY1V6, ifIndexY);
+  auto nh2 = buildNextHop(
+      folly::none, folly::none, folly::none, ipAddrY2V6, ifIndexY);
+
+  std::vector<rnl::NextHopObject> objects(3);
+  objects[0].id = kMemberId1;
+  objects[0].protocolId = kRouteProtoId;
+  objects[0].nextHop = nh1;
+  objects[1].id = kMemberId2;
+  objects[1].protocolId = kRouteProtoId;
+  objects[1].nextHop = nh2;
+  objects[2].id = kGroupId;
+  objects[2].protocolId = kRouteProtoId;
+  objects[2].group = {{kMemberId1, 1}, {kMemberId2, 1}};
+  EXPECT_EQ(ResultCode::SUCCESS, nlSock->addNextHopObjects(objects));
+
+  auto kernelObjects = nlSock->getAllNextHopObjects();
+  ASSERT_TRUE(kernelObjects.has_value());
+  int found{0};
+  for (const auto& object : kernelObjects.value()) {
+    if (object.id == kMemberId1) {
+      found++;
+      ASSERT_TRUE(object.nextHop.has_value());
+      EXPECT_EQ(ipAddrY1V6, object.nextHop->getGateway());
+      EXPECT_EQ(ifIndexY, object.nextHop->getIfIndex());
+    }
+    if (object.id == kGroupId) {
+      found++;
+      EXPECT_EQ(objects[2].group, object.group);
+      EXPECT_EQ(kRouteProtoId, object.protocolId);
+    }
+  }
+  EXPECT_EQ(2, found);
+
+  std::vector<rnl::NextHop> paths{nh1, nh2};
+  auto route = buildRoute(kRouteProtoId, ipPrefix1, folly::none, paths);
+  route.setNextHopId(kGroupId);
+  EXPECT_EQ(ResultCode::SUCCESS, nlSock->addRoute(route));
+
+  // The kernel reports the object and what it resolves to
+  auto kernelRoutes = nlSock->getAllRoutes();
+  EXPECT_TRUE(checkRouteInKernelRoutes(kernelRoutes, route));
+  for (const auto& kernelRoute : kernelRoutes) {
+    if (kernelRoute.getDestination() == ipPrefix1) {
+      EXPECT_EQ(kGroupId, kernelRoute.getNextHopId());
+    }
+  }
+
+  // Repoint the route without touching it
+  objects[2].group = {{kMemberId2, 1}};
+  EXPECT_EQ(ResultCode::SUCCESS, nlSock->addNextHopObjects({objects[2]}));
+  kernelRoutes = nlSock->getAllRoutes();
+  paths = {nh2};
+  EXPECT_TRUE(checkRouteInKernelRoutes(
+      kernelRoutes,
+      buildRoute(kRouteProtoId, ipPrefix1, folly::none, paths)));
+
+  // Deleting the group deletes the route
+  EXPECT_EQ(
+      ResultCode::SUCCESS,
+      nlSock->deleteNextHopObjects({kGroupId, kMemberId1, kMemberId2}));
+  kernelRoutes = nlSock->getAllRoutes();
+  for (const auto& kernelRoute : kernelRoutes) {
+    EXPECT_NE(ipPrefix1, kernelRoute.getDestination());
+  }
+  EXPECT_EQ(0, nlSock->getErrorCount());
+}
+
 TEST_F(NlMessageFixture, IPv4RouteSingleNextHop) {
   // Add IPv4 route with one next hop and no labels
   // outoing IF is vethTestY
@@ -1488,6 +1597,104 @@ TEST_F(NlMessageFixture, GetAllNeighborsV4) {
   EXPECT_EQ(testNeighbors, 0);
 }
 
+// Encoded routes keep their bytes when packed out of the pooled encoding
+// buffers into one arena, back to back, and parse back to the same routes
+TEST(NetlinkMessageTest, PackIntoArena) {
+  auto makeRoute = [](const folly::CIDRNetwork& prefix) {
+    return rnl::RouteBuilder()
+        .setDestination(prefix)
+        .setProtocolId(kRouteProtoId)
+        .setPriority(kAqRouteProtoIdPriority)
+        .addNextHop(rnl::NextHopBuilder()
+                        .setIfIndex(1)
+                        .setGateway(folly::IPAddress("fe80::1"))
+                        .build())
+        .build();
+  };
+  const std::vector<rnl::Route> routes{makeRoute(ipPrefix1),
+                                       makeRoute(ipPrefix2)};
+  std::vector<std::unique_ptr<NetlinkRouteMessage>> rtmMsgs;
+  std::vector<std::string> encoded;
+  std::vector<char> arena;
+  for (const auto& route : routes) {
+    rtmMsgs.push_back(std::make_unique<NetlinkRouteMessage>());
+    auto& rtmMsg = *rtmMsgs.back();
+    ASSERT_EQ(ResultCode::SUCCESS, rtmMsg.addRoute(route));
+    EXPECT_LT(rtmMsg.getDataLength(), rnl::kMaxNlPayloadSize);
+    encoded.emplace_back(
+        reinterpret_cast<const char*>(rtmMsg.getMessagePtr()),
+        rtmMsg.getDataLength());
+    rtmMsg.packInto(arena);
+    // Idempotent
+    rtmMsg.packInto(arena);
+  }
+  EXPECT_EQ(
+      NLMSG_ALIGN(encoded[0].size()) + NLMSG_ALIGN(encoded[1].size()),
+      arena.size());
+
+  const auto sharedArena =
+      std::make_shared<std::vector<char>>(std::move(arena));
+  for (size_t i = 0; i < routes.size(); i++) {
+    auto& rtmMsg = *rtmMsgs[i];
+    rtmMsg.attachArena(sharedArena);
+    const auto* data = reinterpret_cast<const char*>(rtmMsg.getMessagePtr());
+    EXPECT_EQ(encoded[i].size(), rtmMsg.getDataLength());
+    EXPECT_EQ(encoded[i], std::string(data, rtmMsg.getDataLength()));
+    EXPECT_EQ(
+        sharedArena->data() + (i == 0 ? 0 : NLMSG_ALIGN(encoded[0].size())),
+        data);
+
+    const auto parsed =
+        NetlinkRouteMessage::parseMessage(rtmMsg.getMessagePtr());
+    EXPECT_EQ(routes[i].getDestination(), parsed.getDestination());
+    EXPECT_EQ(routes[i].getProtocolId(), parsed.getProtocolId());
+    EXPECT_EQ(routes[i].getPriority(), parsed.getPriority());
+    EXPECT_EQ(routes[i].getNextHops(), parsed.getNextHops());
+  }
+}
+
+// A datagram larger than the receive buffer loses its tail; the messages that
+// fit are processed, the owner is told to resync and the buffer grows so the
+// next such datagram is received whole
+TEST(NetlinkProtocolSocketTest, TruncatedDatagram) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds));
+  fbzmq::ZmqEventLoop evl;
+  NetlinkProtocolSocket nlSock(&evl);
+  int overruns{0};
+  nlSock.setOverrunCB([&overruns]() { overruns++; });
+  std::thread evlThread([&nlSock, &evl, fd = fds[0]]() {
+    nlSock.init(fd);
+    evl.run();
+  });
+  evl.waitUntilRunning();
+
+  // Twice the buffer of NLMSG_NOOPs
+  std::vector<char> datagram(2 * rnl::kNlRecvBufferSize);
+  for (size_t offset = 0; offset < datagram.size();
+       offset += NLMSG_LENGTH(0)) {
+    auto nlh = reinterpret_cast<struct nlmsghdr*>(datagram.data() + offset);
+    nlh->nlmsg_len = NLMSG_LENGTH(0);
+    nlh->nlmsg_type = NLMSG_NOOP;
+  }
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ(
+        datagram.size(),
+        static_cast<size_t>(
+            send(fds[1], datagram.data(), datagram.size(), 0)));
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  evl.stop();
+  evlThread.join();
+
+  EXPECT_EQ(1, overruns);
+  EXPECT_EQ(1, nlSock.getOverrunCount());
+  // NLMSG_NOOPs are not errors
+  EXPECT_EQ(1, nlSock.getErrorCount());
+  close(fds[1]);
+}
+
 int
 main(int argc, char* argv[]) {
   // Parse command line flags
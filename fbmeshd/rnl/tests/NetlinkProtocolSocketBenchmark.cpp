@@ -0,0 +1,268 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <folly/Benchmark.h>
+#include <folly/IPAddress.h>
+#include <folly/init/Init.h>
+
+#include <fbmeshd/rnl/NetlinkMessage.h>
+#include <fbmeshd/rnl/NetlinkRoute.h>
+#include <fbmeshd/rnl/NetlinkTypes.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Short enough that dropped acks do not dominate the runs
+const auto kAckTimeout{20ms};
+
+rnl::Route
+nthRoute(uint32_t n) {
+  std::array<uint8_t, 16> bytes{0xfd};
+  std::memcpy(bytes.data() + 12, &n, sizeof(n));
+  return rnl::RouteBuilder()
+      .setDestination({folly::IPAddressV6{bytes}, 128})
+      .setProtocolId(99)
+      .addNextHop(rnl::NextHopBuilder().setIfIndex(1).build())
+      .setValid(true)
+      .build();
+}
+
+/*
+ * Plays the kernel on one end of a SOCK_SEQPACKET socketpair. Every request is
+ * acked, every errorEvery-th with EINVAL and every dropEvery-th not at all. A
+ * dump request is answered with dumpSize routes. Replies are sent in
+ * datagrams of up to datagramSize bytes. Returns once the other end is closed.
+ */
+class FakeNetlinkPeer {
+ public:
+  FakeNetlinkPeer(
+      int fd,
+      size_t errorEvery,
+      size_t dropEvery,
+      size_t datagramSize = rnl::kNlRecvBufferSize,
+      size_t dumpSize = 0)
+      : fd_{fd},
+        errorEvery_{errorEvery},
+        dropEvery_{dropEvery},
+        datagramSize_{datagramSize},
+        dumpSize_{dumpSize},
+        thread_{[this]() { run(); }} {}
+
+  ~FakeNetlinkPeer() {
+    thread_.join();
+    close(fd_);
+  }
+
+ private:
+  void
+  run() {
+    // A batch of up to kMaxIovMsg route requests arrives as one datagram
+    std::vector<char> requests(1 << 20);
+    std::vector<char> replies;
+    replies.reserve(datagramSize_);
+    while (true) {
+      const auto bytes = ::recv(fd_, requests.data(), requests.size(), 0);
+      if (bytes <= 0) {
+        return;
+      }
+      uint32_t remaining = bytes;
+      for (auto nlh = reinterpret_cast<nlmsghdr*>(requests.data());
+           NLMSG_OK(nlh, remaining);
+           nlh = NLMSG_NEXT(nlh, remaining)) {
+        numRequests_++;
+        if (nlh->nlmsg_flags & NLM_F_DUMP) {
+          dump(*nlh, replies);
+          continue;
+        }
+        if (dropEvery_ && numRequests_ % dropEvery_ == 0) {
+          continue;
+        }
+        nlmsghdr ack{};
+        ack.nlmsg_len = NLMSG_LENGTH(sizeof(nlmsgerr));
+        ack.nlmsg_type = NLMSG_ERROR;
+        ack.nlmsg_seq = nlh->nlmsg_seq;
+        ack.nlmsg_pid = nlh->nlmsg_pid;
+        nlmsgerr err{};
+        const bool fail = errorEvery_ && numRequests_ % errorEvery_ == 0;
+        err.error = fail ? -EINVAL : 0;
+        err.msg = *nlh;
+        append(replies, &ack, sizeof(ack), &err, sizeof(err));
+      }
+      flush(replies);
+    }
+  }
+
+  void
+  dump(const nlmsghdr& request, std::vector<char>& replies) {
+    // The same route every time, it is parsing that is measured
+    rnl::NetlinkRouteMessage routeMsg;
+    CHECK(routeMsg.addRoute(nthRoute(0)) == rnl::ResultCode::SUCCESS);
+    nlmsghdr* route = routeMsg.getMessagePtr();
+    route->nlmsg_flags = NLM_F_MULTI;
+    route->nlmsg_seq = request.nlmsg_seq;
+    route->nlmsg_pid = request.nlmsg_pid;
+    for (size_t i = 0; i < dumpSize_; i++) {
+      append(replies, route, NLMSG_ALIGN(route->nlmsg_len), nullptr, 0);
+    }
+    nlmsghdr done{};
+    done.nlmsg_len = NLMSG_LENGTH(0);
+    done.nlmsg_type = NLMSG_DONE;
+    done.nlmsg_flags = NLM_F_MULTI;
+    done.nlmsg_seq = request.nlmsg_seq;
+    done.nlmsg_pid = request.nlmsg_pid;
+    append(replies, &done, sizeof(done), nullptr, 0);
+  }
+
+  void
+  append(
+      std::vector<char>& replies,
+      const void* hdr,
+      size_t hdrLen,
+      const void* payload,
+      size_t payloadLen) {
+    if (replies.size() + hdrLen + payloadLen > datagramSize_) {
+      flush(replies);
+    }
+    const auto* hdrBytes = reinterpret_cast<const char*>(hdr);
+    const auto* payloadBytes = reinterpret_cast<const char*>(payload);
+    replies.insert(replies.end(), hdrBytes, hdrBytes + hdrLen);
+    replies.insert(replies.end(), payloadBytes, payloadBytes + payloadLen);
+  }
+
+  void
+  flush(std::vector<char>& replies) {
+    if (!replies.empty()) {
+      PCHECK(::send(fd_, replies.data(), replies.size(), 0) >= 0);
+      replies.clear();
+    }
+  }
+
+  const int fd_;
+  const size_t errorEvery_;
+  const size_t dropEvery_;
+  const size_t datagramSize_;
+  const size_t dumpSize_;
+  size_t numRequests_{0};
+  std::thread thread_;
+};
+
+void
+addRoutes(
+    uint32_t iters, size_t window, size_t errorEvery, size_t dropEvery) {
+  fbzmq::ZmqEventLoop evl;
+  std::thread evlThread;
+  std::unique_ptr<FakeNetlinkPeer> peer;
+  std::unique_ptr<rnl::NetlinkProtocolSocket> nlSock;
+  std::vector<rnl::Route> routes;
+
+  BENCHMARK_SUSPEND {
+    int fds[2];
+    PCHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == 0);
+    peer = std::make_unique<FakeNetlinkPeer>(fds[1], errorEvery, dropEvery);
+    nlSock =
+        std::make_unique<rnl::NetlinkProtocolSocket>(&evl, window, kAckTimeout);
+    evlThread = std::thread([&nlSock, &evl, fd = fds[0]]() {
+      nlSock->init(fd);
+      evl.run();
+    });
+    evl.waitUntilRunning();
+    for (uint32_t i = 0; i < iters; i++) {
+      routes.push_back(nthRoute(i));
+    }
+  }
+
+  nlSock->addRoutes(routes);
+
+  BENCHMARK_SUSPEND {
+    evl.stop();
+    evlThread.join();
+    // Closes our end, which stops the peer
+    nlSock.reset();
+    peer.reset();
+  }
+}
+
+void
+dumpRoutes(uint32_t iters, size_t datagramSize) {
+  // About what a mesh gate with a full table has
+  const size_t kDumpSize{10000};
+  fbzmq::ZmqEventLoop evl;
+  std::thread evlThread;
+  std::unique_ptr<FakeNetlinkPeer> peer;
+  std::unique_ptr<rnl::NetlinkProtocolSocket> nlSock;
+
+  BENCHMARK_SUSPEND {
+    int fds[2];
+    PCHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == 0);
+    peer = std::make_unique<FakeNetlinkPeer>(
+        fds[1], 0, 0, datagramSize, kDumpSize);
+    nlSock = std::make_unique<rnl::NetlinkProtocolSocket>(&evl);
+    evlThread = std::thread([&nlSock, &evl, fd = fds[0]]() {
+      nlSock->init(fd);
+      evl.run();
+    });
+    evl.waitUntilRunning();
+  }
+
+  for (uint32_t i = 0; i < iters; i++) {
+    CHECK_EQ(kDumpSize, nlSock->getAllRoutes().size());
+  }
+
+  BENCHMARK_SUSPEND {
+    evl.stop();
+    evlThread.join();
+    nlSock.reset();
+    peer.reset();
+  }
+}
+
+} // namespace
+
+BENCHMARK_NAMED_PARAM(addRoutes, window_1, 1, 0, 0)
+BENCHMARK_RELATIVE_NAMED_PARAM(addRoutes, window_16, 16, 0, 0)
+BENCHMARK_RELATIVE_NAMED_PARAM(addRoutes, window_500, 500, 0, 0)
+
+BENCHMARK_DRAW_LINE();
+
+// Every tenth request fails, which must not slow the others down
+BENCHMARK_NAMED_PARAM(addRoutes, window_500_errors, 500, 10, 0)
+BENCHMARK_RELATIVE_NAMED_PARAM(addRoutes, window_500_no_errors, 500, 0, 0)
+
+BENCHMARK_DRAW_LINE();
+
+// One ack in 1000 is lost; only that request waits for kAckTimeout, the
+// window keeps moving around it
+BENCHMARK_NAMED_PARAM(addRoutes, window_500_lost_acks, 500, 0, 1000)
+BENCHMARK_RELATIVE_NAMED_PARAM(addRoutes, window_500_no_lost_acks, 500, 0, 0)
+
+BENCHMARK_DRAW_LINE();
+
+// The kernel sends a dump in datagrams as large as the buffer it has seen
+// the socket receive with, up to 32 KiB
+BENCHMARK_NAMED_PARAM(dumpRoutes, datagram_4k, 4096)
+BENCHMARK_RELATIVE_NAMED_PARAM(dumpRoutes, datagram_32k, 32 * 1024)
+
+int
+main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -7,6 +7,7 @@
 
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <thread>
 
@@ -120,7 +121,7 @@ class NetlinkSocketFixture : public testing::Test {
 
     // create netlink route socket
     netlinkSocket = std::make_unique<NetlinkSocket>(
-        &evl, nullptr, std::move(nlProtocolSocket));
+        &evl, nullptr, std::move(nlProtocolSocket), useNextHopObjects);
 
     // Run the zmq event loop in its own thread
     // We will either timeout if expected events are not received
@@ -220,6 +221,8 @@ class NetlinkSocketFixture : public testing::Test {
     return builder.buildLinkRoute();
   }
 
+  // Set by fixtures that exercise kernel nexthop objects
+  bool useNextHopObjects{false};
   std::unique_ptr<NetlinkSocket> netlinkSocket;
   std::unique_ptr<rnl::NetlinkProtocolSocket> nlProtocolSocket;
   fbzmq::ZmqEventLoop evl;
@@ -986,6 +989,82 @@ TEST_F(NetlinkSocketFixture, UpdateMultiRouteTestV4) {
   doUpdateMultiRouteTest(true);
 }
 
+// - Add a V6 route
+// - move it from one path to two, to another single path and to another
+//   metric
+// - verify after each update that the kernel has exactly the cached route,
+//   whether it was replaced in place or deleted and added again
+// - Delete it and verify it is deleted
+TEST_F(NetlinkSocketFixture, ReplaceRouteTest) {
+  LOG(INFO) << "IPv6 routes replaced in place: "
+            << netlinkSocket->replacesV6Routes();
+  folly::CIDRNetwork prefix{folly::IPAddress("fc00:cafe:5::5"), 128};
+  int ifIndex = rtnl_link_name2i(linkCache_, kVethNameY.c_str());
+
+  auto routeFunc = [](struct nl_object * obj, void* arg) noexcept->void {
+    RouteCallbackContext* ctx = static_cast<RouteCallbackContext*>(arg);
+    struct rtnl_route* routeObj = reinterpret_cast<struct rtnl_route*>(obj);
+    RouteBuilder builder;
+    if (rtnl_route_get_protocol(routeObj) == kAqRouteProtoId) {
+      ctx->results.emplace_back(builder.buildFromObject(routeObj));
+    }
+  };
+  auto getGateways = [](const Route& route) {
+    std::set<folly::IPAddress> gateways;
+    for (const auto& nextHop : route.getNextHops()) {
+      if (nextHop.getGateway().has_value()) {
+        gateways.insert(nextHop.getGateway().value());
+      }
+    }
+    return gateways;
+  };
+  auto checkRoute = [&](const std::vector<folly::IPAddress>& nexthops) {
+    RouteCallbackContext ctx;
+    rtnlCacheCB(routeFunc, &ctx, routeCache_);
+    std::vector<Route> kernelRoutes;
+    for (const auto& r : ctx.results) {
+      if (r.getDestination() == prefix) {
+        kernelRoutes.push_back(r);
+      }
+    }
+    auto routes = netlinkSocket->getCachedUnicastRoutes(kAqRouteProtoId).get();
+    ASSERT_EQ(1, kernelRoutes.size());
+    ASSERT_EQ(1, routes.count(prefix));
+    const std::set<folly::IPAddress> expected(nexthops.begin(), nexthops.end());
+    EXPECT_EQ(expected, getGateways(kernelRoutes[0]));
+    EXPECT_EQ(expected, getGateways(routes.at(prefix)));
+    EXPECT_EQ(routes.at(prefix).getPriority(), kernelRoutes[0].getPriority());
+  };
+
+  const std::vector<std::vector<folly::IPAddress>> updates{
+      {folly::IPAddress("fe80::1")},
+      {folly::IPAddress("fe80::1"), folly::IPAddress("fe80::2")},
+      {folly::IPAddress("fe80::3")}};
+  for (const auto& nexthops : updates) {
+    netlinkSocket
+        ->addRoute(buildRoute(ifIndex, kAqRouteProtoId, nexthops, prefix))
+        .get();
+    checkRoute(nexthops);
+  }
+
+  // Another metric, for which the kernel would add a second route
+  auto route = buildRoute(ifIndex, kAqRouteProtoId, updates.back(), prefix);
+  route.setPriority(kAqRouteProtoIdPriority + 1);
+  netlinkSocket->addRoute(std::move(route)).get();
+  checkRoute(updates.back());
+
+  netlinkSocket
+      ->delRoute(buildRoute(ifIndex, kAqRouteProtoId, updates.back(), prefix))
+      .get();
+  auto routes = netlinkSocket->getCachedUnicastRoutes(kAqRouteProtoId).get();
+  EXPECT_EQ(0, routes.count(prefix));
+  RouteCallbackContext ctx;
+  rtnlCacheCB(routeFunc, &ctx, routeCache_);
+  for (const auto& r : ctx.results) {
+    EXPECT_NE(prefix, r.getDestination());
+  }
+}
+
 // Create unicast routes database
 // Modify route database in various ways: change nexthops, remove prefixes.. etc
 // Verify netlinkSocket sync up with route db correctly
@@ -2648,6 +2727,104 @@ TEST_F(NetlinkSocketFixture, LoopbackTest) {
   EXPECT_TRUE(netlinkSocket->getLoopbackIfindex().get().has_value());
 }
 
+// Same as NetlinkSocketFixture but programs unicast routes through kernel
+// nexthop objects
+class NetlinkSocketNextHopObjectFixture : public NetlinkSocketFixture {
+ public:
+  NetlinkSocketNextHopObjectFixture() {
+    useNextHopObjects = true;
+  }
+};
+
+// - Add routes sharing the same nexthop
+// - verify they share one nexthop object
+// - Move all of them to another nexthop in one update
+// - verify kernel and cache follow, then delete them
+TEST_F(NetlinkSocketNextHopObjectFixture, RepointRoutesTest) {
+  if (!netlinkSocket->usesNextHopObjects()) {
+    SKIP() << "Kernel does not support nexthop objects";
+    return;
+  }
+
+  const int kNumRoutes{10};
+  std::vector<folly::IPAddress> nexthops1{folly::IPAddress("fe80::1")};
+  std::vector<folly::IPAddress> nexthops2{folly::IPAddress("fe80::2")};
+  int ifIndex = rtnl_link_name2i(linkCache_, kVethNameY.c_str());
+
+  auto routeFunc = [](struct nl_object * obj, void* arg) noexcept->void {
+    RouteCallbackContext* ctx = static_cast<RouteCallbackContext*>(arg);
+    struct rtnl_route* routeObj = reinterpret_cast<struct rtnl_route*>(obj);
+    RouteBuilder builder;
+    if (rtnl_route_get_protocol(routeObj) == kAqRouteProtoId) {
+      ctx->results.emplace_back(builder.buildFromObject(routeObj));
+    }
+  };
+
+  std::vector<Route> routes1;
+  std::vector<Route> routes2;
+  for (int i = 0; i < kNumRoutes; i++) {
+    folly::CIDRNetwork prefix{
+        folly::IPAddress(folly::sformat("fc00:cafe:4::{}", i + 1)), 128};
+    routes1.emplace_back(
+        buildRoute(ifIndex, kAqRouteProtoId, nexthops1, prefix));
+    routes2.emplace_back(
+        buildRoute(ifIndex, kAqRouteProtoId, nexthops2, prefix));
+  }
+
+  auto checkKernelRoutes = [&](const folly::IPAddress& gateway) {
+    RouteCallbackContext ctx;
+    rtnlCacheCB(routeFunc, &ctx, routeCache_);
+    int count = 0;
+    for (const auto& r : ctx.results) {
+      if (r.getNextHops().size() == 1 &&
+          r.getNextHops().begin()->getGateway() == gateway) {
+        count++;
+      }
+    }
+    EXPECT_EQ(kNumRoutes, count);
+  };
+
+  auto checkCachedRoutes = [&](const folly::IPAddress& gateway) {
+    auto cached =
+        netlinkSocket->getCachedUnicastRoutes(kAqRouteProtoId).get();
+    EXPECT_EQ(kNumRoutes, cached.size());
+    std::set<uint32_t> ids;
+    for (const auto& kv : cached) {
+      EXPECT_EQ(1, kv.second.getNextHops().size());
+      EXPECT_EQ(gateway, kv.second.getNextHops().begin()->getGateway());
+      EXPECT_TRUE(kv.second.getNextHopId().has_value());
+      if (kv.second.getNextHopId().has_value()) {
+        ids.insert(kv.second.getNextHopId().value());
+      }
+    }
+    EXPECT_EQ(1, ids.size());
+    return ids.empty() ? 0 : *ids.begin();
+  };
+
+  netlinkSocket->updateUnicastRoutes(kAqRouteProtoId, routes1, {}).get();
+  checkKernelRoutes(nexthops1[0]);
+  const auto id1 = checkCachedRoutes(nexthops1[0]);
+
+  // Every route using the object moves, so the object itself is replaced
+  netlinkSocket->updateUnicastRoutes(kAqRouteProtoId, routes2, {}).get();
+  checkKernelRoutes(nexthops2[0]);
+  EXPECT_EQ(id1, checkCachedRoutes(nexthops2[0]));
+
+  // Moving only one route back gives it its own object
+  netlinkSocket->updateUnicastRoutes(kAqRouteProtoId, {routes1[0]}, {}).get();
+  auto cached = netlinkSocket->getCachedUnicastRoutes(kAqRouteProtoId).get();
+  const auto& moved = cached.at(routes1[0].getDestination());
+  EXPECT_EQ(nexthops1[0], moved.getNextHops().begin()->getGateway());
+  EXPECT_NE(id1, moved.getNextHopId().value());
+
+  netlinkSocket->updateUnicastRoutes(kAqRouteProtoId, {}, routes2).get();
+  EXPECT_EQ(
+      0, netlinkSocket->getCachedUnicastRoutes(kAqRouteProtoId).get().size());
+  RouteCallbackContext ctx;
+  rtnlCacheCB(routeFunc, &ctx, routeCache_);
+  EXPECT_EQ(0, ctx.results.size());
+}
+
 int
 main(int argc, char* argv[]) {
   // Parse command line flags
@@ -83,6 +83,18 @@ TEST(NetlinkTypes, NextHopGatewayTest) {
   rtnl_route_nh_free(object);
 }
 
+TEST(NetlinkTypes, NextHopUnsetWeightEqualsOne) {
+  // The kernel reports an unset weight as 1
+  folly::IPAddress gateway("fc00:cafe:3::3");
+  NextHopBuilder builder;
+  auto unset = builder.setGateway(gateway).setIfIndex(kIfIndex).build();
+  auto one = builder.setWeight(1).build();
+  auto other = builder.setWeight(kWeight).build();
+  EXPECT_EQ(unset, one);
+  EXPECT_EQ(NextHopHash()(unset), NextHopHash()(one));
+  EXPECT_FALSE(unset == other);
+}
+
 TEST(NetlinkTypes, NexthopGeneralTest) {
   folly::IPAddress gateway("fc00:cafe:3::3");
   NextHopBuilder builder;
@@ -7,6 +7,7 @@
 
 #include "RouteUpdateMonitor.h"
 
+#include <limits>
 #include <thread>
 
 #include <folly/Subprocess.h>
@@ -14,6 +15,13 @@
 
 using namespace fbmeshd;
 
+namespace {
+// Bound on the reads done per wakeup, so that a flood of route updates does
+// not starve the event base; the socket stays readable and is drained on the
+// next loop iteration
+const int kMaxReceivesPerEvent{64};
+} // namespace
+
 RouteUpdateMonitor::RouteUpdateMonitor(
     folly::EventBase* evb, Nl80211Handler& nlHandler)
     : folly::EventHandler(), nlHandler_{nlHandler} {
@@ -36,11 +44,23 @@ RouteUpdateMonitor::RouteUpdateMonitor(
 
   nl_socket_disable_seq_check(eventSock_);
 
-  // set up libnl callbacks to invoke processRouteUpdate on events
-  auto valid_cb = [](nl_msg* /* msg */, void* arg) -> int {
-    VLOG(8) << folly::sformat("RouteUpdateMonitor::{}() nl callback", __func__);
+  // set up libnl callbacks to invoke the process*Update functions on events
+  auto valid_cb = [](nl_msg* msg, void* arg) -> int {
     RouteUpdateMonitor* obj = reinterpret_cast<RouteUpdateMonitor*>(arg);
-    obj->processRouteUpdate();
+    nlmsghdr* nlh = nlmsg_hdr(msg);
+    switch (nlh->nlmsg_type) {
+      case RTM_NEWROUTE:
+      case RTM_DELROUTE:
+        obj->processRouteUpdate(nlh);
+        break;
+      case RTM_NEWLINK:
+      case RTM_DELLINK:
+        obj->processLinkUpdate(nlh);
+        break;
+      case RTM_DELADDR:
+        obj->processAddressUpdate(nlh);
+        break;
+    }
     return NL_SKIP;
   };
   nl_socket_modify_cb(eventSock_, NL_CB_VALID, NL_CB_CUSTOM, valid_cb, this);
@@ -53,21 +73,25 @@ RouteUpdateMonitor::RouteUpdateMonitor(
     throw std::runtime_error(folly::sformat(
         "RouteUpdateMonitor::{}() failed to connect event socket", __func__));
   }
-
-  // load route cache
-  int ret = rtnl_route_alloc_cache(sock_, AF_UNSPEC, 0, &routeCache_);
-  if (ret < 0) {
+  if (nl_socket_set_nonblocking(eventSock_) < 0) {
     throw std::runtime_error(folly::sformat(
-        "RouteUpdateMonitor::{}() failed to allocate route cache", __func__));
+        "RouteUpdateMonitor::{}() failed to make event socket non-blocking",
+        __func__));
   }
 
-  // subscribe to mcast route updates
-  std::array<rtnetlink_groups, 2> groups = {
+  // subscribe to mcast route updates before loading the routes, so that no
+  // update falls between the two. Updates already reflected in the dump are
+  // harmless to apply again. The kernel flushes the IPv4 routes of a device
+  // that goes down or loses an address without a RTM_DELROUTE for each, so
+  // those events are followed as well.
+  std::array<rtnetlink_groups, 4> groups = {
       RTNLGRP_IPV4_ROUTE,
       RTNLGRP_IPV6_ROUTE,
+      RTNLGRP_LINK,
+      RTNLGRP_IPV4_IFADDR,
   };
   for (size_t i = 0; i < groups.size(); i++) {
-    ret = nl_socket_add_membership(eventSock_, groups[i]);
+    int ret = nl_socket_add_membership(eventSock_, groups[i]);
     if (ret < 0) {
       throw std::runtime_error(folly::sformat(
           "RouteUpdateMonitor::{}() failed to join multicast group {}",
@@ -76,6 +100,13 @@ RouteUpdateMonitor::RouteUpdateMonitor(
     }
   }
 
+  // load default routes
+  if (!resyncDefaultRoutes()) {
+    throw std::runtime_error(folly::sformat(
+        "RouteUpdateMonitor::{}() failed to allocate route cache", __func__));
+  }
+  reportConnectedToGate();
+
   initHandler(evb, folly::NetworkSocket::fromFd(nl_socket_get_fd(eventSock_)));
   registerHandler(folly::EventHandler::READ | folly::EventHandler::PERSIST);
 }
@@ -85,18 +116,76 @@ RouteUpdateMonitor::~RouteUpdateMonitor() {
 
   unregisterHandler();
 
-  nl_cache_free(routeCache_);
   nl_socket_free(eventSock_);
   nl_socket_free(sock_);
 }
 
 bool
-RouteUpdateMonitor::hasDefaultRoute() {
-  nl_object* obj = nl_cache_get_first(routeCache_);
+RouteUpdateMonitor::isDefaultRoute(rtnl_route* route) {
+  nl_addr* addr = rtnl_route_get_dst(route);
+  return addr && nl_addr_iszero(addr);
+}
+
+std::vector<RouteUpdateMonitor::DefaultRoute>
+RouteUpdateMonitor::getDefaultRoutes(rtnl_route* route) {
+  const auto family = rtnl_route_get_family(route);
+  const auto table = rtnl_route_get_table(route);
+  const auto tos = rtnl_route_get_tos(route);
+  const auto priority = rtnl_route_get_priority(route);
+
+  // Routes without next hops, e.g. unreachable ones, still count
+  std::vector<DefaultRoute> defaultRoutes;
+  const int numNextHops = rtnl_route_get_nnexthops(route);
+  if (numNextHops == 0) {
+    defaultRoutes.emplace_back(family, table, tos, priority, 0, "");
+  }
+  for (int i = 0; i < numNextHops; i++) {
+    rtnl_nexthop* nextHop = rtnl_route_nexthop_n(route, i);
+    nl_addr* gateway = rtnl_route_nh_get_gateway(nextHop);
+    std::string gatewayBytes;
+    if (gateway) {
+      gatewayBytes.assign(
+          static_cast<const char*>(nl_addr_get_binary_addr(gateway)),
+          nl_addr_get_len(gateway));
+    }
+    defaultRoutes.emplace_back(
+        family,
+        table,
+        tos,
+        priority,
+        rtnl_route_nh_get_ifindex(nextHop),
+        std::move(gatewayBytes));
+  }
+  return defaultRoutes;
+}
+
+bool
+RouteUpdateMonitor::resyncDefaultRoutes() {
+  VLOG(8) << folly::sformat("RouteUpdateMonitor::{}()", __func__);
+  nl_cache* routeCache{nullptr};
+  if (rtnl_route_alloc_cache(sock_, AF_UNSPEC, 0, &routeCache) < 0) {
+    LOG(ERROR) << "Could not load routing table";
+    return false;
+  }
+
+  defaultRoutes_.clear();
+  nl_object* obj = nl_cache_get_first(routeCache);
   for (; obj; obj = nl_cache_get_next(obj)) {
     rtnl_route* route = (rtnl_route*)obj;
-    nl_addr* addr = rtnl_route_get_dst(route);
-    if (addr && nl_addr_iszero(addr)) {
+    if (isDefaultRoute(route)) {
+      for (auto& defaultRoute : getDefaultRoutes(route)) {
+        defaultRoutes_.insert(std::move(defaultRoute));
+      }
+    }
+  }
+  nl_cache_free(routeCache);
+  return true;
+}
+
+bool
+RouteUpdateMonitor::hasDefaultRouteThrough(int ifIndex) const {
+  for (const auto& defaultRoute : defaultRoutes_) {
+    if (std::get<4>(defaultRoute) == ifIndex) {
       return true;
     }
   }
@@ -104,13 +193,104 @@ RouteUpdateMonitor::hasDefaultRoute() {
 }
 
 void
-RouteUpdateMonitor::processRouteUpdate() {
-  VLOG(8) << folly::sformat("RouteUpdateMonitor::{}()", __func__);
-  if (nl_cache_refill(sock_, routeCache_) < 0) {
-    LOG(ERROR) << "Could not refill routing cache";
+RouteUpdateMonitor::processLinkUpdate(nlmsghdr* nlh) {
+  if (!nlmsg_valid_hdr(nlh, sizeof(ifinfomsg))) {
+    return;
+  }
+  const auto* ifi = static_cast<const ifinfomsg*>(nlmsg_data(nlh));
+  if (nlh->nlmsg_type == RTM_NEWLINK && (ifi->ifi_flags & IFF_UP)) {
     return;
   }
-  bool isConnected = hasDefaultRoute();
+  if (hasDefaultRouteThrough(ifi->ifi_index)) {
+    VLOG(8) << folly::sformat(
+        "RouteUpdateMonitor::{}() link {} with a default route went down",
+        __func__,
+        ifi->ifi_index);
+    needsResync_ = true;
+  }
+}
+
+void
+RouteUpdateMonitor::processAddressUpdate(nlmsghdr* nlh) {
+  if (!nlmsg_valid_hdr(nlh, sizeof(ifaddrmsg))) {
+    return;
+  }
+  const auto* ifa = static_cast<const ifaddrmsg*>(nlmsg_data(nlh));
+  if (ifa->ifa_family != AF_INET) {
+    return;
+  }
+  if (hasDefaultRouteThrough(ifa->ifa_index)) {
+    VLOG(8) << folly::sformat(
+        "RouteUpdateMonitor::{}() link {} with a default route lost an address",
+        __func__,
+        ifa->ifa_index);
+    needsResync_ = true;
+  }
+}
+
+void
+RouteUpdateMonitor::processRouteUpdate(nlmsghdr* nlh) {
+  if (!nlmsg_valid_hdr(nlh, sizeof(rtmsg))) {
+    return;
+  }
+  // SyncRoutes80211s installs a host route per mesh station, so most updates
+  // are skipped here without being parsed
+  if (static_cast<const rtmsg*>(nlmsg_data(nlh))->rtm_dst_len != 0) {
+    return;
+  }
+
+  rtnl_route* route{nullptr};
+  if (rtnl_route_parse(nlh, &route) < 0) {
+    LOG(ERROR) << "Could not parse route update";
+    return;
+  }
+  if (!isDefaultRoute(route)) {
+    rtnl_route_put(route);
+    return;
+  }
+  VLOG(8) << folly::sformat(
+      "RouteUpdateMonitor::{}() {} default route",
+      __func__,
+      nlh->nlmsg_type == RTM_NEWROUTE ? "new" : "deleted");
+
+  auto defaultRoutes = getDefaultRoutes(route);
+  rtnl_route_put(route);
+  if (nlh->nlmsg_type == RTM_DELROUTE) {
+    for (const auto& defaultRoute : defaultRoutes) {
+      defaultRoutes_.erase(defaultRoute);
+    }
+    return;
+  }
+  if (nlh->nlmsg_flags & NLM_F_REPLACE && !defaultRoutes.empty()) {
+    // Drop the next hops of the route this one replaced
+    const auto& first = defaultRoutes.front();
+    auto it = defaultRoutes_.lower_bound(std::make_tuple(
+        std::get<0>(first),
+        std::get<1>(first),
+        std::get<2>(first),
+        std::get<3>(first),
+        std::numeric_limits<int>::min(),
+        std::string{}));
+    while (it != defaultRoutes_.end() &&
+           std::get<0>(*it) == std::get<0>(first) &&
+           std::get<1>(*it) == std::get<1>(first) &&
+           std::get<2>(*it) == std::get<2>(first) &&
+           std::get<3>(*it) == std::get<3>(first)) {
+      it = defaultRoutes_.erase(it);
+    }
+  }
+  for (auto& defaultRoute : defaultRoutes) {
+    defaultRoutes_.insert(std::move(defaultRoute));
+  }
+}
+
+void
+RouteUpdateMonitor::reportConnectedToGate() {
+  const bool isConnected = !defaultRoutes_.empty();
+  if (reportedConnectedToGate_ == isConnected) {
+    return;
+  }
+  reportedConnectedToGate_ = isConnected;
   nlHandler_.setMeshConnectedToGate(isConnected);
 }
 
@@ -118,9 +298,33 @@ void
 RouteUpdateMonitor::handlerReady(uint16_t events) noexcept {
   VLOG(8) << folly::sformat("RouteUpdateMonitor::{}()", __func__);
   uint16_t relevantEvents = uint16_t(events & folly::EventHandler::READ);
-  if (relevantEvents == folly::EventHandler::READ) {
-    VLOG(8) << folly::sformat(
-        "RouteUpdateMonitor::{}() received from socket", __func__);
-    nl_recvmsgs_default(eventSock_);
+  if (relevantEvents != folly::EventHandler::READ) {
+    return;
   }
-};
+
+  // Drain the socket and report once for the whole burst
+  for (int i = 0; i < kMaxReceivesPerEvent; i++) {
+    const int ret = nl_recvmsgs_default(eventSock_);
+    if (ret == -NLE_AGAIN) {
+      break;
+    }
+    if (ret == -NLE_NOMEM) {
+      // ENOBUFS: the kernel dropped updates, any of which may have been for
+      // a default route
+      needsResync_ = true;
+    } else if (ret < 0) {
+      LOG(ERROR) << "Could not receive route updates: " << nl_geterror(ret);
+      break;
+    }
+  }
+  if (needsResync_) {
+    LOG(WARNING) << "Route updates were lost or routes were flushed, "
+                    "reloading the routing table";
+    if (!resyncDefaultRoutes()) {
+      // Keep the last known state and retry on the next update
+      return;
+    }
+    needsResync_ = false;
+  }
+  reportConnectedToGate();
+}
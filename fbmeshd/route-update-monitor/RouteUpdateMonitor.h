@@ -10,7 +10,10 @@
 #include <netlink/cache.h> // @manual
 #include <netlink/route/route.h> // @manual
 
+#include <set>
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include <folly/Optional.h>
 #include <folly/Portability.h>
@@ -36,16 +39,43 @@ class RouteUpdateMonitor final : public folly::EventHandler {
  private:
   void handlerReady(uint16_t events) noexcept override;
 
-  // called whenever the routing table is updated
-  void processRouteUpdate();
+  // called for every route notification, only default routes are parsed
+  void processRouteUpdate(nlmsghdr* nlh);
+
+  // called for every link and IPv4 address removal notification; the kernel
+  // flushes the routes these take down silently, so they trigger a resync if
+  // a default route goes through the link
+  void processLinkUpdate(nlmsghdr* nlh);
+  void processAddressUpdate(nlmsghdr* nlh);
+
+  bool hasDefaultRouteThrough(int ifIndex) const;
+
+  // rebuilds defaultRoutes_ from a dump of the routing table, used at start
+  // and when notifications were lost
+  FOLLY_NODISCARD bool resyncDefaultRoutes();
+
+  // tells the kernel whether this node has an L3 route (aka connected to
+  // gate), if that changed
+  void reportConnectedToGate();
+
+  // One default route next hop: family, table, tos, priority, ifindex and
+  // gateway address bytes
+  using DefaultRoute =
+      std::tuple<uint8_t, uint32_t, uint8_t, uint32_t, int, std::string>;
+
+  static bool isDefaultRoute(rtnl_route* route);
+  static std::vector<DefaultRoute> getDefaultRoutes(rtnl_route* route);
 
-  // checks whether this node has an L3 route (aka connected to gate)
-  FOLLY_NODISCARD bool hasDefaultRoute();
   Nl80211Handler& nlHandler_;
 
   nl_sock* sock_;
   nl_sock* eventSock_;
-  nl_cache* routeCache_;
+
+  std::set<DefaultRoute> defaultRoutes_;
+  folly::Optional<bool> reportedConnectedToGate_;
+  // set when updates were lost or routes were flushed without updates, until
+  // a resync succeeds
+  bool needsResync_{false};
 }; // RouteUpdateMonitor
 
 } // namespace fbmeshd
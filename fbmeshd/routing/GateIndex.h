@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+#include <folly/MacAddress.h>
+
+namespace fbmeshd {
+
+/**
+ * Mesh gates ordered by path metric (ties broken by address), maintained
+ * incrementally as gate paths are added, updated and withdrawn so that top-K
+ * queries do not have to sort all gates.
+ *
+ * Queries take an isLive predicate so that the owner can skip entries that
+ * went stale but have not been erased yet; with at most a few stale entries
+ * near the front they cost O(K).
+ */
+class GateIndex {
+ public:
+  GateIndex() = default;
+  ~GateIndex() = default;
+  GateIndex(const GateIndex&) = delete;
+  GateIndex(GateIndex&&) = delete;
+  GateIndex& operator=(const GateIndex&) = delete;
+  GateIndex& operator=(GateIndex&&) = delete;
+
+  // Insert the gate, or move it to its new metric
+  void
+  set(folly::MacAddress gate, uint32_t metric) {
+    auto it = metrics_.find(gate);
+    if (it != metrics_.end()) {
+      if (it->second == metric) {
+        return;
+      }
+      byMetric_.erase(std::make_pair(it->second, gate));
+      it->second = metric;
+    } else {
+      metrics_.emplace(gate, metric);
+    }
+    byMetric_.emplace(metric, gate);
+  }
+
+  void
+  erase(folly::MacAddress gate) {
+    auto it = metrics_.find(gate);
+    if (it == metrics_.end()) {
+      return;
+    }
+    byMetric_.erase(std::make_pair(it->second, gate));
+    metrics_.erase(it);
+  }
+
+  // Returns true if gate is one of the k best live gates
+  template <typename IsLive>
+  bool
+  isInTopK(folly::MacAddress gate, size_t k, IsLive isLive) const {
+    size_t rank{0};
+    for (auto it = byMetric_.begin(); it != byMetric_.end() && rank < k; ++it) {
+      if (!isLive(it->second)) {
+        continue;
+      }
+      if (it->second == gate) {
+        return true;
+      }
+      ++rank;
+    }
+    return false;
+  }
+
+  // Counts live gates other than exclude with a metric no worse than the given
+  // one, stopping once limit is reached
+  template <typename IsLive>
+  size_t
+  countNoWorseThan(
+      uint32_t metric,
+      folly::MacAddress exclude,
+      size_t limit,
+      IsLive isLive) const {
+    size_t count{0};
+    for (auto it = byMetric_.begin();
+         it != byMetric_.end() && it->first <= metric && count < limit;
+         ++it) {
+      if (it->second != exclude && isLive(it->second)) {
+        ++count;
+      }
+    }
+    return count;
+  }
+
+  size_t
+  size() const {
+    return metrics_.size();
+  }
+
+ private:
+  std::set<std::pair<uint32_t, folly::MacAddress>> byMetric_;
+  std::unordered_map<folly::MacAddress, uint32_t> metrics_;
+};
+
+} // namespace fbmeshd
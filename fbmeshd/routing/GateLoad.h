@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include <folly/Optional.h>
+
+namespace fbmeshd {
+
+/**
+ * WAN load a gate advertises in its PANNs
+ *
+ * @capacityKbps: WAN capacity
+ * @utilization: WAN utilization in percent of the capacity
+ */
+struct GateLoad {
+  uint32_t capacityKbps{0};
+  uint8_t utilization{0};
+};
+
+inline bool
+operator==(const GateLoad& lhs, const GateLoad& rhs) {
+  return lhs.capacityKbps == rhs.capacityKbps &&
+      lhs.utilization == rhs.utilization;
+}
+
+// Spare WAN capacity at or above which a gate counts as idle. Gates that
+// advertise no capacity are assumed to have this much in total.
+constexpr uint64_t kIdleGateSpareKbps{100000};
+
+// Bound on how much further away load can make a gate look
+constexpr uint64_t kMaxGateLoadPenalty{10};
+
+/*
+ * Scale the path metric to a gate by the WAN capacity it has to spare: a gate
+ * with less than kIdleGateSpareKbps spare looks kIdleGateSpareKbps / spare
+ * times further away, up to kMaxGateLoadPenalty times. A small uplink thus
+ * ranks below a large one that is busier in percent. Gates that advertise no
+ * load count as idle.
+ */
+inline uint32_t
+getLoadAdjustedMetric(
+    uint32_t metric, const folly::Optional<GateLoad>& gateLoad) {
+  if (!gateLoad) {
+    return metric;
+  }
+  const uint64_t capacityKbps =
+      gateLoad->capacityKbps != 0 ? gateLoad->capacityKbps : kIdleGateSpareKbps;
+  const uint64_t spareKbps = capacityKbps *
+      (100 - std::min<uint8_t>(gateLoad->utilization, 100)) / 100;
+  if (spareKbps >= kIdleGateSpareKbps) {
+    return metric;
+  }
+  const uint64_t maxMetric{uint64_t{metric} * kMaxGateLoadPenalty};
+  const uint64_t adjusted = spareKbps == 0
+      ? maxMetric
+      : std::min(uint64_t{metric} * kIdleGateSpareKbps / spareKbps, maxMetric);
+  return static_cast<uint32_t>(
+      std::min<uint64_t>(adjusted, std::numeric_limits<uint32_t>::max()));
+}
+
+} // namespace fbmeshd
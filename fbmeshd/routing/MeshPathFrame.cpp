@@ -0,0 +1,224 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "fbmeshd/routing/MeshPathFrame.h"
+
+#include <exception>
+
+#include <glog/logging.h>
+
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBufQueue.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include <fbmeshd/if/gen-cpp2/fbmeshd_types.h>
+
+using namespace fbmeshd;
+
+namespace {
+
+const uint8_t kPannFlagIsGate{1 << 0};
+const uint8_t kPannFlagReplyRequested{1 << 1};
+const uint8_t kPannFlagHasGateLoad{1 << 2};
+
+// Room for the frame type byte and a thrift compact PANN
+const size_t kPannFrameThriftGrowth{64};
+
+std::unique_ptr<folly::IOBuf>
+encodePannFrameFixed(const PannFrame& pann) {
+  auto buf = folly::IOBuf::create(
+      1 + kPannFrameFixedSize + (pann.gateLoad ? kPannFrameGateLoadSize : 0));
+  folly::io::Appender appender{buf.get(), 0};
+  appender.write(static_cast<uint8_t>(MeshPathFrameType::PANN_FIXED));
+  appender.push(pann.origAddr.bytes(), 6);
+  appender.writeBE(pann.origSn);
+  appender.write(pann.hopCount);
+  appender.write(pann.ttl);
+  appender.push(pann.targetAddr.bytes(), 6);
+  appender.writeBE(pann.metric);
+  appender.write(static_cast<uint8_t>(
+      (pann.isGate ? kPannFlagIsGate : 0) |
+      (pann.replyRequested ? kPannFlagReplyRequested : 0) |
+      (pann.gateLoad ? kPannFlagHasGateLoad : 0)));
+  if (pann.gateLoad) {
+    appender.writeBE(pann.gateLoad->capacityKbps);
+    appender.write(pann.gateLoad->utilization);
+  }
+  return buf;
+}
+
+folly::Optional<PannFrame>
+decodePannFrameFixed(const folly::IOBuf& data) {
+  folly::io::Cursor cursor{&data};
+  if (!cursor.canAdvance(kPannFrameFixedSize)) {
+    return folly::none;
+  }
+
+  uint8_t addr[6];
+  PannFrame pann;
+  cursor.pull(addr, sizeof(addr));
+  pann.origAddr = folly::MacAddress::fromBinary({addr, sizeof(addr)});
+  pann.origSn = cursor.readBE<uint64_t>();
+  pann.hopCount = cursor.read<uint8_t>();
+  pann.ttl = cursor.read<uint8_t>();
+  cursor.pull(addr, sizeof(addr));
+  pann.targetAddr = folly::MacAddress::fromBinary({addr, sizeof(addr)});
+  pann.metric = cursor.readBE<uint32_t>();
+  const auto flags = cursor.read<uint8_t>();
+  pann.isGate = flags & kPannFlagIsGate;
+  pann.replyRequested = flags & kPannFlagReplyRequested;
+  if (flags & kPannFlagHasGateLoad) {
+    if (!cursor.canAdvance(kPannFrameGateLoadSize)) {
+      return folly::none;
+    }
+    GateLoad gateLoad;
+    gateLoad.capacityKbps = cursor.readBE<uint32_t>();
+    gateLoad.utilization = cursor.read<uint8_t>();
+    pann.gateLoad = gateLoad;
+  }
+  return pann;
+}
+
+std::unique_ptr<folly::IOBuf>
+encodePannFrameThrift(const PannFrame& pann) {
+  folly::IOBufQueue queue{folly::IOBufQueue::cacheChainLength()};
+  folly::io::QueueAppender appender{&queue, kPannFrameThriftGrowth};
+  appender.write(static_cast<uint8_t>(MeshPathFrameType::PANN));
+  thrift::MeshPathFramePANN thriftPann{
+      apache::thrift::FRAGILE,
+      pann.origAddr.u64NBO(),
+      pann.origSn,
+      pann.hopCount,
+      pann.ttl,
+      pann.targetAddr.u64NBO(),
+      pann.metric,
+      pann.isGate,
+      pann.replyRequested,
+      pann.gateLoad ? pann.gateLoad->capacityKbps : 0,
+      pann.gateLoad ? pann.gateLoad->utilization : uint8_t{0},
+  };
+  if (!pann.gateLoad) {
+#ifdef USE_THRIFT_FIELD_REF_API
+    thriftPann.gateCapacityKbps_ref().reset();
+    thriftPann.gateUtilization_ref().reset();
+#else
+    thriftPann.__isset.gateCapacityKbps = false;
+    thriftPann.__isset.gateUtilization = false;
+#endif
+  }
+  apache::thrift::CompactSerializer::serialize(thriftPann, &queue);
+  return queue.move();
+}
+
+folly::Optional<PannFrame>
+decodePannFrameThrift(const folly::IOBuf& data) {
+  thrift::MeshPathFramePANN thriftPann;
+  try {
+    apache::thrift::CompactSerializer::deserialize(&data, thriftPann);
+  } catch (const std::exception& ex) {
+    VLOG(8) << "failed to deserialize PANN: " << ex.what();
+    return folly::none;
+  }
+
+  PannFrame pann;
+#ifdef USE_THRIFT_FIELD_REF_API
+  pann.origAddr = folly::MacAddress::fromNBO(*thriftPann.origAddr_ref());
+  pann.origSn = *thriftPann.origSn_ref();
+  pann.hopCount = *thriftPann.hopCount_ref();
+  pann.ttl = *thriftPann.ttl_ref();
+  pann.targetAddr = folly::MacAddress::fromNBO(*thriftPann.targetAddr_ref());
+  pann.metric = *thriftPann.metric_ref();
+  pann.isGate = *thriftPann.isGate_ref();
+  pann.replyRequested = *thriftPann.replyRequested_ref();
+  if (thriftPann.gateCapacityKbps_ref().has_value() &&
+      thriftPann.gateUtilization_ref().has_value()) {
+    GateLoad gateLoad;
+    gateLoad.capacityKbps = *thriftPann.gateCapacityKbps_ref();
+    gateLoad.utilization = *thriftPann.gateUtilization_ref();
+    pann.gateLoad = gateLoad;
+  }
+#else
+  pann.origAddr = folly::MacAddress::fromNBO(thriftPann.origAddr);
+  pann.origSn = thriftPann.origSn;
+  pann.hopCount = thriftPann.hopCount;
+  pann.ttl = thriftPann.ttl;
+  pann.targetAddr = folly::MacAddress::fromNBO(thriftPann.targetAddr);
+  pann.metric = thriftPann.metric;
+  pann.isGate = thriftPann.isGate;
+  pann.replyRequested = thriftPann.replyRequested;
+  if (thriftPann.__isset.gateCapacityKbps &&
+      thriftPann.__isset.gateUtilization) {
+    GateLoad gateLoad;
+    gateLoad.capacityKbps = thriftPann.gateCapacityKbps;
+    gateLoad.utilization = thriftPann.gateUtilization;
+    pann.gateLoad = gateLoad;
+  }
+#endif
+  return pann;
+}
+
+} // namespace
+
+std::unique_ptr<folly::IOBuf>
+fbmeshd::encodePannFrame(const PannFrame& pann, MeshPathFrameType type) {
+  switch (type) {
+    case MeshPathFrameType::PANN_FIXED:
+      return encodePannFrameFixed(pann);
+    case MeshPathFrameType::PANN:
+    default:
+      return encodePannFrameThrift(pann);
+  }
+}
+
+folly::Optional<PannFrame>
+fbmeshd::decodePannFrame(MeshPathFrameType type, const folly::IOBuf& data) {
+  switch (type) {
+    case MeshPathFrameType::PANN_FIXED:
+      return decodePannFrameFixed(data);
+    case MeshPathFrameType::PANN:
+      return decodePannFrameThrift(data);
+    default:
+      return folly::none;
+  }
+}
+
+std::unique_ptr<folly::IOBuf>
+fbmeshd::encodeAggregateFrame(
+    const std::vector<std::unique_ptr<folly::IOBuf>>& frames) {
+  size_t size{1};
+  for (const auto& frame : frames) {
+    size += kAggregateFrameOverhead + frame->computeChainDataLength();
+  }
+
+  auto buf = folly::IOBuf::create(size);
+  folly::io::Appender appender{buf.get(), 0};
+  appender.write(static_cast<uint8_t>(MeshPathFrameType::AGGREGATE));
+  for (const auto& frame : frames) {
+    appender.writeBE(static_cast<uint16_t>(frame->computeChainDataLength()));
+    for (const auto& range : *frame) {
+      appender.push(range.data(), range.size());
+    }
+  }
+  return buf;
+}
+
+std::vector<std::unique_ptr<folly::IOBuf>>
+fbmeshd::decodeAggregateFrame(const folly::IOBuf& data) {
+  std::vector<std::unique_ptr<folly::IOBuf>> frames;
+  folly::io::Cursor cursor{&data};
+  while (cursor.canAdvance(kAggregateFrameOverhead)) {
+    const auto length = cursor.readBE<uint16_t>();
+    if (length == 0 || !cursor.canAdvance(length)) {
+      VLOG(8) << "discarding truncated frame in aggregate";
+      break;
+    }
+    std::unique_ptr<folly::IOBuf> frame;
+    cursor.clone(frame, length);
+    frames.push_back(std::move(frame));
+  }
+  return frames;
+}
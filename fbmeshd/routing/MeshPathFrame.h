@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <folly/MacAddress.h>
+#include <folly/Optional.h>
+#include <folly/io/IOBuf.h>
+
+#include <fbmeshd/routing/GateLoad.h>
+
+namespace fbmeshd {
+
+/*
+ * mesh path frame type, sent as the first byte of every routing frame
+ *
+ * PANN: thrift compact encoded thrift::MeshPathFramePANN
+ * PANN_FIXED: fixed layout PANN, see kPannFrameFixedSize. Optional fields may
+ *  be appended behind a flag bit that older versions ignore, as for the gate
+ *  load. Any other change to the layout must use a new frame type so that
+ *  nodes running older versions drop the frames instead of misparsing them.
+ * AGGREGATE: several frames sent in one datagram, each preceded by its length
+ *  as a 16 bit big endian integer. Aggregates are never nested.
+ */
+enum class MeshPathFrameType { PANN = 0, PANN_FIXED = 1, AGGREGATE = 2 };
+
+/**
+ * path announcement frame
+ *
+ * @origAddr: address of the node that originated the PANN
+ * @origSn: sequence number of the originator
+ * @hopCount: hops travelled so far
+ * @ttl: remaining hops
+ * @targetAddr: destination of the PANN, broadcast unless a reply
+ * @metric: cumulative metric to the originator
+ * @isGate: the originator is a mesh gate
+ * @replyRequested: the receiver should answer with a unicast PANN
+ * @gateLoad: WAN load of the originator, only sent by gates
+ */
+struct PannFrame {
+  folly::MacAddress origAddr;
+  uint64_t origSn{0};
+  uint8_t hopCount{0};
+  uint8_t ttl{0};
+  folly::MacAddress targetAddr;
+  uint32_t metric{0};
+  bool isGate{false};
+  bool replyRequested{false};
+  folly::Optional<GateLoad> gateLoad;
+};
+
+/*
+ * Size of a PANN_FIXED frame after the frame type byte. All fields are in
+ * network byte order:
+ *
+ *   origAddr(6) origSn(8) hopCount(1) ttl(1) targetAddr(6) metric(4) flags(1)
+ *
+ * flags bit 0 is isGate and bit 1 is replyRequested. If bit 2 is set, the
+ * gate load follows:
+ *
+ *   gateCapacityKbps(4) gateUtilization(1)
+ *
+ * Older versions ignore both the flag and the trailing bytes.
+ */
+constexpr size_t kPannFrameFixedSize{27};
+constexpr size_t kPannFrameGateLoadSize{5};
+
+// Encode pann, preceded by the frame type byte, using the format of type
+std::unique_ptr<folly::IOBuf> encodePannFrame(
+    const PannFrame& pann, MeshPathFrameType type);
+
+// Decode a PANN frame of the given type from data, which starts after the
+// frame type byte. Returns folly::none if the frame is truncated or malformed.
+folly::Optional<PannFrame> decodePannFrame(
+    MeshPathFrameType type, const folly::IOBuf& data);
+
+// Largest AGGREGATE frame we build, keeps the datagram within the IPv6
+// minimum MTU
+constexpr size_t kMaxAggregateFrameSize{1232};
+
+// Bytes an AGGREGATE frame spends on a frame besides the frame itself
+constexpr size_t kAggregateFrameOverhead{2};
+
+// Pack frames, each starting with its frame type byte, into one AGGREGATE
+// frame
+std::unique_ptr<folly::IOBuf> encodeAggregateFrame(
+    const std::vector<std::unique_ptr<folly::IOBuf>>& frames);
+
+// Unpack the frames of an AGGREGATE frame from data, which starts after the
+// frame type byte. Unpacking stops at the first truncated frame.
+std::vector<std::unique_ptr<folly::IOBuf>> decodeAggregateFrame(
+    const folly::IOBuf& data);
+
+} // namespace fbmeshd
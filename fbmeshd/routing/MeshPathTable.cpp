@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "fbmeshd/routing/MeshPathTable.h"
+
+#include <algorithm>
+
+#include <folly/Bits.h>
+#include <folly/hash/Hash.h>
+
+using namespace fbmeshd;
+
+namespace {
+
+const size_t kMinCapacity{16};
+
+} // namespace
+
+constexpr size_t MeshPathTable::kNoSlot;
+constexpr uint64_t MeshPathTable::kEmptyKey;
+constexpr uint64_t MeshPathTable::kErasedKey;
+
+MeshPathTable::MeshPathTable() {
+  rehash(kMinCapacity);
+}
+
+size_t
+MeshPathTable::probeStart(uint64_t key) const {
+  return folly::hash::twang_mix64(key) & (keys_.size() - 1);
+}
+
+size_t
+MeshPathTable::find(folly::MacAddress dst) const {
+  const uint64_t key{dst.u64HBO()};
+  const size_t mask{keys_.size() - 1};
+  for (size_t slot = probeStart(key);; slot = (slot + 1) & mask) {
+    if (keys_[slot] == key) {
+      return slot;
+    }
+    if (keys_[slot] == kEmptyKey) {
+      return kNoSlot;
+    }
+  }
+}
+
+std::pair<size_t, bool>
+MeshPathTable::findOrInsert(
+    folly::MacAddress dst, std::chrono::steady_clock::time_point now) {
+  const auto slot = find(dst);
+  if (slot != kNoSlot) {
+    return std::make_pair(slot, false);
+  }
+
+  // Keep at most half of the slots in use, counting erased ones, so that
+  // probe sequences stay short and always end at an empty slot
+  if ((size_ + erased_ + 1) * 2 > keys_.size()) {
+    rehash(std::max<size_t>(
+        kMinCapacity, folly::nextPowTwo(size_t{(size_ + 1) * 4})));
+  }
+
+  const uint64_t key{dst.u64HBO()};
+  const size_t mask{keys_.size() - 1};
+  size_t newSlot = probeStart(key);
+  while (isOccupied(newSlot)) {
+    newSlot = (newSlot + 1) & mask;
+  }
+  if (keys_[newSlot] == kErasedKey) {
+    erased_--;
+  }
+  keys_[newSlot] = key;
+  metrics_[newSlot] = 0;
+  sns_[newSlot] = 0;
+  expTimes_[newSlot] = now;
+  nextHops_[newSlot] = 0;
+  cold_[newSlot] = ColdFields{};
+  size_++;
+  return std::make_pair(newSlot, true);
+}
+
+void
+MeshPathTable::erase(size_t slot) {
+  if (!isOccupied(slot)) {
+    return;
+  }
+  keys_[slot] = kErasedKey;
+  size_--;
+  erased_++;
+}
+
+MeshPath
+MeshPathTable::get(size_t slot) const {
+  MeshPath mpath{dst(slot)};
+  mpath.nextHop = nextHop(slot);
+  mpath.sn = sns_[slot];
+  mpath.metric = metrics_[slot];
+  mpath.nextHopMetric = cold_[slot].nextHopMetric;
+  mpath.hopCount = cold_[slot].hopCount;
+  mpath.expTime = expTimes_[slot];
+  mpath.isRoot = cold_[slot].isRoot;
+  mpath.isGate = cold_[slot].isGate;
+  mpath.gateLoad = cold_[slot].gateLoad;
+  return mpath;
+}
+
+void
+MeshPathTable::rehash(size_t capacity) {
+  std::vector<uint64_t> keys(capacity, kEmptyKey);
+  std::vector<uint32_t> metrics(capacity);
+  std::vector<uint64_t> sns(capacity);
+  std::vector<std::chrono::steady_clock::time_point> expTimes(capacity);
+  std::vector<uint64_t> nextHops(capacity);
+  std::vector<ColdFields> cold(capacity);
+
+  const size_t mask{capacity - 1};
+  for (size_t slot = 0; slot < keys_.size(); slot++) {
+    if (!isOccupied(slot)) {
+      continue;
+    }
+    size_t newSlot = folly::hash::twang_mix64(keys_[slot]) & mask;
+    while (keys[newSlot] != kEmptyKey) {
+      newSlot = (newSlot + 1) & mask;
+    }
+    keys[newSlot] = keys_[slot];
+    metrics[newSlot] = metrics_[slot];
+    sns[newSlot] = sns_[slot];
+    expTimes[newSlot] = expTimes_[slot];
+    nextHops[newSlot] = nextHops_[slot];
+    cold[newSlot] = cold_[slot];
+  }
+
+  keys_.swap(keys);
+  metrics_.swap(metrics);
+  sns_.swap(sns);
+  expTimes_.swap(expTimes);
+  nextHops_.swap(nextHops);
+  cold_.swap(cold);
+  erased_ = 0;
+}
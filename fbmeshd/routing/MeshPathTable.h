@@ -0,0 +1,221 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <folly/MacAddress.h>
+#include <folly/Optional.h>
+
+#include <fbmeshd/routing/GateLoad.h>
+
+namespace fbmeshd {
+
+/**
+ * mesh path structure
+ *
+ * @dst: mesh path destination mac address
+ * @nextHop: mesh neighbor to which frames for this destination will be
+ *  forwarded
+ * @sn: target sequence number
+ * @metric: current metric to this destination
+ * @nextHopMetric: metric for the next hop link
+ * @hopCount: hops to destination
+ * @expTime: when the path will expire or when it expired
+ * @isRoot: the destination station of this path is a root node
+ * @isGate: the destination station of this path is a mesh gate
+ * @gateLoad: WAN load advertised by the gate, if it advertises one
+ *
+ *
+ * The dst address is unique in the mesh path table.
+ */
+struct MeshPath {
+  explicit MeshPath(folly::MacAddress _dst) : dst{_dst} {}
+
+  bool
+  expired() const {
+    return expired(std::chrono::steady_clock::now());
+  }
+
+  bool
+  expired(std::chrono::steady_clock::time_point now) const {
+    return now >= expTime;
+  }
+
+  folly::MacAddress dst;
+  folly::MacAddress nextHop{};
+  uint64_t sn{0};
+  uint32_t metric{0};
+  uint32_t nextHopMetric{0};
+  uint8_t hopCount{0};
+  std::chrono::steady_clock::time_point expTime{
+      std::chrono::steady_clock::now()};
+  bool isRoot{false};
+  bool isGate{false};
+  folly::Optional<GateLoad> gateLoad;
+};
+
+/**
+ * Mesh path table keyed on the 48-bit destination address held in a uint64_t.
+ *
+ * Open addressing with linear probing over power-of-two sized arrays. The
+ * fields read for every PANN and every route sync (metric, sn, expTime,
+ * nextHop) are stored in separate arrays so that scans touch as few cache
+ * lines as possible; the rest of a path lives in a colder array.
+ *
+ * Paths are addressed by slot. A slot stays valid until the next
+ * findOrInsert() that inserts, which may move every path.
+ */
+class MeshPathTable {
+ public:
+  static constexpr size_t kNoSlot{std::numeric_limits<size_t>::max()};
+
+  // The backup route is the best PANN for the path's current sn that arrived
+  // through another neighbor; it takes over if nextHop goes away
+  struct ColdFields {
+    uint32_t nextHopMetric{0};
+    uint8_t hopCount{0};
+    bool isRoot{false};
+    bool isGate{false};
+    folly::Optional<GateLoad> gateLoad;
+    folly::MacAddress backupNextHop{};
+    uint32_t backupMetric{0};
+    uint32_t backupNextHopMetric{0};
+    uint8_t backupHopCount{0};
+    std::chrono::steady_clock::time_point backupExpTime{};
+  };
+
+  MeshPathTable();
+  ~MeshPathTable() = default;
+  MeshPathTable(const MeshPathTable&) = delete;
+  MeshPathTable(MeshPathTable&&) = delete;
+  MeshPathTable& operator=(const MeshPathTable&) = delete;
+  MeshPathTable& operator=(MeshPathTable&&) = delete;
+
+  // Returns the slot holding dst, or kNoSlot
+  size_t find(folly::MacAddress dst) const;
+
+  // Returns the slot holding dst and whether the path was just inserted, in
+  // which case it is default-initialized with its expTime set to now
+  std::pair<size_t, bool> findOrInsert(
+      folly::MacAddress dst, std::chrono::steady_clock::time_point now);
+
+  void erase(size_t slot);
+
+  size_t
+  size() const {
+    return size_;
+  }
+
+  folly::MacAddress
+  dst(size_t slot) const {
+    return folly::MacAddress::fromHBO(keys_[slot]);
+  }
+
+  folly::MacAddress
+  nextHop(size_t slot) const {
+    return folly::MacAddress::fromHBO(nextHops_[slot]);
+  }
+
+  void
+  setNextHop(size_t slot, folly::MacAddress nextHop) {
+    nextHops_[slot] = nextHop.u64HBO();
+  }
+
+  uint32_t&
+  metric(size_t slot) {
+    return metrics_[slot];
+  }
+
+  uint64_t&
+  sn(size_t slot) {
+    return sns_[slot];
+  }
+
+  std::chrono::steady_clock::time_point&
+  expTime(size_t slot) {
+    return expTimes_[slot];
+  }
+
+  std::chrono::steady_clock::time_point
+  expTime(size_t slot) const {
+    return expTimes_[slot];
+  }
+
+  bool
+  expired(size_t slot, std::chrono::steady_clock::time_point now) const {
+    return now >= expTimes_[slot];
+  }
+
+  ColdFields&
+  cold(size_t slot) {
+    return cold_[slot];
+  }
+
+  const ColdFields&
+  cold(size_t slot) const {
+    return cold_[slot];
+  }
+
+  // Materialize the path stored in slot
+  MeshPath get(size_t slot) const;
+
+  // Calls f(slot) for every path in the table
+  template <typename F>
+  void
+  forEach(F&& f) const {
+    for (size_t slot = 0; slot < keys_.size(); slot++) {
+      if (isOccupied(slot)) {
+        f(slot);
+      }
+    }
+  }
+
+  // Returns a copy of every path for which pred(slot) returns true
+  template <typename Pred>
+  std::vector<MeshPath>
+  snapshot(Pred&& pred) const {
+    std::vector<MeshPath> paths;
+    paths.reserve(size_);
+    forEach([this, &pred, &paths](size_t slot) {
+      if (pred(slot)) {
+        paths.push_back(get(slot));
+      }
+    });
+    return paths;
+  }
+
+ private:
+  // Keys are 48-bit addresses, so these can never collide with a real key
+  static constexpr uint64_t kEmptyKey{std::numeric_limits<uint64_t>::max()};
+  static constexpr uint64_t kErasedKey{kEmptyKey - 1};
+
+  bool
+  isOccupied(size_t slot) const {
+    return keys_[slot] != kEmptyKey && keys_[slot] != kErasedKey;
+  }
+
+  size_t probeStart(uint64_t key) const;
+
+  void rehash(size_t capacity);
+
+  std::vector<uint64_t> keys_;
+  std::vector<uint32_t> metrics_;
+  std::vector<uint64_t> sns_;
+  std::vector<std::chrono::steady_clock::time_point> expTimes_;
+  std::vector<uint64_t> nextHops_;
+  std::vector<ColdFields> cold_;
+
+  size_t size_{0};
+  size_t erased_{0};
+};
+
+} // namespace fbmeshd
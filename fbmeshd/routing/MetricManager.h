@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <memory>
 #include <unordered_map>
 
 #include <folly/MacAddress.h>
@@ -15,12 +16,33 @@ namespace fbmeshd {
 
 class MetricManager {
  public:
+  /**
+   * link metric table
+   *
+   * @generation: incremented whenever the table changes
+   * @metrics: metric of the link to every peer we have a metric for
+   */
+  struct LinkMetrics {
+    uint64_t generation{0};
+    std::unordered_map<folly::MacAddress, uint32_t> metrics;
+  };
+
   virtual ~MetricManager(){};
 
   virtual std::unordered_map<folly::MacAddress, uint32_t>
   getLinkMetrics() {
     return {};
   };
+
+  // Returns the current link metric table. This is called for every routing
+  // packet, so implementations must not do any I/O here. Safe to call from
+  // any thread.
+  virtual std::shared_ptr<const LinkMetrics>
+  getLinkMetricTable() {
+    auto linkMetrics = std::make_shared<LinkMetrics>();
+    linkMetrics->metrics = getLinkMetrics();
+    return linkMetrics;
+  }
 };
 
 } // namespace fbmeshd
@@ -8,6 +8,9 @@
 #include "fbmeshd/routing/MetricManager80211s.h"
 
 #include <cstddef>
+#include <exception>
+
+#include <folly/futures/Future.h>
 
 using namespace fbmeshd;
 
@@ -24,14 +27,51 @@ MetricManager80211s::MetricManager80211s(
       ewmaFactor_{ewmaFactor},
       hysteresisFactor_{hysteresisFactor},
       baseBitrate_{baseBitrate},
-      rssiWeight_{rssiWeight} {
+      rssiWeight_{rssiWeight},
+      linkMetrics_{std::make_shared<const LinkMetrics>()} {
   // Set timer to update metrics
   metricManagerTimer_ =
       folly::AsyncTimeout::make(*evb_, [this, interval]() noexcept {
-        updateMetrics();
+        dumpStations([this](const auto& stas) { updateMetrics(stas); });
         metricManagerTimer_->scheduleTimeout(interval);
       });
   metricManagerTimer_->scheduleTimeout(interval);
+
+  stationEventTimer_ = folly::AsyncTimeout::make(*evb_, [this]() noexcept {
+    dumpStations([this](const auto& stas) { updateLinkMetricTable(stas); });
+  });
+  // Peers come and go between updates, pick them up right away
+  nlHandler_.addStationEventCallback([this](StationEvent, folly::MacAddress) {
+    evb_->runInEventBaseThread([this]() {
+      if (!stationEventTimer_->isScheduled()) {
+        stationEventTimer_->scheduleTimeout(0);
+      }
+    });
+  });
+  evb_->runInEventBaseThread([this]() {
+    dumpStations([this](const auto& stas) { updateLinkMetricTable(stas); });
+  });
+}
+
+void
+MetricManager80211s::dumpStations(
+    std::function<void(const std::vector<StationInfo>&)> cb) {
+  folly::SemiFuture<std::vector<StationInfo>> stas{std::vector<StationInfo>{}};
+  try {
+    stas = nlHandler_.getStationsInfoAsync();
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "MetricManager80211s: station dump failed: " << e.what();
+    return;
+  }
+  std::move(stas).via(evb_).thenTry(
+      [cb = std::move(cb)](folly::Try<std::vector<StationInfo>> stas) {
+        if (stas.hasException()) {
+          LOG(ERROR) << "MetricManager80211s: station dump failed: "
+                     << stas.exception().what();
+          return;
+        }
+        cb(*stas);
+      });
 }
 
 uint32_t
@@ -89,9 +129,8 @@ MetricManager80211s::rssiToAirtime(int32_t rssi) {
 }
 
 void
-MetricManager80211s::updateMetrics() {
+MetricManager80211s::updateMetrics(const std::vector<StationInfo>& stas) {
   VLOG(8) << "MetricManager80211s: updating metrics...";
-  const auto stas = nlHandler_.getStationsInfo();
   for (const auto& it : stas) {
     auto mac = it.macAddress;
     uint32_t newMetricBitrate{bitrateToAirtime(it.expectedThroughput)};
@@ -144,6 +183,32 @@ MetricManager80211s::updateMetrics() {
     VLOG(8) << "MetricManager80211s: " << mac << " adding metric " << newMetric
              << " new metric " << (metrics_[mac].ewmaMetric >> ewmaFactor_);
   }
+
+  updateLinkMetricTable(stas);
+}
+
+void
+MetricManager80211s::updateLinkMetricTable(
+    const std::vector<StationInfo>& stas) {
+  std::unordered_map<folly::MacAddress, uint32_t> metrics;
+  for (const auto& sta : stas) {
+    if (sta.expectedThroughput == 0) {
+      continue;
+    }
+    metrics.emplace(sta.macAddress, getLinkMetric(sta));
+  }
+
+  const auto current = linkMetrics_.load();
+  if (metrics == current->metrics) {
+    return;
+  }
+  auto linkMetrics = std::make_shared<LinkMetrics>();
+  linkMetrics->generation = current->generation + 1;
+  linkMetrics->metrics = std::move(metrics);
+  VLOG(8) << "MetricManager80211s: link metrics generation "
+          << linkMetrics->generation << " with "
+          << linkMetrics->metrics.size() << " peers";
+  linkMetrics_.store(std::move(linkMetrics));
 }
 
 uint32_t
@@ -174,12 +239,10 @@ MetricManager80211s::getLinkMetric(const StationInfo& sta) {
 
 std::unordered_map<folly::MacAddress, uint32_t>
 MetricManager80211s::getLinkMetrics() {
-  std::unordered_map<folly::MacAddress, uint32_t> metrics;
-  for (const auto& sta : nlHandler_.getStationsInfo()) {
-    if (sta.expectedThroughput == 0) {
-      continue;
-    }
-    metrics.emplace(sta.macAddress, getLinkMetric(sta));
-  }
-  return metrics;
+  return linkMetrics_.load()->metrics;
+}
+
+std::shared_ptr<const MetricManager::LinkMetrics>
+MetricManager80211s::getLinkMetricTable() {
+  return linkMetrics_.load();
 }
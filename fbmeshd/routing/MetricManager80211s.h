@@ -8,7 +8,10 @@
 #pragma once
 
 #include <chrono>
+#include <functional>
+#include <vector>
 
+#include <folly/concurrency/AtomicSharedPtr.h>
 #include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/EventBase.h>
 
@@ -47,8 +50,18 @@ class MetricManager80211s : public MetricManager {
   virtual std::unordered_map<folly::MacAddress, uint32_t> getLinkMetrics()
       override;
 
+  virtual std::shared_ptr<const LinkMetrics> getLinkMetricTable() override;
+
  private:
-  void updateMetrics();
+  // Dump stations without blocking the event base and pass them to cb on it
+  void dumpStations(std::function<void(const std::vector<StationInfo>&)> cb);
+
+  void updateMetrics(const std::vector<StationInfo>& stas);
+
+  // Rebuild the link metric table from a station dump, publishing it with a
+  // new generation if it changed
+  void updateLinkMetricTable(const std::vector<StationInfo>& stas);
+
   uint32_t bitrateToAirtime(uint32_t rate);
   uint32_t rssiToAirtime(int32_t rssi);
 
@@ -60,6 +73,11 @@ class MetricManager80211s : public MetricManager {
   uint32_t baseBitrate_;
   double rssiWeight_;
   std::unique_ptr<folly::AsyncTimeout> metricManagerTimer_;
+
+  // Coalesces station events into a single station dump
+  std::unique_ptr<folly::AsyncTimeout> stationEventTimer_;
+
+  folly::atomic_shared_ptr<const LinkMetrics> linkMetrics_;
 };
 
 } // namespace fbmeshd
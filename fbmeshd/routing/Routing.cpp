@@ -7,11 +7,14 @@
 
 #include "Routing.h"
 
+#include <algorithm>
 #include <chrono>
 #include <exception>
+#include <functional>
 
 #include <glog/logging.h>
 
+#include <folly/Chrono.h>
 #include <folly/MacAddress.h>
 #include <folly/io/async/AsyncUDPSocket.h>
 #include <folly/system/ThreadName.h>
@@ -24,20 +27,32 @@ using namespace fbmeshd;
 namespace {
 const uint32_t kMaxMetric{0xffffffff};
 
-const auto kMeshHousekeepingInterval{60s};
 const auto kMeshPathExpire{60s};
 const auto kMinGatewayRedundancy{2};
 
-void meshPathExpire(
-    std::unordered_map<folly::MacAddress, Routing::MeshPath>& paths) {
-  for (auto it = paths.begin(); it != paths.end();) {
-    const auto& mpath = it->second;
-    if (std::chrono::steady_clock::now() > mpath.expTime + kMeshPathExpire) {
-      it = paths.erase(it);
-    } else {
-      ++it;
-    }
-  }
+// Bound on journal entries kept for a consumer that stopped draining them
+const size_t kMaxMeshPathChanges{4096};
+
+// Rebuild the expiry index once it holds this many entries per mesh path
+const size_t kMeshPathExpiryQueueSlack{4};
+
+// Minimum time between two snapshot publications. Each one copies the whole
+// mesh path table, which must not happen for every PANN.
+const auto kMinSnapshotInterval{100ms};
+
+// Metric added to our PANNs per point of WAN quality lost, so that a gate
+// with a useless uplink looks a few typical hops further away
+const uint32_t kWanQualityMetricScale{10};
+
+// Whether a path is routed: it is live and goes through a peer we have a
+// metric for. Applied to full dumps and to journal entries alike, so that
+// incremental syncs program the same routes a full sync would.
+bool isRoutableMeshPath(
+    bool expired,
+    folly::MacAddress nextHop,
+    const MetricManager::LinkMetrics& linkMetrics) {
+  return !expired && nextHop != folly::MacAddress::ZERO &&
+      linkMetrics.metrics.count(nextHop) != 0;
 }
 
 } // namespace
@@ -48,10 +63,16 @@ Routing::Routing(
     folly::MacAddress nodeAddr,
     uint32_t elementTtl,
     std::chrono::milliseconds activePathTimeout,
-    std::chrono::milliseconds rootPannInterval)
+    std::chrono::milliseconds rootPannInterval,
+    MeshPathFrameType pannFrameType,
+    std::chrono::milliseconds txAggregationWindow,
+    StatsClient& statsClient)
     : evb_{evb},
       nodeAddr_{nodeAddr},
       elementTtl_{elementTtl},
+      pannFrameType_{pannFrameType},
+      txAggregationWindow_{txAggregationWindow},
+      statsClient_{statsClient},
       metricManager_{metricManager},
       noLongerAGateRANNTimer_{
           folly::AsyncTimeout::
@@ -62,8 +83,15 @@ Routing::Routing(
       meshPathRootTimer_{
           folly::AsyncTimeout::
               make(*evb_, [this]() noexcept { doMeshPathRoot(); })},
+      txFlushTimer_{
+          folly::AsyncTimeout::
+              make(*evb_, [this]() noexcept { flushTxQueue(); })},
       activePathTimeout_{activePathTimeout},
-      rootPannInterval_{rootPannInterval} {
+      rootPannInterval_{rootPannInterval},
+      snapshot_{std::make_shared<const Snapshot>()},
+      publishSnapshotTimer_{
+          folly::AsyncTimeout::
+              make(*evb_, [this]() noexcept { publishSnapshot(); })} {
   evb_->runInEventBaseThread([this]() { prepare(); });
 }
 
@@ -72,32 +100,223 @@ void Routing::prepare() {
   doMeshHousekeeping();
 }
 
-std::unordered_map<folly::MacAddress, Routing::MeshPath>
-Routing::getMeshPaths() {
-  std::unordered_map<folly::MacAddress, MeshPath> meshPaths;
-  evb_->runImmediatelyOrRunInEventBaseThreadAndWait([this, &meshPaths]() {
-    // Only return meshPaths that we are peer-ed with and have a metric for
-    const auto stas = metricManager_->getLinkMetrics();
-    for (const auto& m : meshPaths_) {
-      if (!m.second.expired() && stas.find(m.second.nextHop) != stas.end()) {
-        meshPaths.emplace(m.first, m.second);
-      }
+std::shared_ptr<const Routing::Snapshot> Routing::getSnapshot() const {
+  return snapshot_.load();
+}
+
+std::vector<Routing::MeshPath> Routing::getLiveMeshPaths(
+    bool gatesOnly) const {
+  const auto snapshot = getSnapshot();
+  // Only return meshPaths that we are peer-ed with and have a metric for
+  const auto linkMetrics = metricManager_->getLinkMetricTable();
+  const auto now = std::chrono::steady_clock::now();
+  std::vector<MeshPath> meshPaths;
+  for (const auto& mpath : snapshot->meshPaths) {
+    if ((!gatesOnly || mpath.isGate) &&
+        isRoutableMeshPath(mpath.expired(now), mpath.nextHop, *linkMetrics)) {
+      meshPaths.push_back(mpath);
     }
-  });
+  }
   return meshPaths;
 }
 
+std::vector<Routing::MeshPath> Routing::getMeshPaths() {
+  return getLiveMeshPaths(false);
+}
+
+std::vector<Routing::MeshPath> Routing::getGatePaths() {
+  return getLiveMeshPaths(true);
+}
+
+Routing::MeshPathChanges Routing::getMeshPathChanges() {
+  MeshPathChanges changes;
+  evb_->runImmediatelyOrRunInEventBaseThreadAndWait([this, &changes]() {
+    publishSnapshot();
+    std::swap(changes, meshPathChanges_);
+    changes.isGate = isGate_;
+    filterMeshPathChanges(changes);
+  });
+  return changes;
+}
+
+void Routing::journalLinkMetricPeerChanges(
+    const MetricManager::LinkMetrics& linkMetrics, MeshPathChanges& changes) {
+  if (linkMetrics.generation != 0 &&
+      linkMetrics.generation == linkMetricsGeneration_) {
+    return;
+  }
+  linkMetricsGeneration_ = linkMetrics.generation;
+
+  // Peers that gained or lost their link metric since the last drain
+  std::unordered_set<folly::MacAddress> changedPeers;
+  for (const auto& peer : linkMetricPeers_) {
+    if (linkMetrics.metrics.count(peer) == 0) {
+      changedPeers.insert(peer);
+    }
+  }
+  for (const auto& it : linkMetrics.metrics) {
+    if (linkMetricPeers_.count(it.first) == 0) {
+      changedPeers.insert(it.first);
+      linkMetricPeers_.insert(it.first);
+    }
+  }
+  if (changedPeers.empty()) {
+    return;
+  }
+  for (const auto& peer : changedPeers) {
+    if (linkMetrics.metrics.count(peer) == 0) {
+      linkMetricPeers_.erase(peer);
+    }
+  }
+  if (changes.fullSyncRequired) {
+    return;
+  }
+
+  // The paths through them are journaled as added, and turned into removals
+  // below if they are no longer routed
+  std::unordered_set<folly::MacAddress> journaled;
+  for (const auto& change : changes.changes) {
+    journaled.insert(change.dst);
+  }
+  meshPaths_.forEach([this, &changedPeers, &journaled, &changes](size_t slot) {
+    const auto dst = meshPaths_.dst(slot);
+    if (changedPeers.count(meshPaths_.nextHop(slot)) != 0 &&
+        journaled.count(dst) == 0) {
+      changes.changes.push_back(MeshPathChange{
+          MeshPathChange::Type::ADDED, dst, meshPaths_.nextHop(slot)});
+    }
+  });
+}
+
+void Routing::filterMeshPathChanges(MeshPathChanges& changes) {
+  const auto linkMetrics = metricManager_->getLinkMetricTable();
+  const auto now = getNow();
+  journalLinkMetricPeerChanges(*linkMetrics, changes);
+  for (auto& change : changes.changes) {
+    if (change.type == MeshPathChange::Type::REMOVED) {
+      continue;
+    }
+    const auto slot = meshPaths_.find(change.dst);
+    if (slot == MeshPathTable::kNoSlot ||
+        !isRoutableMeshPath(
+            meshPaths_.expired(slot, now),
+            meshPaths_.nextHop(slot),
+            *linkMetrics)) {
+      change.type = MeshPathChange::Type::REMOVED;
+      change.nextHop = folly::MacAddress::ZERO;
+    }
+  }
+}
+
 /*
  * Misc utility functions
  */
 
-Routing::MeshPath& Routing::getMeshPath(folly::MacAddress addr) {
-  return meshPaths_
-      .emplace(
-          std::piecewise_construct,
-          std::forward_as_tuple(addr),
-          std::forward_as_tuple(addr))
-      .first->second;
+size_t Routing::getMeshPath(folly::MacAddress addr) {
+  const auto mpath = meshPaths_.findOrInsert(addr, getNow());
+  if (mpath.second) {
+    // New paths start out expired and are dropped unless they get refreshed
+    scheduleMeshPathExpiry(meshPaths_.expTime(mpath.first), addr);
+    markSnapshotDirty();
+  }
+  return mpath.first;
+}
+
+std::chrono::steady_clock::time_point Routing::getNow() {
+  if (!evb_->isRunning() || !evb_->isInEventBaseThread()) {
+    return std::chrono::steady_clock::now();
+  }
+  if (!cachedNow_) {
+    cachedNow_ = std::chrono::steady_clock::now();
+    evb_->runInLoop(&clearCachedNowCallback_, true);
+  }
+  return *cachedNow_;
+}
+
+void Routing::scheduleMeshPathExpiry(
+    std::chrono::steady_clock::time_point deadline, folly::MacAddress dst) {
+  if (meshPathExpiryQueue_.size() >=
+      kMeshPathExpiryQueueSlack * (meshPaths_.size() + 1)) {
+    // Too many stale entries, rebuild the index from the live paths
+    decltype(meshPathExpiryQueue_) expiryQueue;
+    meshPaths_.forEach([this, &expiryQueue](size_t slot) {
+      expiryQueue.emplace(meshPaths_.expTime(slot), meshPaths_.dst(slot));
+    });
+    std::swap(meshPathExpiryQueue_, expiryQueue);
+  }
+
+  const bool isEarliest = meshPathExpiryQueue_.empty() ||
+      deadline < meshPathExpiryQueue_.top().first;
+  meshPathExpiryQueue_.emplace(deadline, dst);
+  if (isEarliest) {
+    scheduleHousekeeping();
+  }
+}
+
+void Routing::scheduleHousekeeping() {
+  if (meshPathExpiryQueue_.empty()) {
+    housekeepingTimer_->cancelTimeout();
+    return;
+  }
+  const auto delay = folly::chrono::ceil<std::chrono::milliseconds>(
+      meshPathExpiryQueue_.top().first - getNow());
+  housekeepingTimer_->scheduleTimeout(std::max(delay, 0ms));
+}
+
+void Routing::recordMeshPathChange(
+    MeshPathChange::Type type,
+    folly::MacAddress dst,
+    folly::MacAddress nextHop) {
+  if (meshPathChanges_.fullSyncRequired) {
+    return;
+  }
+  if (meshPathChanges_.changes.size() >= kMaxMeshPathChanges) {
+    VLOG(8) << "mesh path change journal overflowed, requesting full sync";
+    meshPathChanges_.changes.clear();
+    meshPathChanges_.fullSyncRequired = true;
+    return;
+  }
+  meshPathChanges_.changes.push_back(MeshPathChange{
+      type,
+      dst,
+      type == MeshPathChange::Type::REMOVED ? folly::MacAddress::ZERO
+                                            : nextHop});
+}
+
+void Routing::notifyMeshPathChange() {
+  if (meshPathChangeCallback_) {
+    (*meshPathChangeCallback_)();
+  }
+}
+
+void Routing::markSnapshotDirty() {
+  snapshotDirty_ = true;
+  if (publishSnapshotCallback_.isLoopCallbackScheduled() ||
+      publishSnapshotTimer_->isScheduled()) {
+    return;
+  }
+  const auto delay = folly::chrono::ceil<std::chrono::milliseconds>(
+      lastSnapshotTime_ + kMinSnapshotInterval - getNow());
+  if (delay > 0ms) {
+    // Published too recently, batch this change with those that follow
+    publishSnapshotTimer_->scheduleTimeout(delay);
+  } else {
+    evb_->runInLoop(&publishSnapshotCallback_, true);
+  }
+}
+
+void Routing::publishSnapshot() {
+  if (!snapshotDirty_) {
+    return;
+  }
+  snapshotDirty_ = false;
+  lastSnapshotTime_ = getNow();
+
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->version = snapshot_.load()->version + 1;
+  snapshot->isGate = isGate_;
+  snapshot->meshPaths = meshPaths_.snapshot([](size_t) { return true; });
+  snapshot_.store(std::move(snapshot));
 }
 
 /*
@@ -106,8 +325,46 @@ Routing::MeshPath& Routing::getMeshPath(folly::MacAddress addr) {
 
 void Routing::doMeshHousekeeping() {
   VLOG(8) << folly::sformat("Routing::{}()", __func__);
-  meshPathExpire(meshPaths_);
-  housekeepingTimer_->scheduleTimeout(kMeshHousekeepingInterval);
+  const auto now = getNow();
+  bool withdrawn{false};
+  while (!meshPathExpiryQueue_.empty() &&
+         meshPathExpiryQueue_.top().first <= now) {
+    const auto expiry = meshPathExpiryQueue_.top();
+    meshPathExpiryQueue_.pop();
+
+    const auto dst = expiry.second;
+    const auto slot = meshPaths_.find(dst);
+    if (slot == MeshPathTable::kNoSlot) {
+      continue;
+    }
+    const auto expTime = meshPaths_.expTime(slot);
+    if (now >= expTime + kMeshPathExpire) {
+      // The path may not have been withdrawn yet, if housekeeping ran late;
+      // withdrawing it twice is harmless
+      if (meshPaths_.nextHop(slot) != folly::MacAddress::ZERO) {
+        recordMeshPathChange(
+            MeshPathChange::Type::REMOVED, dst, folly::MacAddress::ZERO);
+        withdrawn = true;
+      }
+      gateIndex_.erase(dst);
+      meshPaths_.erase(slot);
+      markSnapshotDirty();
+    } else if (expiry.first == expTime) {
+      gateIndex_.erase(dst);
+      // Withdraw the path as soon as it expires, but keep it around for a
+      // while so that its sn and metric still apply to late PANNs
+      if (meshPaths_.nextHop(slot) != folly::MacAddress::ZERO) {
+        recordMeshPathChange(
+            MeshPathChange::Type::REMOVED, dst, folly::MacAddress::ZERO);
+        withdrawn = true;
+      }
+      meshPathExpiryQueue_.emplace(expTime + kMeshPathExpire, dst);
+    }
+  }
+  if (withdrawn) {
+    notifyMeshPathChange();
+  }
+  scheduleHousekeeping();
 }
 
 void Routing::doMeshPathRoot() {
@@ -120,8 +377,9 @@ void Routing::doMeshPathRoot() {
         0,
         elementTtl_,
         folly::MacAddress::BROADCAST,
-        0,
+        getOriginMetric(),
         isGate_,
+        isGate_ ? gateLoad_ : folly::none,
         true);
 
     meshPathRootTimer_->scheduleTimeout(rootPannInterval_);
@@ -141,32 +399,78 @@ void Routing::txPannFrame(
     folly::MacAddress targetAddr,
     uint32_t metric,
     bool isGate,
+    const folly::Optional<GateLoad>& gateLoad,
     bool replyRequested) {
   VLOG(8) << folly::sformat("Routing::{}()", __func__);
 
-  std::string skb;
   VLOG(8) << "sending PANN orig:" << origAddr << " target:" << targetAddr
           << " dst:" << da.toString();
-  serializer_.serialize(
-      thrift::MeshPathFramePANN{
-          apache::thrift::FRAGILE,
-          origAddr.u64NBO(),
-          origSn,
-          hopCount,
-          ttl,
-          targetAddr.u64NBO(),
-          metric,
-          isGate,
-          replyRequested,
-      },
-      &skb);
+  PannFrame pann;
+  pann.origAddr = origAddr;
+  pann.origSn = origSn;
+  pann.hopCount = hopCount;
+  pann.ttl = ttl;
+  pann.targetAddr = targetAddr;
+  pann.metric = metric;
+  pann.isGate = isGate;
+  pann.replyRequested = replyRequested;
+  pann.gateLoad = gateLoad;
+  sendFrame(da, encodePannFrame(pann, pannFrameType_));
+}
 
-  auto buf = folly::IOBuf::copyBuffer(skb, 1, 0);
-  buf->prepend(1);
-  *buf->writableData() = static_cast<uint8_t>(MeshPathFrameType::PANN);
+void Routing::sendFrame(
+    folly::MacAddress da,
+    std::unique_ptr<folly::IOBuf> frame) {
+  if (!sendPacketCallback_) {
+    return;
+  }
+  if (txAggregationWindow_ == 0ms) {
+    statsClient_.setAvgStat("fbmeshd.routing.tx_frames_per_datagram", 1);
+    (*sendPacketCallback_)(da, std::move(frame));
+    return;
+  }
 
-  if (sendPacketCallback_) {
-    (*sendPacketCallback_)(da, std::move(buf));
+  const size_t frameSize{
+      kAggregateFrameOverhead + frame->computeChainDataLength()};
+  auto& pending = txQueue_[da];
+  if (!pending.frames.empty() &&
+      pending.size + frameSize > kMaxAggregateFrameSize) {
+    // Would not fit in one datagram, send what we have and start over
+    statsClient_.setAvgStat(
+        "fbmeshd.routing.tx_frames_per_datagram", pending.frames.size());
+    (*sendPacketCallback_)(
+        da,
+        pending.frames.size() == 1 ? std::move(pending.frames.front())
+                                   : encodeAggregateFrame(pending.frames));
+    pending = PendingDatagram{};
+  }
+  pending.frames.push_back(std::move(frame));
+  pending.size += frameSize;
+
+  if (!txFlushTimer_->isScheduled()) {
+    txFlushTimer_->scheduleTimeout(txAggregationWindow_);
+  }
+}
+
+void Routing::flushTxQueue() {
+  VLOG(8) << folly::sformat("Routing::{}()", __func__);
+  auto txQueue = std::move(txQueue_);
+  txQueue_.clear();
+  if (!sendPacketCallback_) {
+    return;
+  }
+  for (auto& pending : txQueue) {
+    auto& frames = pending.second.frames;
+    if (frames.empty()) {
+      continue;
+    }
+    statsClient_.setAvgStat(
+        "fbmeshd.routing.tx_frames_per_datagram", frames.size());
+    // A lone frame is sent as is, which older nodes can still parse
+    (*sendPacketCallback_)(
+        pending.first,
+        frames.size() == 1 ? std::move(frames.front())
+                           : encodeAggregateFrame(frames));
   }
 }
 
@@ -178,71 +482,80 @@ void Routing::receivePacket(
     folly::MacAddress sa,
     std::unique_ptr<folly::IOBuf> data) {
   VLOG(8) << folly::sformat("Routing::{}()", __func__);
+  if (data->length() == 0 ||
+      static_cast<MeshPathFrameType>(*data->data()) !=
+          MeshPathFrameType::AGGREGATE) {
+    statsClient_.setAvgStat("fbmeshd.routing.rx_frames_per_datagram", 1);
+    processFrame(sa, std::move(data));
+    return;
+  }
+
+  data->trimStart(1);
+  auto frames = decodeAggregateFrame(*data);
+  statsClient_.setAvgStat(
+      "fbmeshd.routing.rx_frames_per_datagram", frames.size());
+  for (auto& frame : frames) {
+    processFrame(sa, std::move(frame));
+  }
+}
+
+void Routing::processFrame(
+    folly::MacAddress sa,
+    std::unique_ptr<folly::IOBuf> data) {
+  if (data->length() == 0) {
+    return;
+  }
   auto action = static_cast<MeshPathFrameType>(*data->data());
   data->trimStart(1);
 
-  thrift::MeshPathFramePANN pann;
   switch (action) {
     case MeshPathFrameType::PANN:
-      serializer_.deserialize(data.get(), pann);
-      hwmpPannFrameProcess(sa, pann);
+    case MeshPathFrameType::PANN_FIXED: {
+      const auto pann = decodePannFrame(action, *data);
+      if (!pann) {
+        VLOG(8) << "discarding malformed PANN from " << sa;
+        return;
+      }
+      hwmpPannFrameProcess(sa, *pann);
       break;
+    }
     default:
       return;
   }
 }
 
-bool Routing::isStationInTopKGates(folly::MacAddress mac) {
-  std::vector<std::pair<uint32_t, folly::MacAddress>> ret;
-
-  for (const auto& mpath : meshPaths_) {
-    if (!mpath.second.expired() && mpath.second.isGate) {
-      ret.emplace_back(mpath.second.metric, mpath.first);
-    }
-  }
-
-  std::sort(ret.begin(), ret.end());
+bool Routing::isLiveMeshPath(folly::MacAddress addr) {
+  const auto slot = meshPaths_.find(addr);
+  return slot != MeshPathTable::kNoSlot && !meshPaths_.expired(slot, getNow());
+}
 
+bool Routing::isStationInTopKGates(folly::MacAddress mac) {
   const size_t maxNoGates =
       isGate_ ? kMinGatewayRedundancy - 1 : kMinGatewayRedundancy;
 
-  for (size_t i = 0; i < maxNoGates && i < ret.size(); i++) {
-    if (ret[i].second == mac) {
-      return true;
-    }
-  }
-
-  return false;
+  return gateIndex_.isInTopK(mac, maxNoGates, [this](folly::MacAddress gate) {
+    return isLiveMeshPath(gate);
+  });
 }
 
 void Routing::hwmpPannFrameProcess(
     folly::MacAddress sa,
-    thrift::MeshPathFramePANN pann) {
+    const PannFrame& pann) {
   VLOG(8) << folly::sformat("Routing::{}({}, ...)", __func__, sa.toString());
 
-#ifdef USE_THRIFT_FIELD_REF_API
-  folly::MacAddress origAddr{folly::MacAddress::fromNBO(*pann.origAddr_ref())};
-  uint64_t origSn{*pann.origSn_ref()};
-  uint8_t hopCount{*pann.hopCount_ref()};
-  uint32_t origMetric{*pann.metric_ref()};
-  uint8_t ttl{*pann.ttl_ref()};
-  folly::MacAddress targetAddr{
-      folly::MacAddress::fromNBO(*pann.targetAddr_ref())};
-  bool isGate{*pann.isGate_ref()};
-  bool replyRequested{*pann.replyRequested_ref()};
-#else
-  folly::MacAddress origAddr{folly::MacAddress::fromNBO(pann.origAddr)};
+  folly::MacAddress origAddr{pann.origAddr};
   uint64_t origSn{pann.origSn};
   uint8_t hopCount{pann.hopCount};
   uint32_t origMetric{pann.metric};
   uint8_t ttl{pann.ttl};
-  folly::MacAddress targetAddr{
-      folly::MacAddress::fromNBO(pann.targetAddr)};
+  folly::MacAddress targetAddr{pann.targetAddr};
   bool isGate{pann.isGate};
   bool replyRequested{pann.replyRequested};
-#endif
+  const auto gateLoad = isGate ? pann.gateLoad : folly::none;
   hopCount++;
 
+  const auto now = getNow();
+
   /*  Ignore our own PANNs */
   if (origAddr == nodeAddr_) {
     return;
@@ -251,27 +564,25 @@ void Routing::hwmpPannFrameProcess(
   VLOG(8) << "received PANN from " << origAddr << " via neighbour " << sa
           << " target " << targetAddr << " (is_gate=" << isGate << ")";
 
-  const auto stas = metricManager_->getLinkMetrics();
-
-  const auto sta = stas.find(sa);
-  if (sta == stas.end()) {
+  const auto linkMetrics = metricManager_->getLinkMetricTable();
+  const auto sta = linkMetrics->metrics.find(sa);
+  if (sta == linkMetrics->metrics.end()) {
     VLOG(8) << "discarding PANN - sta not found";
     return;
   }
 
   folly::MacAddress da{targetAddr};
   if (da.isUnicast() && da != nodeAddr_) {
-    const auto targetMpathIt{meshPaths_.find(targetAddr)};
-    if (targetMpathIt == meshPaths_.end()) {
+    const auto targetSlot = meshPaths_.find(targetAddr);
+    if (targetSlot == MeshPathTable::kNoSlot) {
       VLOG(8) << "discarding PANN - target not found";
       return;
     }
-    const auto& targetMpath = targetMpathIt->second;
-    if (targetMpath.expired()) {
+    if (meshPaths_.expired(targetSlot, now)) {
       VLOG(8) << "discarding PANN - target expired";
       return;
     }
-    da = targetMpath.nextHop;
+    da = meshPaths_.nextHop(targetSlot);
   }
 
   uint32_t lastHopMetric{sta->second};
@@ -280,8 +591,13 @@ void Routing::hwmpPannFrameProcess(
   if (newMetric < origMetric) {
     newMetric = kMaxMetric;
   }
+  // Gates are ranked by this
+  const uint32_t gateMetric{getLoadAdjustedMetric(newMetric, gateLoad)};
 
-  auto& mpath = getMeshPath(origAddr);
+  // Valid until the next insertion into meshPaths_
+  const auto slot = getMeshPath(origAddr);
+  const auto mpathExpired = meshPaths_.expired(slot, now);
+  const auto mpathNextHop = meshPaths_.nextHop(slot);
 
   /*
    * At this point we decide to ignore some PANNs (i.e. return from here):
@@ -291,46 +607,84 @@ void Routing::hwmpPannFrameProcess(
    *    new nextHop has a better metric. This rule prevents route flapping when
    *    we occasionally lose a PANN.
    */
-  if (!mpath.expired() &&
-      (mpath.sn > origSn ||
-       (mpath.nextHop != sa && mpath.metric <= newMetric))) {
-    VLOG(8) << "discarding PANN - mpath.sn:" << mpath.sn << " origSn:" << origSn
-            << " newMetric" << newMetric << " mpath.metric" << mpath.metric;
+  if (!mpathExpired &&
+      (meshPaths_.sn(slot) > origSn ||
+       (mpathNextHop != sa && meshPaths_.metric(slot) <= newMetric))) {
+    if (meshPaths_.sn(slot) <= origSn) {
+      updateBackupMeshPath(slot, sa, newMetric, lastHopMetric, hopCount);
+    }
+    VLOG(8) << "discarding PANN - mpath.sn:" << meshPaths_.sn(slot)
+            << " origSn:" << origSn << " newMetric" << newMetric
+            << " mpath.metric" << meshPaths_.metric(slot);
     return;
   }
 
   const auto topKGatesOldHasOrig = isStationInTopKGates(origAddr);
 
+  const size_t maxNoGates =
+      isGate_ ? kMinGatewayRedundancy - 1 : kMinGatewayRedundancy;
   if (isGate &&
-      std::count_if(
-          meshPaths_.begin(),
-          meshPaths_.end(),
-          [origAddr, newMetric](const auto& mpathPair) {
-            const auto& mpath = mpathPair.second;
-            return mpath.dst != origAddr && !mpath.expired() && mpath.isGate &&
-                mpath.metric <= newMetric;
-          }) >= (isGate_ ? kMinGatewayRedundancy - 1 : kMinGatewayRedundancy)) {
+      gateIndex_.countNoWorseThan(
+          gateMetric, origAddr, maxNoGates, [this](folly::MacAddress gate) {
+            return isLiveMeshPath(gate);
+          }) >= maxNoGates) {
     return;
   }
 
-  mpath.sn = origSn;
-  mpath.metric = newMetric;
-  mpath.nextHop = sa;
-  mpath.nextHopMetric = lastHopMetric;
-  mpath.hopCount = hopCount;
-  mpath.isGate = isGate;
-  mpath.expTime = std::chrono::steady_clock::now() + activePathTimeout_;
+  folly::Optional<MeshPathChange::Type> change;
+  if (mpathExpired || mpathNextHop == folly::MacAddress::ZERO) {
+    change = MeshPathChange::Type::ADDED;
+  } else if (mpathNextHop != sa) {
+    change = MeshPathChange::Type::NEXT_HOP_CHANGED;
+  }
+  auto& mpathCold = meshPaths_.cold(slot);
+  const bool gateChanged{mpathCold.isGate != isGate};
+
+  if (change == MeshPathChange::Type::NEXT_HOP_CHANGED) {
+    // The route we are leaving has not expired, keep it as the backup
+    mpathCold.backupNextHop = mpathNextHop;
+    mpathCold.backupMetric = meshPaths_.metric(slot);
+    mpathCold.backupNextHopMetric = mpathCold.nextHopMetric;
+    mpathCold.backupHopCount = mpathCold.hopCount;
+    mpathCold.backupExpTime = meshPaths_.expTime(slot);
+  } else if (mpathCold.backupNextHop == sa) {
+    mpathCold.backupNextHop = folly::MacAddress::ZERO;
+  }
+
+  meshPaths_.sn(slot) = origSn;
+  meshPaths_.metric(slot) = newMetric;
+  meshPaths_.setNextHop(slot, sa);
+  mpathCold.nextHopMetric = lastHopMetric;
+  mpathCold.hopCount = hopCount;
+  mpathCold.isGate = isGate;
+  mpathCold.gateLoad = gateLoad;
+  meshPaths_.expTime(slot) = now + activePathTimeout_;
+  if (isGate) {
+    gateIndex_.set(origAddr, gateMetric);
+  } else {
+    gateIndex_.erase(origAddr);
+  }
+  scheduleMeshPathExpiry(meshPaths_.expTime(slot), origAddr);
+  markSnapshotDirty();
+
+  if (change) {
+    recordMeshPathChange(*change, origAddr, sa);
+  }
+  if (change || gateChanged) {
+    notifyMeshPathChange();
+  }
 
   if (replyRequested) {
     txPannFrame(
-        mpath.nextHop,
+        sa,
         nodeAddr_,
         ++sn_,
         0,
         elementTtl_,
         origAddr,
-        0,
+        getOriginMetric(),
         isGate_,
+        isGate_ ? gateLoad_ : folly::none,
         false);
   }
 
@@ -352,19 +706,104 @@ void Routing::hwmpPannFrameProcess(
         targetAddr,
         newMetric,
         isGate,
+        gateLoad,
         replyRequested);
   }
 }
 
+void Routing::updateBackupMeshPath(
+    size_t slot,
+    folly::MacAddress sa,
+    uint32_t metric,
+    uint32_t nextHopMetric,
+    uint8_t hopCount) {
+  const auto now = getNow();
+  auto& mpathCold = meshPaths_.cold(slot);
+  if (mpathCold.backupNextHop != sa && now < mpathCold.backupExpTime &&
+      mpathCold.backupMetric < metric) {
+    return;
+  }
+  mpathCold.backupNextHop = sa;
+  mpathCold.backupMetric = metric;
+  mpathCold.backupNextHopMetric = nextHopMetric;
+  mpathCold.backupHopCount = hopCount;
+  mpathCold.backupExpTime = now + activePathTimeout_;
+}
+
+void Routing::invalidateNextHop(folly::MacAddress peer) {
+  VLOG(8) << folly::sformat("Routing::{}({})", __func__, peer.toString());
+  const auto now = getNow();
+  const auto linkMetrics = metricManager_->getLinkMetricTable();
+  int64_t numRerouted{0};
+  int64_t numWithdrawn{0};
+  meshPaths_.forEach([this,
+                      peer,
+                      now,
+                      &linkMetrics,
+                      &numRerouted,
+                      &numWithdrawn](size_t slot) {
+    auto& mpathCold = meshPaths_.cold(slot);
+    if (mpathCold.backupNextHop == peer) {
+      mpathCold.backupNextHop = folly::MacAddress::ZERO;
+    }
+    if (meshPaths_.nextHop(slot) != peer || meshPaths_.expired(slot, now)) {
+      return;
+    }
+
+    const auto dst = meshPaths_.dst(slot);
+    if (mpathCold.backupNextHop != folly::MacAddress::ZERO &&
+        now < mpathCold.backupExpTime &&
+        linkMetrics->metrics.count(mpathCold.backupNextHop) != 0) {
+      meshPaths_.setNextHop(slot, mpathCold.backupNextHop);
+      meshPaths_.metric(slot) = mpathCold.backupMetric;
+      meshPaths_.expTime(slot) = mpathCold.backupExpTime;
+      mpathCold.nextHopMetric = mpathCold.backupNextHopMetric;
+      mpathCold.hopCount = mpathCold.backupHopCount;
+      mpathCold.backupNextHop = folly::MacAddress::ZERO;
+      if (mpathCold.isGate) {
+        gateIndex_.set(
+            dst,
+            getLoadAdjustedMetric(meshPaths_.metric(slot), mpathCold.gateLoad));
+      }
+      scheduleMeshPathExpiry(meshPaths_.expTime(slot), dst);
+      recordMeshPathChange(
+          MeshPathChange::Type::NEXT_HOP_CHANGED,
+          dst,
+          meshPaths_.nextHop(slot));
+      numRerouted++;
+    } else {
+      // Expire the path now; it is erased kMeshPathExpire later as usual
+      meshPaths_.expTime(slot) = now;
+      gateIndex_.erase(dst);
+      scheduleMeshPathExpiry(now + kMeshPathExpire, dst);
+      recordMeshPathChange(
+          MeshPathChange::Type::REMOVED, dst, folly::MacAddress::ZERO);
+      numWithdrawn++;
+    }
+  });
+
+  VLOG(8) << "lost peer " << peer << ": rerouted " << numRerouted
+          << " paths, withdrew " << numWithdrawn;
+  if (numRerouted != 0 || numWithdrawn != 0) {
+    statsClient_.incrementSumStat(
+        "fbmeshd.routing.peer_down.rerouted_paths", numRerouted);
+    statsClient_.incrementSumStat(
+        "fbmeshd.routing.peer_down.withdrawn_paths", numWithdrawn);
+    markSnapshotDirty();
+    notifyMeshPathChange();
+  }
+}
+
 /*
  * Management / Control functions
  */
 
+void Routing::peerDown(folly::MacAddress peer) {
+  evb_->runInEventBaseThread([this, peer]() { invalidateNextHop(peer); });
+}
+
 bool Routing::getGatewayStatus() const {
-  bool isGate{};
-  evb_->runImmediatelyOrRunInEventBaseThreadAndWait(
-      [&isGate, this]() { isGate = isGate_; });
-  return isGate;
+  return getSnapshot()->isGate;
 }
 
 void Routing::setGatewayStatus(bool isGate) {
@@ -373,6 +812,8 @@ void Routing::setGatewayStatus(bool isGate) {
       return;
     }
     isGate_ = isGate;
+    markSnapshotDirty();
+    notifyMeshPathChange();
 
     if (isGate) {
       noLongerAGateRANNTimer_->cancelTimeout();
@@ -386,12 +827,32 @@ void Routing::setGatewayStatus(bool isGate) {
   });
 }
 
-std::unordered_map<folly::MacAddress, Routing::MeshPath> Routing::dumpMpaths() {
+void Routing::setGateLoad(folly::Optional<GateLoad> gateLoad) {
+  evb_->runInEventBaseThread([gateLoad, this]() {
+    VLOG(8) << "Advertising gate load: "
+            << (gateLoad ? folly::sformat(
+                               "{}% of {} kbps",
+                               static_cast<int>(gateLoad->utilization),
+                               gateLoad->capacityKbps)
+                         : "none");
+    gateLoad_ = gateLoad;
+  });
+}
+
+void Routing::setWanQuality(uint8_t wanQuality) {
+  evb_->runInEventBaseThread([wanQuality, this]() {
+    VLOG(8) << "Advertising WAN quality: " << static_cast<int>(wanQuality);
+    wanQuality_ = std::min<uint8_t>(wanQuality, 100);
+  });
+}
+
+uint32_t Routing::getOriginMetric() const {
+  return isGate_ ? (100 - wanQuality_) * kWanQualityMetricScale : 0;
+}
+
+std::vector<Routing::MeshPath> Routing::dumpMpaths() {
   VLOG(8) << folly::sformat("Routing::{}()", __func__);
-  std::unordered_map<folly::MacAddress, Routing::MeshPath> mpaths;
-  evb_->runImmediatelyOrRunInEventBaseThreadAndWait(
-      [this, &mpaths]() { mpaths = meshPaths_; });
-  return mpaths;
+  return getSnapshot()->meshPaths;
 }
 
 void Routing::setSendPacketCallback(
@@ -412,3 +873,21 @@ void Routing::resetSendPacketCallback() {
     sendPacketCallback_.reset();
   }
 }
+
+void Routing::setMeshPathChangeCallback(std::function<void()> cb) {
+  if (evb_->isRunning()) {
+    evb_->runImmediatelyOrRunInEventBaseThreadAndWait(
+        [this, cb = std::move(cb)]() { meshPathChangeCallback_ = cb; });
+  } else {
+    meshPathChangeCallback_ = cb;
+  }
+}
+
+void Routing::resetMeshPathChangeCallback() {
+  if (evb_->isRunning()) {
+    evb_->runImmediatelyOrRunInEventBaseThreadAndWait(
+        [this]() { meshPathChangeCallback_.reset(); });
+  } else {
+    meshPathChangeCallback_.reset();
+  }
+}
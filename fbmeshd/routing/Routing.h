@@ -8,75 +8,77 @@
 #pragma once
 
 #include <chrono>
+#include <memory>
 #include <queue>
-
-#include <thrift/lib/cpp2/protocol/Serializer.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <folly/IPAddressV6.h>
 #include <folly/SocketAddress.h>
+#include <folly/concurrency/AtomicSharedPtr.h>
 #include <folly/io/IOBuf.h>
 #include <folly/io/async/AsyncUDPServerSocket.h>
 #include <folly/io/async/AsyncUDPSocket.h>
 #include <folly/io/async/EventBase.h>
 
 #include <fbmeshd/802.11s/Nl80211Handler.h>
+#include <fbmeshd/gateway-connectivity-monitor/StatsClient.h>
+#include <fbmeshd/routing/GateIndex.h>
+#include <fbmeshd/routing/MeshPathFrame.h>
+#include <fbmeshd/routing/MeshPathTable.h>
 #include <fbmeshd/routing/MetricManager.h>
 
 namespace fbmeshd {
 
 class Routing {
  public:
-  /*
-   * mesh path frame type
-   */
-  enum class MeshPathFrameType { PANN = 0 };
+  using MeshPathFrameType = fbmeshd::MeshPathFrameType;
+
+  using MeshPath = fbmeshd::MeshPath;
 
   /**
-   * mesh path structure
+   * mesh path change journal entry
    *
+   * @type: whether the path was added, removed or moved to another next hop
    * @dst: mesh path destination mac address
-   * @nextHop: mesh neighbor to which frames for this destination will be
-   *  forwarded
-   * @sn: target sequence number
-   * @metric: current metric to this destination
-   * @nextHopMetric: metric for the next hop link
-   * @hopCount: hops to destination
-   * @expTime: when the path will expire or when it expired
-   * @isRoot: the destination station of this path is a root node
-   * @isGate: the destination station of this path is a mesh gate
-   *
-   *
-   * The dst address is unique in the mesh path table.
+   * @nextHop: next hop of the path after the change, ZERO if it was removed
    */
-  struct MeshPath {
-    explicit MeshPath(folly::MacAddress _dst) : dst{_dst} {}
-
-    MeshPath(const MeshPath& other)
-        : dst{other.dst},
-          nextHop{other.nextHop},
-          sn{other.sn},
-          metric{other.metric},
-          nextHopMetric{other.nextHopMetric},
-          hopCount{other.hopCount},
-          expTime{other.expTime},
-          isRoot{other.isRoot},
-          isGate{other.isGate} {}
-
-    bool
-    expired() const {
-      return std::chrono::steady_clock::now() > expTime;
-    }
+  struct MeshPathChange {
+    enum class Type { ADDED, REMOVED, NEXT_HOP_CHANGED };
 
+    Type type;
     folly::MacAddress dst;
-    folly::MacAddress nextHop{};
-    uint64_t sn{0};
-    uint32_t metric{0};
-    uint32_t nextHopMetric{0};
-    uint8_t hopCount{0};
-    std::chrono::steady_clock::time_point expTime{
-        std::chrono::steady_clock::now()};
-    bool isRoot{false};
+    folly::MacAddress nextHop;
+  };
+
+  /**
+   * changes recorded since the last call to getMeshPathChanges()
+   *
+   * @fullSyncRequired: the journal overflowed and was dropped, the consumer
+   *  must resync from getMeshPaths()
+   * @isGate: our own gate status as of the drain
+   * @changes: journal entries in the order they happened
+   */
+  struct MeshPathChanges {
+    bool fullSyncRequired{false};
     bool isGate{false};
+    std::vector<MeshPathChange> changes;
+  };
+
+  /**
+   * immutable copy of the routing state, published at the end of the event
+   * loop iteration in which it changed, or up to kMinSnapshotInterval later if
+   * the previous publication was more recent than that
+   *
+   * @version: incremented on every publication
+   * @isGate: our own gate status
+   * @meshPaths: every mesh path, including expired ones
+   */
+  struct Snapshot {
+    uint64_t version{0};
+    bool isGate{false};
+    std::vector<MeshPath> meshPaths;
   };
 
   explicit Routing(
@@ -85,7 +87,10 @@ class Routing {
       folly::MacAddress nodeAddr,
       uint32_t elementTtl,
       std::chrono::milliseconds activePathTimeout,
-      std::chrono::milliseconds rootPannInterval);
+      std::chrono::milliseconds rootPannInterval,
+      MeshPathFrameType pannFrameType,
+      std::chrono::milliseconds txAggregationWindow,
+      StatsClient& statsClient);
 
   Routing() = delete;
   ~Routing() = default;
@@ -94,25 +99,112 @@ class Routing {
   Routing& operator=(const Routing&) = delete;
   Routing& operator=(Routing&&) = delete;
 
+  // Returns the latest published snapshot. Safe to call from any thread, never
+  // waits for the routing EventBase.
+  std::shared_ptr<const Snapshot> getSnapshot() const;
+
   bool getGatewayStatus() const;
   void setGatewayStatus(bool isGate);
 
-  std::unordered_map<folly::MacAddress, MeshPath> dumpMpaths();
+  // WAN load to advertise in our PANNs while we are a gate, none to advertise
+  // none. Gates advertising load are ranked by their load adjusted metric,
+  // see getLoadAdjustedMetric(). Safe to call from any thread.
+  void setGateLoad(folly::Optional<GateLoad> gateLoad);
+
+  // Quality of our WAN uplink from 0 (unusable) to 100 (perfect). While we are
+  // a gate, our PANNs start out with a metric that grows as it degrades, so
+  // nodes move to other gates before the uplink fails outright. Safe to call
+  // from any thread.
+  void setWanQuality(uint8_t wanQuality);
+
+  // Called when the peer link to a neighbor is lost. Paths through it switch
+  // to their backup route, or are withdrawn, right away instead of when they
+  // time out. Safe to call from any thread.
+  void peerDown(folly::MacAddress peer);
+
+  // Returns every mesh path from the latest snapshot, which may be up to
+  // kMinSnapshotInterval behind
+  std::vector<MeshPath> dumpMpaths();
 
   void setSendPacketCallback(
       std::function<void(folly::MacAddress, std::unique_ptr<folly::IOBuf>)> cb);
   void resetSendPacketCallback();
 
+  // Called on the routing EventBase whenever a mesh path changes next hop,
+  // appears, disappears or changes gate status, or our own gate status changes
+  void setMeshPathChangeCallback(std::function<void()> cb);
+  void resetMeshPathChangeCallback();
+
   void receivePacket(folly::MacAddress sa, std::unique_ptr<folly::IOBuf> data);
 
-  std::unordered_map<folly::MacAddress, MeshPath> getMeshPaths();
+  // Returns the live mesh paths from the latest snapshot, which may be up to
+  // kMinSnapshotInterval behind unless getMeshPathChanges() was just called
+  std::vector<MeshPath> getMeshPaths();
+
+  // Returns the live mesh paths to gates, filtered like getMeshPaths()
+  std::vector<MeshPath> getGatePaths();
+
+  // Drains the mesh path change journal. There is a single consumer
+  // (SyncRoutes80211s); a second caller would steal its changes. Pending
+  // updates are published first, so the snapshot reflects every change
+  // returned. Paths getMeshPaths() would leave out are returned as removed.
+  MeshPathChanges getMeshPathChanges();
 
  private:
+  class LoopCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit LoopCallback(std::function<void()> f) : f_{std::move(f)} {}
+
+    void
+    runLoopCallback() noexcept override {
+      f_();
+    }
+
+   private:
+    std::function<void()> f_;
+  };
+
   void prepare();
 
   void meshPathAddGate(MeshPath& mpath);
 
-  MeshPath& getMeshPath(folly::MacAddress addr);
+  // Returns the slot of the path to addr in meshPaths_, creating it if needed
+  size_t getMeshPath(folly::MacAddress addr);
+
+  void recordMeshPathChange(
+      MeshPathChange::Type type,
+      folly::MacAddress dst,
+      folly::MacAddress nextHop);
+
+  void notifyMeshPathChange();
+
+  // Filter the snapshot down to paths that are live and go through a peer we
+  // have a metric for
+  std::vector<MeshPath> getLiveMeshPaths(bool gatesOnly) const;
+
+  // Turn journal entries for paths getLiveMeshPaths() would filter out into
+  // removals
+  void filterMeshPathChanges(MeshPathChanges& changes);
+
+  // Journal the paths through peers that gained or lost their link metric
+  // since the last drain; that changes whether they are routed without
+  // changing the paths themselves
+  void journalLinkMetricPeerChanges(
+      const MetricManager::LinkMetrics& linkMetrics, MeshPathChanges& changes);
+
+  // Schedule a snapshot publication at the end of this loop iteration, or
+  // once kMinSnapshotInterval has passed since the last one
+  void markSnapshotDirty();
+  void publishSnapshot();
+
+  // Returns the current time, read from the clock once per event loop
+  // iteration
+  std::chrono::steady_clock::time_point getNow();
+
+  // Queue an expiry check for dst at deadline, see meshPathExpiryQueue_
+  void scheduleMeshPathExpiry(
+      std::chrono::steady_clock::time_point deadline, folly::MacAddress dst);
+  void scheduleHousekeeping();
 
   /*
    * HWMP Timer callbacks
@@ -124,6 +216,9 @@ class Routing {
    * Transmit path / path discovery
    */
 
+  // Metric our own PANNs start out with
+  uint32_t getOriginMetric() const;
+
   void txPannFrame(
       folly::MacAddress da,
       folly::MacAddress origAddr,
@@ -133,12 +228,31 @@ class Routing {
       folly::MacAddress targetAddr,
       uint32_t metric,
       bool isGate,
+      const folly::Optional<GateLoad>& gateLoad,
       bool replyRequested);
 
+  // Queue frame for da. Frames queued for the same destination within
+  // txAggregationWindow_ are sent as one AGGREGATE datagram.
+  void sendFrame(folly::MacAddress da, std::unique_ptr<folly::IOBuf> frame);
+  void flushTxQueue();
+
+  void processFrame(folly::MacAddress sa, std::unique_ptr<folly::IOBuf> data);
+
   bool isStationInTopKGates(folly::MacAddress mac);
 
-  void hwmpPannFrameProcess(
-      folly::MacAddress sa, thrift::MeshPathFramePANN rann);
+  bool isLiveMeshPath(folly::MacAddress addr);
+
+  void hwmpPannFrameProcess(folly::MacAddress sa, const PannFrame& pann);
+
+  // Offer the route through sa as the backup for the path in slot
+  void updateBackupMeshPath(
+      size_t slot,
+      folly::MacAddress sa,
+      uint32_t metric,
+      uint32_t nextHopMetric,
+      uint8_t hopCount);
+
+  void invalidateNextHop(folly::MacAddress peer);
 
   folly::EventBase* evb_;
 
@@ -146,7 +260,13 @@ class Routing {
 
   uint32_t elementTtl_;
 
-  apache::thrift::CompactSerializer serializer_;
+  // Format of the PANNs we send, we accept every format
+  MeshPathFrameType pannFrameType_;
+
+  // Aggregation is disabled when this is zero
+  std::chrono::milliseconds txAggregationWindow_;
+
+  StatsClient& statsClient_;
 
   MetricManager* metricManager_;
 
@@ -154,6 +274,8 @@ class Routing {
       std::function<void(folly::MacAddress, std::unique_ptr<folly::IOBuf>)>>
       sendPacketCallback_;
 
+  folly::Optional<std::function<void()>> meshPathChangeCallback_;
+
   /*
    * L3 Routing state
    */
@@ -163,6 +285,7 @@ class Routing {
 
   std::unique_ptr<folly::AsyncTimeout> housekeepingTimer_;
   std::unique_ptr<folly::AsyncTimeout> meshPathRootTimer_;
+  std::unique_ptr<folly::AsyncTimeout> txFlushTimer_;
 
   /* Local mesh Sequence Number */
   uint64_t sn_{0};
@@ -174,11 +297,65 @@ class Routing {
   bool isRoot_{false};
   std::chrono::milliseconds rootPannInterval_;
   bool isGate_{false};
+  folly::Optional<GateLoad> gateLoad_;
+  uint8_t wanQuality_{100};
 
   /*
    * Path state
    */
-  std::unordered_map<folly::MacAddress, MeshPath> meshPaths_;
+  MeshPathTable meshPaths_;
+
+  /*
+   * Mesh path expiry index: a min-heap of (deadline, dst). A path gets an
+   * entry at its expTime, when it is withdrawn, which in turn queues one at
+   * expTime + kMeshPathExpire, when it is erased. Entries are not removed when
+   * a path is refreshed; they are ignored when popped if they no longer match
+   * the path's expTime.
+   */
+  using MeshPathExpiry =
+      std::pair<std::chrono::steady_clock::time_point, folly::MacAddress>;
+  std::priority_queue<
+      MeshPathExpiry,
+      std::vector<MeshPathExpiry>,
+      std::greater<MeshPathExpiry>>
+      meshPathExpiryQueue_;
+
+  folly::Optional<std::chrono::steady_clock::time_point> cachedNow_;
+  LoopCallback clearCachedNowCallback_{[this]() { cachedNow_.reset(); }};
+
+  /*
+   * Live gate paths by metric, for top-K gate and redundancy checks
+   */
+  GateIndex gateIndex_;
+
+  /*
+   * Mesh path change journal, drained by getMeshPathChanges()
+   */
+  MeshPathChanges meshPathChanges_;
+
+  // Peers with a link metric as of the last drain, and the generation of the
+  // link metric table they were taken from
+  std::unordered_set<folly::MacAddress> linkMetricPeers_;
+  uint64_t linkMetricsGeneration_{0};
+
+  /*
+   * Frames waiting for txFlushTimer_, by destination. The size includes the
+   * AGGREGATE frame type byte and per frame overhead.
+   */
+  struct PendingDatagram {
+    std::vector<std::unique_ptr<folly::IOBuf>> frames;
+    size_t size{1};
+  };
+  std::unordered_map<folly::MacAddress, PendingDatagram> txQueue_;
+
+  /*
+   * Read-side snapshot, see getSnapshot()
+   */
+  folly::atomic_shared_ptr<const Snapshot> snapshot_;
+  bool snapshotDirty_{false};
+  std::chrono::steady_clock::time_point lastSnapshotTime_;
+  LoopCallback publishSnapshotCallback_{[this]() { publishSnapshot(); }};
+  std::unique_ptr<folly::AsyncTimeout> publishSnapshotTimer_;
 };
 
 } // namespace fbmeshd
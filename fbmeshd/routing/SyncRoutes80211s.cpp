@@ -7,11 +7,19 @@
 
 #include "fbmeshd/routing/SyncRoutes80211s.h"
 
+#include <fcntl.h>
 #include <sys/ioctl.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <tuple>
 
+#include <folly/Chrono.h>
+#include <folly/FileUtil.h>
 #include <folly/MacAddress.h>
+#include <folly/String.h>
+#include <folly/futures/Future.h>
 #include <folly/system/ThreadName.h>
 
 using namespace std::chrono_literals;
@@ -21,6 +29,38 @@ namespace {
 
 const auto kSyncRoutesInterval{1s};
 
+// Window over which mesh path change notifications are batched into one sync
+const auto kSyncRoutesCoalesceWindow{5ms};
+
+// Minimum time between the start of two syncs. Each sync blocks the routing
+// EventBase on netlink round trips, so under churn change notifications are
+// deferred rather than served right away.
+const auto kMinSyncRoutesInterval{100ms};
+
+// Time between full reconciliations of the mesh routes with the Routing
+// state. In between, only journaled changes are applied.
+const auto kFullSyncInterval{10s};
+
+const uint8_t kMeshRouteProtocolId{98};
+
+const auto kTaygaIfName{"tayga"};
+
+// Hash IPv6 multipath routes on the L4 five-tuple. The default L3 policy also
+// hashes the flow label, which a host may change mid-connection, and would
+// then move a NAT session to a gate that does not know about it.
+const auto kMultipathHashPolicyPath{
+    "/proc/sys/net/ipv6/fib_multipath_hash_policy"};
+const auto kMultipathHashPolicyL4{"1"};
+
+// Gate weights are only reprogrammed once one of them moves by more than this
+// fraction, as every change moves flows between gates
+const double kGateWeightHysteresis{0.25};
+
+// The current gates are ranked as if they were this many points of
+// utilization less loaded, so that gates do not trade places every time load
+// shifts between them
+const uint8_t kCurrentGateUtilizationBonus{10};
+
 folly::IPAddressV6
 getIPV6FromMacAddress(const char* prefix, folly::MacAddress macAddress) {
   folly::ByteArray16 bytes;
@@ -48,6 +88,65 @@ getMeshIPV6FromMacAddress(folly::MacAddress macAddress) {
   return getIPV6FromMacAddress("\xfc\x00\x00\x00\x00\x00\x00\x00", macAddress);
 }
 
+// Returns the /128 prefixes routed to a mesh node
+std::vector<folly::CIDRNetwork>
+getMeshPathDestinations(folly::MacAddress dst, bool taygaRoutable) {
+  std::vector<folly::CIDRNetwork> destinations;
+  if (taygaRoutable) {
+    destinations.emplace_back(getTaygaIPV6FromMacAddress(dst), 128);
+  }
+  destinations.emplace_back(getMeshIPV6FromMacAddress(dst), 128);
+  return destinations;
+}
+
+rnl::Route
+buildMeshRoute(
+    const folly::CIDRNetwork& destination,
+    folly::MacAddress nextHop,
+    int meshIfIndex) {
+  return rnl::RouteBuilder{}
+      .setDestination(destination)
+      .setProtocolId(kMeshRouteProtocolId)
+      .addNextHop(rnl::NextHopBuilder{}
+                      .setGateway(folly::IPAddressV6{
+                          folly::IPAddressV6::LinkLocalTag::LINK_LOCAL,
+                          nextHop})
+                      .setIfIndex(meshIfIndex)
+                      .build())
+      .build();
+}
+
+rnl::Route
+buildMultipathMeshRoute(
+    const folly::CIDRNetwork& destination,
+    const std::unordered_map<folly::MacAddress, uint8_t>& nextHopWeights,
+    int meshIfIndex) {
+  rnl::RouteBuilder builder;
+  builder.setDestination(destination).setProtocolId(kMeshRouteProtocolId);
+  for (const auto& it : nextHopWeights) {
+    builder.addNextHop(
+        rnl::NextHopBuilder{}
+            .setGateway(folly::IPAddressV6{
+                folly::IPAddressV6::LinkLocalTag::LINK_LOCAL, it.first})
+            .setIfIndex(meshIfIndex)
+            .setWeight(it.second)
+            .build());
+  }
+  return builder.build();
+}
+
+// Load adjusted metric of a gate path, with the hysteresis bonus for a gate
+// that is currently in use
+uint32_t
+getGateSelectionMetric(const Routing::MeshPath& mpath, bool isCurrentGate) {
+  auto gateLoad = mpath.gateLoad;
+  if (gateLoad && isCurrentGate) {
+    gateLoad->utilization -=
+        std::min(gateLoad->utilization, kCurrentGateUtilizationBonus);
+  }
+  return getLoadAdjustedMetric(mpath.metric, gateLoad);
+}
+
 bool
 isInterfaceUp(std::string interface) {
   VLOG(8) << folly::sformat("::{}(interface: {})", __func__, interface);
@@ -76,89 +175,275 @@ isInterfaceUp(std::string interface) {
 
 } // namespace
 
+constexpr uint8_t SyncRoutes80211s::kMaxGateWeight;
+
 SyncRoutes80211s::SyncRoutes80211s(
     folly::EventBase* evb,
     Routing* routing,
     rnl::NetlinkSocket* netlinkSocket,
     folly::MacAddress nodeAddr,
-    const std::string& interface)
+    const std::string& interface,
+    uint32_t multipathGates)
     : routing_{routing},
       nodeAddr_{nodeAddr},
       interface_{interface},
-      netlinkSocket_{netlinkSocket} {
+      netlinkSocket_{netlinkSocket},
+      multipathGates_{std::max<uint32_t>(multipathGates, 1)} {
+  // The hash policy is host-wide, so leave it alone unless multipath is used
+  if (multipathGates_ > 1) {
+    std::string hashPolicy;
+    if (folly::readFile(kMultipathHashPolicyPath, hashPolicy)) {
+      hashPolicy = folly::rtrimWhitespace(hashPolicy).str();
+      LOG(INFO) << "Setting " << kMultipathHashPolicyPath << " to "
+                << kMultipathHashPolicyL4 << ", was " << hashPolicy;
+      previousHashPolicy_ = hashPolicy;
+    }
+    if (!folly::writeFile(
+            folly::StringPiece{kMultipathHashPolicyL4},
+            kMultipathHashPolicyPath,
+            O_WRONLY)) {
+      LOG(WARNING) << "Failed to set " << kMultipathHashPolicyPath
+                   << ", flows may move between gates";
+    }
+  }
+
   // Set timer to sync routes
   syncRoutesTimer_ = folly::AsyncTimeout::make(*evb, [this]() noexcept {
+    syncRoutesScheduled_ = false;
     doSyncRoutes();
     syncRoutesTimer_->scheduleTimeout(kSyncRoutesInterval);
   });
   syncRoutesTimer_->scheduleTimeout(kSyncRoutesInterval);
 }
 
+SyncRoutes80211s::~SyncRoutes80211s() {
+  if (previousHashPolicy_ && *previousHashPolicy_ != kMultipathHashPolicyL4) {
+    LOG(INFO) << "Restoring " << kMultipathHashPolicyPath << " to "
+              << *previousHashPolicy_;
+    if (!folly::writeFile(
+            *previousHashPolicy_, kMultipathHashPolicyPath, O_WRONLY)) {
+      LOG(WARNING) << "Failed to restore " << kMultipathHashPolicyPath;
+    }
+  }
+}
+
 void
-SyncRoutes80211s::doSyncRoutes() {
+SyncRoutes80211s::scheduleSyncRoutes() {
+  if (syncRoutesScheduled_) {
+    return;
+  }
   VLOG(8) << folly::sformat("SyncRoutes80211s::{}()", __func__);
+  syncRoutesScheduled_ = true;
+  // Replaces the pending fallback timeout, which is rearmed after the sync
+  std::chrono::milliseconds delay{kSyncRoutesCoalesceWindow};
+  if (lastSyncTime_) {
+    delay = std::max(
+        delay,
+        folly::chrono::ceil<std::chrono::milliseconds>(
+            *lastSyncTime_ + kMinSyncRoutesInterval -
+            std::chrono::steady_clock::now()));
+  }
+  syncRoutesTimer_->scheduleTimeout(delay);
+}
 
-  auto meshIfIndex = netlinkSocket_->getIfIndex(interface_).get();
-  auto isGate = routing_->getGatewayStatus();
-  auto meshPaths = routing_->getMeshPaths();
+std::unordered_map<folly::MacAddress, uint8_t>
+SyncRoutes80211s::getGateNextHopWeights(
+    const std::vector<Routing::MeshPath>& gatePaths) {
+  std::unordered_map<folly::MacAddress, double> shares;
+  double maxShare{0};
+  for (const auto& mpath : gatePaths) {
+    const auto metric = getLoadAdjustedMetric(mpath.metric, mpath.gateLoad);
+    auto& share = shares[mpath.nextHop];
+    share += 1.0 / std::max<uint32_t>(metric, 1);
+    maxShare = std::max(maxShare, share);
+  }
 
-  rnl::NlUnicastRoutes unicastRouteDb;
-  rnl::NlLinkRoutes linkRouteDb;
-  std::vector<rnl::IfAddress> meshAddrs;
+  // The scale is kept coarse so that small metric changes do not reprogram
+  // the route, which would move flows between gates
+  std::unordered_map<folly::MacAddress, uint8_t> weights;
+  for (const auto& it : shares) {
+    weights.emplace(
+        it.first,
+        std::max<long>(std::lround(kMaxGateWeight * it.second / maxShare), 1));
+  }
+  return weights;
+}
 
-  const auto kTaygaIfName{"tayga"};
-  auto taygaIfIndex = netlinkSocket_->getIfIndex(kTaygaIfName).get();
-  bool taygaIfUp = isInterfaceUp(kTaygaIfName);
+std::unordered_map<folly::MacAddress, uint8_t>
+SyncRoutes80211s::stabilizeGateNextHopWeights(
+    const std::unordered_map<folly::MacAddress, uint8_t>& current,
+    const std::unordered_map<folly::MacAddress, uint8_t>& weights) {
+  if (current.size() != weights.size()) {
+    return weights;
+  }
+  for (const auto& it : weights) {
+    const auto currentIt = current.find(it.first);
+    if (currentIt == current.end()) {
+      return weights;
+    }
+    const int delta = std::abs(int{it.second} - int{currentIt->second});
+    const int weight = std::max(it.second, currentIt->second);
+    if (delta > kGateWeightHysteresis * weight) {
+      return weights;
+    }
+  }
+  return current;
+}
 
-  folly::Optional<std::pair<folly::MacAddress, uint32_t>> bestGate;
-  bool isCurrentGateStillAlive = false;
-  for (const auto& mpathIt : meshPaths) {
-    const auto& mpath = mpathIt.second;
+std::vector<Routing::MeshPath>
+SyncRoutes80211s::selectMultipathGates(
+    const std::vector<Routing::MeshPath>& gatePaths) {
+  auto gates = gatePaths;
+  std::sort(
+      gates.begin(),
+      gates.end(),
+      [this](const Routing::MeshPath& a, const Routing::MeshPath& b) {
+        const bool aIsNew = multipathGateSet_.count(a.dst) == 0;
+        const bool bIsNew = multipathGateSet_.count(b.dst) == 0;
+        const auto aMetric = getGateSelectionMetric(a, !aIsNew);
+        const auto bMetric = getGateSelectionMetric(b, !bIsNew);
+        return std::tie(aMetric, aIsNew) < std::tie(bMetric, bIsNew);
+      });
+  if (gates.size() > multipathGates_) {
+    gates.erase(gates.begin() + multipathGates_, gates.end());
+  }
+
+  multipathGateSet_.clear();
+  for (const auto& mpath : gates) {
+    VLOG(8) << "Multipath gate: " << mpath.dst << " via " << mpath.nextHop
+            << " with metric: " << mpath.metric;
+    multipathGateSet_.insert(mpath.dst);
+  }
+  return gates;
+}
+
+void
+SyncRoutes80211s::rebuildMeshRoutes(int meshIfIndex, bool taygaRoutable) {
+  VLOG(8) << folly::sformat("SyncRoutes80211s::{}()", __func__);
 
+  meshRouteDb_.clear();
+  for (const auto& mpath : routing_->getMeshPaths()) {
     if (mpath.nextHop == folly::MacAddress::ZERO) {
       continue;
     }
 
-    auto destination = std::make_pair<folly::IPAddress, uint8_t>(
-        getTaygaIPV6FromMacAddress(mpath.dst), 128);
-    // Ensure tayga interface is present and up
-    if (taygaIfIndex != 0 && taygaIfUp) {
-      unicastRouteDb.emplace(
-          destination,
-          rnl::RouteBuilder{}
-              .setDestination(destination)
-              .setProtocolId(98)
-              .addNextHop(rnl::NextHopBuilder{}
-                              .setGateway(folly::IPAddressV6{
-                                  folly::IPAddressV6::LinkLocalTag::LINK_LOCAL,
-                                  mpath.nextHop})
-                              .setIfIndex(meshIfIndex)
-                              .build())
-              .build());
+    for (const auto& destination :
+         getMeshPathDestinations(mpath.dst, taygaRoutable)) {
+      meshRouteDb_.emplace(
+          destination, buildMeshRoute(destination, mpath.nextHop, meshIfIndex));
     }
-    destination = std::make_pair<folly::IPAddress, uint8_t>(
-        getMeshIPV6FromMacAddress(mpath.dst), 128);
-    unicastRouteDb.emplace(
-        destination,
-        rnl::RouteBuilder{}
-            .setDestination(destination)
-            .setProtocolId(98)
-            .addNextHop(rnl::NextHopBuilder{}
-                            .setGateway(folly::IPAddressV6{
-                                folly::IPAddressV6::LinkLocalTag::LINK_LOCAL,
-                                mpath.nextHop})
-                            .setIfIndex(meshIfIndex)
-                            .build())
-            .build());
+  }
+}
 
-    if (mpath.expTime > std::chrono::steady_clock::now() && mpath.isGate) {
-      if (currentGate_ && currentGate_->first == mpath.dst) {
-        isCurrentGateStillAlive = true;
-        currentGate_->second = mpath.metric;
+void
+SyncRoutes80211s::applyMeshPathChanges(
+    const std::vector<Routing::MeshPathChange>& changes,
+    int meshIfIndex,
+    bool taygaRoutable) {
+  VLOG(8) << folly::sformat(
+      "SyncRoutes80211s::{}(changes: {})", __func__, changes.size());
+
+  // Only the most recent change for each destination matters
+  std::unordered_map<folly::MacAddress, folly::MacAddress> nextHops;
+  for (const auto& change : changes) {
+    nextHops[change.dst] = change.nextHop;
+  }
+
+  std::vector<rnl::Route> toDelete;
+  std::vector<rnl::Route> toAdd;
+  for (const auto& nextHopIt : nextHops) {
+    for (const auto& destination :
+         getMeshPathDestinations(nextHopIt.first, taygaRoutable)) {
+      auto routeIt = meshRouteDb_.find(destination);
+      if (nextHopIt.second == folly::MacAddress::ZERO) {
+        if (routeIt != meshRouteDb_.end()) {
+          toDelete.push_back(std::move(routeIt->second));
+          meshRouteDb_.erase(routeIt);
+        }
+        continue;
       }
-      if (!bestGate || bestGate->second > mpath.metric) {
-        bestGate = std::make_pair(mpath.dst, mpath.metric);
+
+      auto route = buildMeshRoute(destination, nextHopIt.second, meshIfIndex);
+      if (routeIt != meshRouteDb_.end() && routeIt->second == route) {
+        continue;
       }
+      toAdd.push_back(route);
+      meshRouteDb_.erase(destination);
+      meshRouteDb_.emplace(destination, std::move(route));
+    }
+  }
+
+  if (toDelete.empty() && toAdd.empty()) {
+    return;
+  }
+
+  VLOG(8) << folly::sformat(
+      "Applying mesh route deltas: {} to delete, {} to add/update",
+      toDelete.size(),
+      toAdd.size());
+
+  // One batch, so that destinations moving together to a new next hop can
+  // be moved by repointing their nexthop object
+  try {
+    netlinkSocket_
+        ->updateUnicastRoutes(
+            kMeshRouteProtocolId, std::move(toAdd), std::move(toDelete))
+        .get();
+  } catch (const std::exception&) {
+    // Errors are logged by NetlinkSocket; let a full sync repair the state
+    lastFullSyncTime_.reset();
+  }
+}
+
+void
+SyncRoutes80211s::doSyncRoutes() {
+  VLOG(8) << folly::sformat("SyncRoutes80211s::{}()", __func__);
+
+  const auto now = std::chrono::steady_clock::now();
+  lastSyncTime_ = now;
+
+  auto meshIfIndex = netlinkSocket_->getIfIndex(interface_).get();
+  // Drain the journal before any full dump so that no change is lost between
+  // the two; changes already reflected in the dump are idempotent. Our gate
+  // status comes with it, as the snapshot may lag behind.
+  auto meshPathChanges = routing_->getMeshPathChanges();
+  const auto isGate = meshPathChanges.isGate;
+
+  rnl::NlLinkRoutes linkRouteDb;
+  std::vector<rnl::IfAddress> meshAddrs;
+
+  auto taygaIfIndex = netlinkSocket_->getIfIndex(kTaygaIfName).get();
+  // Ensure tayga interface is present and up
+  bool taygaRoutable = taygaIfIndex != 0 && isInterfaceUp(kTaygaIfName);
+
+  const bool fullSync = !lastFullSyncTime_ ||
+      now - *lastFullSyncTime_ >= kFullSyncInterval ||
+      meshPathChanges.fullSyncRequired || meshIfIndex != meshIfIndex_ ||
+      taygaRoutable != taygaRoutable_ || isGateBeforeRouteSync_ != isGate;
+
+  if (fullSync) {
+    rebuildMeshRoutes(meshIfIndex, taygaRoutable);
+    lastFullSyncTime_ = now;
+    meshIfIndex_ = meshIfIndex;
+    taygaRoutable_ = taygaRoutable;
+  } else {
+    applyMeshPathChanges(meshPathChanges.changes, meshIfIndex, taygaRoutable);
+  }
+
+  const auto gatePaths = routing_->getGatePaths();
+
+  folly::Optional<std::pair<folly::MacAddress, uint32_t>> bestGate;
+  bool isCurrentGateStillAlive = false;
+  folly::MacAddress currentGateNextHop;
+  for (const auto& mpath : gatePaths) {
+    const bool isCurrentGate = currentGate_ && currentGate_->first == mpath.dst;
+    const auto metric = getGateSelectionMetric(mpath, isCurrentGate);
+    if (isCurrentGate) {
+      isCurrentGateStillAlive = true;
+      currentGate_->second = metric;
+    }
+    if (!bestGate || bestGate->second > metric) {
+      bestGate = std::make_pair(mpath.dst, metric);
     }
   }
   if (bestGate) {
@@ -177,6 +462,11 @@ SyncRoutes80211s::doSyncRoutes() {
   if (currentGate_) {
     VLOG(8) << "Current gate: " << currentGate_->first
              << " with metric: " << currentGate_->second;
+    for (const auto& mpath : gatePaths) {
+      if (mpath.dst == currentGate_->first) {
+        currentGateNextHop = mpath.nextHop;
+      }
+    }
   } else {
     VLOG(8) << "No current gate found";
   }
@@ -184,13 +474,12 @@ SyncRoutes80211s::doSyncRoutes() {
   auto destination =
       folly::CIDRNetwork{getTaygaIPV6FromMacAddress(nodeAddr_), 128};
 
-  // Ensure tayga interface is present and up
-  if (taygaIfIndex != 0 && taygaIfUp) {
+  if (taygaRoutable) {
     linkRouteDb.emplace(
         std::make_pair(destination, kTaygaIfName),
         rnl::RouteBuilder{}
             .setDestination(destination)
-            .setProtocolId(98)
+            .setProtocolId(kMeshRouteProtocolId)
             .setRouteIfIndex(taygaIfIndex)
             .setRouteIfName(kTaygaIfName)
             .buildLinkRoute());
@@ -200,7 +489,7 @@ SyncRoutes80211s::doSyncRoutes() {
         std::make_pair(destination, kTaygaIfName),
         rnl::RouteBuilder{}
             .setDestination(destination)
-            .setProtocolId(98)
+            .setProtocolId(kMeshRouteProtocolId)
             .setRouteIfIndex(taygaIfIndex)
             .setRouteIfName(kTaygaIfName)
             .buildLinkRoute());
@@ -216,21 +505,22 @@ SyncRoutes80211s::doSyncRoutes() {
       meshIfIndex, meshAddrs, AF_INET6, RT_SCOPE_UNIVERSE);
 
   if (isGateBeforeRouteSync_ != isGate) {
-    netlinkSocket_->syncUnicastRoutes(98, unicastRouteDb).get();
-    netlinkSocket_->syncLinkRoutes(98, linkRouteDb).get();
+    netlinkSocket_->syncUnicastRoutes(kMeshRouteProtocolId, meshRouteDb_)
+        .get();
+    netlinkSocket_->syncLinkRoutes(kMeshRouteProtocolId, linkRouteDb).get();
   }
 
   destination = std::make_pair<folly::IPAddress, uint8_t>(
       folly::IPAddressV6{"fd00:ffff::"}, 96);
 
-  // Ensure tayga interface is present and up
-  if (taygaIfIndex != 0 && taygaIfUp) {
+  folly::Optional<rnl::Route> gateRoute;
+  if (taygaRoutable) {
     if (isGate) {
       linkRouteDb.emplace(
           std::make_pair(destination, kTaygaIfName),
           rnl::RouteBuilder{}
               .setDestination(destination)
-              .setProtocolId(98)
+              .setProtocolId(kMeshRouteProtocolId)
               .setRouteIfIndex(taygaIfIndex)
               .setRouteIfName(kTaygaIfName)
               .buildLinkRoute());
@@ -243,29 +533,47 @@ SyncRoutes80211s::doSyncRoutes() {
           std::make_pair(defaultV4Prefix, kTaygaIfName),
           rnl::RouteBuilder{}
               .setDestination(defaultV4Prefix)
-              .setProtocolId(98)
+              .setProtocolId(kMeshRouteProtocolId)
               .setMtu(1500)
               .setAdvMss(1460)
               .setRouteIfIndex(taygaIfIndex)
               .setRouteIfName(kTaygaIfName)
               .buildLinkRoute());
 
-      unicastRouteDb.emplace(
-          destination,
-          rnl::RouteBuilder{}
-              .setDestination(destination)
-              .setProtocolId(98)
-              .addNextHop(rnl::NextHopBuilder{}
-                              .setGateway(folly::IPAddressV6{
-                                  folly::IPAddressV6::LinkLocalTag::LINK_LOCAL,
-                                  meshPaths.at(currentGate_->first).nextHop})
-                              .setIfIndex(meshIfIndex)
-                              .build())
-              .build());
+      if (multipathGates_ > 1) {
+        gateWeights_ = stabilizeGateNextHopWeights(
+            gateWeights_,
+            getGateNextHopWeights(selectMultipathGates(gatePaths)));
+        gateRoute =
+            buildMultipathMeshRoute(destination, gateWeights_, meshIfIndex);
+      } else {
+        gateRoute =
+            buildMeshRoute(destination, currentGateNextHop, meshIfIndex);
+      }
     }
   }
+  if (!gateRoute) {
+    gateWeights_.clear();
+  }
   isGateBeforeRouteSync_ = isGate;
 
-  netlinkSocket_->syncUnicastRoutes(98, std::move(unicastRouteDb)).get();
-  netlinkSocket_->syncLinkRoutes(98, std::move(linkRouteDb)).get();
+  if (fullSync) {
+    auto unicastRouteDb = meshRouteDb_;
+    if (gateRoute) {
+      unicastRouteDb.emplace(destination, *gateRoute);
+    }
+    netlinkSocket_
+        ->syncUnicastRoutes(kMeshRouteProtocolId, std::move(unicastRouteDb))
+        .get();
+  } else if (gateRoute) {
+    if (!gateRoute_ || !(*gateRoute_ == *gateRoute)) {
+      netlinkSocket_->addRoute(*gateRoute).get();
+    }
+  } else if (gateRoute_) {
+    netlinkSocket_->delRoute(*gateRoute_).get();
+  }
+  gateRoute_ = std::move(gateRoute);
+
+  netlinkSocket_->syncLinkRoutes(kMeshRouteProtocolId, std::move(linkRouteDb))
+      .get();
 }
@@ -8,6 +8,9 @@
 #pragma once
 
 #include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/EventBase.h>
@@ -24,28 +27,87 @@ class SyncRoutes80211s {
       Routing* routing,
       rnl::NetlinkSocket* netlinkSocket,
       folly::MacAddress nodeAddr,
-      const std::string& interface);
+      const std::string& interface,
+      uint32_t multipathGates);
 
   // This class should never be copied; remove default copy/move
   SyncRoutes80211s() = delete;
-  ~SyncRoutes80211s() = default;
+  ~SyncRoutes80211s();
   SyncRoutes80211s(const SyncRoutes80211s&) = delete;
   SyncRoutes80211s(SyncRoutes80211s&&) = delete;
   SyncRoutes80211s& operator=(const SyncRoutes80211s&) = delete;
   SyncRoutes80211s& operator=(SyncRoutes80211s&&) = delete;
 
+  // Request a route sync soon, e.g. because a mesh path changed. Requests made
+  // within the coalescing window are served by a single sync, and syncs are
+  // at least kMinSyncRoutesInterval apart. Must be called from the EventBase
+  // thread.
+  void scheduleSyncRoutes();
+
+  // Weights for a multipath route over the given gate paths, in inverse
+  // proportion to their load adjusted metrics. Gates reached through the same
+  // next hop add up. Weights are between 1 and kMaxGateWeight.
+  static std::unordered_map<folly::MacAddress, uint8_t> getGateNextHopWeights(
+      const std::vector<Routing::MeshPath>& gatePaths);
+
+  // Returns current unless the next hops differ, or one of the weights
+  // differs from its current value by more than kGateWeightHysteresis
+  static std::unordered_map<folly::MacAddress, uint8_t>
+  stabilizeGateNextHopWeights(
+      const std::unordered_map<folly::MacAddress, uint8_t>& current,
+      const std::unordered_map<folly::MacAddress, uint8_t>& weights);
+
+  static constexpr uint8_t kMaxGateWeight{16};
+
  private:
   void doSyncRoutes();
 
+  // Rebuilds meshRouteDb_ from a full dump of the Routing mesh paths
+  void rebuildMeshRoutes(int meshIfIndex, bool taygaRoutable);
+
+  // Applies journaled mesh path changes to meshRouteDb_ and the kernel
+  void applyMeshPathChanges(
+      const std::vector<Routing::MeshPathChange>& changes,
+      int meshIfIndex,
+      bool taygaRoutable);
+
+  // Picks the multipathGates_ best gates by load adjusted metric, favoring
+  // current members
+  std::vector<Routing::MeshPath> selectMultipathGates(
+      const std::vector<Routing::MeshPath>& gatePaths);
+
   Routing* routing_;
   folly::MacAddress nodeAddr_;
   const std::string& interface_;
 
+  // Fires every kSyncRoutesInterval as a fallback, or at the end of the
+  // coalescing window after scheduleSyncRoutes()
   std::unique_ptr<folly::AsyncTimeout> syncRoutesTimer_;
+  bool syncRoutesScheduled_{false};
   rnl::NetlinkSocket* netlinkSocket_;
 
   folly::Optional<std::pair<folly::MacAddress, uint32_t>> currentGate_;
+  // Number of gates the gate route is spread across, 1 disables multipath
+  const uint32_t multipathGates_;
+  std::unordered_set<folly::MacAddress> multipathGateSet_;
+  // Weights the gate route was last built with
+  std::unordered_map<folly::MacAddress, uint8_t> gateWeights_;
+  // fib_multipath_hash_policy before we changed it, restored on destruction
+  folly::Optional<std::string> previousHashPolicy_;
   bool isGateBeforeRouteSync_{false};
+
+  // Per-destination mesh routes as last programmed. Between full syncs this is
+  // kept up to date from the Routing change journal.
+  rnl::NlUnicastRoutes meshRouteDb_;
+  folly::Optional<rnl::Route> gateRoute_;
+
+  // State the last full sync was computed with; a change forces a full sync
+  int meshIfIndex_{0};
+  bool taygaRoutable_{false};
+  folly::Optional<std::chrono::steady_clock::time_point> lastFullSyncTime_;
+
+  // Start of the last sync, full or not
+  folly::Optional<std::chrono::steady_clock::time_point> lastSyncTime_;
 };
 
 } // namespace fbmeshd
@@ -7,10 +7,44 @@
 
 #include "UDPRoutingPacketTransport.h"
 
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
 #include <folly/Format.h>
+#include <folly/IPAddressV6.h>
+#include <folly/String.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
 
 using namespace fbmeshd;
 
+namespace {
+
+// Datagrams read per recvmmsg()/sendmmsg() call
+const size_t kBatchSize{32};
+
+// Upper bound for received datagrams, larger than any frame Routing sends
+const size_t kMaxDatagramSize{2048};
+
+// Stop reading after this many full batches to let other events run
+const size_t kMaxRecvBatchesPerWakeup{4};
+
+// Kernel limits for a single UDP GSO send
+const size_t kMaxGsoSegments{64};
+const size_t kMaxGsoSize{65000};
+
+} // namespace
+
 UDPRoutingPacketTransport::UDPRoutingPacketTransport(
     folly::EventBase* evb,
     const std::string& interface,
@@ -18,52 +52,245 @@ UDPRoutingPacketTransport::UDPRoutingPacketTransport(
     int32_t tos)
     : evb_{evb},
       interface_{interface},
-      serverSocket_{evb_},
-      clientSocket_{evb_} {
-  evb_->runInEventBaseThread([this, port, tos]() {
-    serverSocket_.bind(folly::SocketAddress{"::", port});
-    serverSocket_.addListener(evb_, this);
-    serverSocket_.listen();
-
-    clientSocket_.bind(folly::SocketAddress("::", 0));
-    clientSocket_.setTrafficClass(tos);
+      port_{port},
+      broadcastAddress_{
+          folly::IPAddressV6{folly::sformat("ff02::1%{}", interface)},
+          port} {
+  serverFd_ = ::socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  CHECK_NE(serverFd_, -1);
+  const int one{1};
+  CHECK_EQ(
+      ::setsockopt(serverFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)), 0);
+  sockaddr_in6 serverAddr{};
+  serverAddr.sin6_family = AF_INET6;
+  serverAddr.sin6_addr = in6addr_any;
+  serverAddr.sin6_port = htons(port_);
+  CHECK_EQ(
+      ::bind(
+          serverFd_,
+          reinterpret_cast<const sockaddr*>(&serverAddr),
+          sizeof(serverAddr)),
+      0)
+      << folly::errnoStr(errno);
+
+  clientFd_ = ::socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  CHECK_NE(clientFd_, -1);
+  CHECK_EQ(
+      ::setsockopt(clientFd_, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos)),
+      0);
+
+  int gsoSize{0};
+  socklen_t gsoSizeLen{sizeof(gsoSize)};
+  gsoSupported_ = ::getsockopt(
+                      clientFd_,
+                      IPPROTO_UDP,
+                      UDP_SEGMENT,
+                      &gsoSize,
+                      &gsoSizeLen) == 0;
+  VLOG(1) << "UDP GSO " << (gsoSupported_ ? "supported" : "not supported")
+          << " for routing packets";
+
+  evb_->runInEventBaseThread([this]() {
+    initHandler(evb_, folly::NetworkSocket::fromFd(serverFd_));
+    registerHandler(folly::EventHandler::READ | folly::EventHandler::PERSIST);
   });
 }
 
+UDPRoutingPacketTransport::~UDPRoutingPacketTransport() {
+  unregisterHandler();
+  ::close(serverFd_);
+  ::close(clientFd_);
+}
+
 void
-UDPRoutingPacketTransport::onDataAvailable(
-    std::shared_ptr<folly::AsyncUDPSocket> /* socket */,
-    const folly::SocketAddress& client,
-    std::unique_ptr<folly::IOBuf> data,
-#ifdef USE_ON_DATA_AVAILABLE
-    bool /* truncated */,
-    OnDataAvailableParams) noexcept {
-#else
-    bool /* truncated */) noexcept {
-#endif
-  if (receivePacketCallback_) {
-    (*receivePacketCallback_)(
-        *client.getIPAddress().asV6().getMacAddressFromLinkLocal(),
-        std::move(data));
+UDPRoutingPacketTransport::handlerReady(uint16_t /* events */) noexcept {
+  std::array<mmsghdr, kBatchSize> msgs;
+  std::array<iovec, kBatchSize> iovecs;
+  std::array<sockaddr_in6, kBatchSize> addrs;
+
+  for (size_t batch = 0; batch < kMaxRecvBatchesPerWakeup; batch++) {
+    // Reuse the buffer unless a receiver kept one of the previous datagrams
+    if (!recvBuffer_ || recvBuffer_->isShared()) {
+      recvBuffer_ = folly::IOBuf::create(kBatchSize * kMaxDatagramSize);
+    }
+
+    std::memset(msgs.data(), 0, sizeof(msgs));
+    for (size_t i = 0; i < kBatchSize; i++) {
+      iovecs[i].iov_base = recvBuffer_->writableData() + i * kMaxDatagramSize;
+      iovecs[i].iov_len = kMaxDatagramSize;
+      msgs[i].msg_hdr.msg_iov = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    }
+
+    const int received =
+        ::recvmmsg(serverFd_, msgs.data(), kBatchSize, MSG_DONTWAIT, nullptr);
+    if (received <= 0) {
+      if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        VLOG(1) << "recvmmsg failed: " << folly::errnoStr(errno);
+      }
+      return;
+    }
+
+    for (int i = 0; i < received; i++) {
+      if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        VLOG(8) << "discarding truncated routing packet";
+        continue;
+      }
+      folly::SocketAddress client;
+      client.setFromSockaddr(
+          reinterpret_cast<const sockaddr*>(&addrs[i]),
+          msgs[i].msg_hdr.msg_namelen);
+      const auto sa =
+          client.getIPAddress().asV6().getMacAddressFromLinkLocal();
+      if (!sa || !receivePacketCallback_) {
+        continue;
+      }
+
+      const size_t offset{i * kMaxDatagramSize};
+      auto data = recvBuffer_->cloneOne();
+      data->append(offset + msgs[i].msg_len);
+      data->trimStart(offset);
+      (*receivePacketCallback_)(*sa, std::move(data));
+    }
+
+    if (static_cast<size_t>(received) < kBatchSize) {
+      return;
+    }
   }
 }
 
+const folly::SocketAddress&
+UDPRoutingPacketTransport::getDestination(folly::MacAddress da) {
+  if (da.isBroadcast()) {
+    return broadcastAddress_;
+  }
+  auto it = addressCache_.find(da);
+  if (it == addressCache_.end()) {
+    it = addressCache_
+             .emplace(
+                 da,
+                 folly::SocketAddress{
+                     folly::IPAddressV6{folly::sformat(
+                         "{}%{}",
+                         folly::IPAddressV6{folly::IPAddressV6::LINK_LOCAL, da}
+                             .str(),
+                         interface_)},
+                     port_})
+             .first;
+  }
+  return it->second;
+}
+
 void
 UDPRoutingPacketTransport::sendPacket(
     folly::MacAddress da, std::unique_ptr<folly::IOBuf> buf) {
-  evb_->runInEventBaseThread([this, da, buf = std::move(buf)]() {
-    const auto destSockAddr = folly::SocketAddress{
-        da.isBroadcast()
-            ? folly::IPAddressV6{folly::sformat("ff02::1%{}", interface_)}
-            : folly::IPAddressV6{folly::sformat(
-                  "{}%{}",
-                  folly::IPAddressV6{folly::IPAddressV6::LINK_LOCAL, da}.str(),
-                  interface_)},
-        6668};
-    clientSocket_.write(destSockAddr, std::move(buf));
+  if (evb_->isInEventBaseThread()) {
+    queueWrite(da, std::move(buf));
+    return;
+  }
+  evb_->runInEventBaseThread([this, da, buf = std::move(buf)]() mutable {
+    queueWrite(da, std::move(buf));
   });
 }
 
+void
+UDPRoutingPacketTransport::queueWrite(
+    folly::MacAddress da, std::unique_ptr<folly::IOBuf> buf) {
+  buf->coalesce();
+  writeQueue_.emplace_back(&getDestination(da), std::move(buf));
+  if (!flushWritesCallback_.isLoopCallbackScheduled()) {
+    evb_->runInLoop(&flushWritesCallback_, true);
+  }
+}
+
+void
+UDPRoutingPacketTransport::flushWrites() {
+  auto writes = std::move(writeQueue_);
+  writeQueue_.clear();
+  size_t next{0};
+  while (next < writes.size()) {
+    next = sendWrites(writes, next);
+  }
+}
+
+size_t
+UDPRoutingPacketTransport::sendWrites(
+    std::vector<QueuedWrite>& writes, size_t begin) {
+  std::array<mmsghdr, kBatchSize> msgs;
+  std::array<sockaddr_storage, kBatchSize> addrs;
+  std::array<std::array<iovec, kMaxGsoSegments>, kBatchSize> iovecs;
+  std::array<std::array<char, CMSG_SPACE(sizeof(uint16_t))>, kBatchSize>
+      controls;
+  // Index one past the last write of each message
+  std::array<size_t, kBatchSize> ends;
+  std::memset(msgs.data(), 0, sizeof(msgs));
+
+  size_t numMsgs{0};
+  size_t next{begin};
+  while (numMsgs < kBatchSize && next < writes.size()) {
+    // Group equally sized writes to the same destination into one GSO
+    // message; only the last segment may be shorter
+    const auto dst = writes[next].first;
+    const size_t segmentSize{writes[next].second->length()};
+    size_t numSegments{0};
+    size_t totalSize{0};
+    do {
+      const auto& buf = writes[next].second;
+      iovecs[numMsgs][numSegments].iov_base =
+          const_cast<uint8_t*>(buf->data());
+      iovecs[numMsgs][numSegments].iov_len = buf->length();
+      totalSize += buf->length();
+      numSegments++;
+      next++;
+    } while (gsoSupported_ && next < writes.size() &&
+             numSegments < kMaxGsoSegments && writes[next].first == dst &&
+             writes[next - 1].second->length() == segmentSize &&
+             writes[next].second->length() <= segmentSize &&
+             totalSize + writes[next].second->length() <= kMaxGsoSize);
+
+    auto& hdr = msgs[numMsgs].msg_hdr;
+    hdr.msg_namelen = dst->getAddress(&addrs[numMsgs]);
+    hdr.msg_name = &addrs[numMsgs];
+    hdr.msg_iov = iovecs[numMsgs].data();
+    hdr.msg_iovlen = numSegments;
+    if (numSegments > 1) {
+      hdr.msg_control = controls[numMsgs].data();
+      hdr.msg_controllen = controls[numMsgs].size();
+      auto cmsg = CMSG_FIRSTHDR(&hdr);
+      cmsg->cmsg_level = IPPROTO_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      const uint16_t gsoSize = segmentSize;
+      std::memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+    }
+    ends[numMsgs] = next;
+    numMsgs++;
+  }
+
+  const int sent = ::sendmmsg(clientFd_, msgs.data(), numMsgs, 0);
+  if (sent > 0) {
+    return ends[sent - 1];
+  }
+
+  if (errno == EAGAIN || errno == EWOULDBLOCK) {
+    VLOG(8) << "routing socket buffer full, dropping "
+            << writes.size() - begin << " packets";
+    return writes.size();
+  }
+  if (msgs[0].msg_hdr.msg_iovlen > 1) {
+    // The interface can not segment for us, e.g. no checksum offload
+    LOG(WARNING) << "UDP GSO send failed, disabling it: "
+                 << folly::errnoStr(errno);
+    gsoSupported_ = false;
+    return begin;
+  }
+  VLOG(1) << "failed to send routing packet to "
+          << writes[begin].first->describe() << ": " << folly::errnoStr(errno);
+  return ends[0];
+}
+
 void
 UDPRoutingPacketTransport::setReceivePacketCallback(
     std::function<void(folly::MacAddress, std::unique_ptr<folly::IOBuf>)> cb) {
@@ -7,15 +7,29 @@
 
 #pragma once
 
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include <folly/MacAddress.h>
+#include <folly/Optional.h>
+#include <folly/SocketAddress.h>
 #include <folly/io/IOBuf.h>
-#include <folly/io/async/AsyncUDPServerSocket.h>
-#include <folly/io/async/AsyncUDPSocket.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
 
 namespace fbmeshd {
 
-class UDPRoutingPacketTransport : public folly::AsyncUDPServerSocket::Callback {
+/*
+ * Sends and receives routing frames over UDP on the mesh interface.
+ *
+ * Writes queued during an event loop iteration are flushed together at its end
+ * with sendmmsg(), and runs of equally sized datagrams to the same neighbor
+ * (e.g. a burst of fixed format PANNs to ff02::1) go out as a single UDP GSO
+ * send where the kernel supports it. Reads drain the socket with recvmmsg()
+ * into a buffer that is reused as long as no receiver holds on to a datagram.
+ */
+class UDPRoutingPacketTransport : public folly::EventHandler {
  public:
   UDPRoutingPacketTransport(
       folly::EventBase* evb,
@@ -23,6 +37,13 @@ class UDPRoutingPacketTransport : public folly::AsyncUDPServerSocket::Callback {
       uint16_t port,
       int32_t tos);
 
+  ~UDPRoutingPacketTransport() override;
+  UDPRoutingPacketTransport(const UDPRoutingPacketTransport&) = delete;
+  UDPRoutingPacketTransport(UDPRoutingPacketTransport&&) = delete;
+  UDPRoutingPacketTransport& operator=(const UDPRoutingPacketTransport&) =
+      delete;
+  UDPRoutingPacketTransport& operator=(UDPRoutingPacketTransport&&) = delete;
+
   void sendPacket(folly::MacAddress da, std::unique_ptr<folly::IOBuf> buf);
 
   void setReceivePacketCallback(
@@ -30,30 +51,58 @@ class UDPRoutingPacketTransport : public folly::AsyncUDPServerSocket::Callback {
   void resetReceivePacketCallback();
 
  private:
-  virtual void
-  onListenStarted() noexcept override {}
-
-  virtual void
-  onListenStopped() noexcept override {}
-
-  virtual void onDataAvailable(
-      std::shared_ptr<folly::AsyncUDPSocket> socket,
-      const folly::SocketAddress& client,
-      std::unique_ptr<folly::IOBuf> data,
-#ifdef USE_ON_DATA_AVAILABLE
-      bool truncated,
-      OnDataAvailableParams params) noexcept override;
-#else
-      bool truncated) noexcept override;
-#endif
+  using QueuedWrite =
+      std::pair<const folly::SocketAddress*, std::unique_ptr<folly::IOBuf>>;
+
+  class FlushWritesCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit FlushWritesCallback(UDPRoutingPacketTransport* parent)
+        : parent_{parent} {}
+
+    void
+    runLoopCallback() noexcept override {
+      parent_->flushWrites();
+    }
+
+   private:
+    UDPRoutingPacketTransport* parent_;
+  };
+
+  void handlerReady(uint16_t events) noexcept override;
+
+  // Returns the address to send to for da, resolved once per neighbor
+  const folly::SocketAddress& getDestination(folly::MacAddress da);
+
+  void queueWrite(folly::MacAddress da, std::unique_ptr<folly::IOBuf> buf);
+  void flushWrites();
+
+  // Send the writes starting at begin with one sendmmsg() call. Returns the
+  // index of the first write that was neither sent nor dropped.
+  size_t sendWrites(std::vector<QueuedWrite>& writes, size_t begin);
 
   folly::EventBase* evb_;
 
   const std::string& interface_;
 
-  folly::AsyncUDPServerSocket serverSocket_;
+  uint16_t port_;
+
+  int serverFd_{-1};
+
+  int clientFd_{-1};
+
+  bool gsoSupported_{false};
+
+  folly::SocketAddress broadcastAddress_;
+
+  // Never erased, so pointers to the addresses stay valid
+  std::unordered_map<folly::MacAddress, folly::SocketAddress> addressCache_;
+
+  std::vector<QueuedWrite> writeQueue_;
+
+  FlushWritesCallback flushWritesCallback_{this};
 
-  folly::AsyncUDPSocket clientSocket_;
+  // Datagrams are received into slices of this buffer, see handlerReady()
+  std::unique_ptr<folly::IOBuf> recvBuffer_;
 
   folly::Optional<
       std::function<void(folly::MacAddress, std::unique_ptr<folly::IOBuf>)>>
@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <netlink/genl/ctrl.h> // @manual
+
+#include <folly/futures/Future.h>
+#include <folly/io/async/EventBase.h>
+
+#include <fbmeshd/nl/AsyncGenericNetlinkSocket.h>
+#include <fbmeshd/nl/GenericNetlinkFamily.h>
+#include <fbmeshd/nl/GenericNetlinkSocket.h>
+
+using namespace std::chrono_literals;
+using namespace fbmeshd;
+
+namespace {
+// The generic netlink controller is always present, so its family dump makes
+// a good stand-in for an nl80211 dump
+std::unique_ptr<GenericNetlinkMessage>
+makeFamilyDumpMessage() {
+  return std::make_unique<GenericNetlinkMessage>(
+      GenericNetlinkFamily::NLCTRL(), CTRL_CMD_GETFAMILY, NLM_F_DUMP);
+}
+} // namespace
+
+class AsyncGenericNetlinkSocketTest : public ::testing::Test {
+ protected:
+  void
+  SetUp() override {
+    sock = std::make_unique<AsyncGenericNetlinkSocket>(&evb, 5s);
+    evbThread = std::thread([this]() { evb.loopForever(); });
+    evb.waitUntilRunning();
+  }
+
+  void
+  TearDown() override {
+    evb.runInEventBaseThreadAndWait([this]() { sock.reset(); });
+    evb.terminateLoopSoon();
+    evbThread.join();
+  }
+
+  folly::EventBase evb;
+  std::thread evbThread;
+  std::unique_ptr<AsyncGenericNetlinkSocket> sock;
+};
+
+TEST_F(AsyncGenericNetlinkSocketTest, ConcurrentDumpsAreMatched) {
+  size_t numFamilies{0};
+  GenericNetlinkSocket::sendCommand(
+      *makeFamilyDumpMessage(), [&numFamilies](const auto&) {
+        numFamilies++;
+        return NL_OK;
+      });
+  ASSERT_GT(numFamilies, 0);
+
+  const size_t numRequests{8};
+  std::vector<std::atomic<size_t>> numReplies(numRequests);
+  std::vector<folly::SemiFuture<folly::Unit>> futures;
+  for (size_t i = 0; i < numRequests; i++) {
+    numReplies[i] = 0;
+    futures.push_back(sock->sendCommand(
+        makeFamilyDumpMessage(), [&numReplies, i](const auto&) {
+          numReplies[i]++;
+          return NL_OK;
+        }));
+  }
+
+  for (size_t i = 0; i < numRequests; i++) {
+    std::move(futures[i]).get(5s);
+    EXPECT_EQ(numFamilies, numReplies[i]);
+  }
+}
+
+TEST_F(AsyncGenericNetlinkSocketTest, ErrorFailsOnlyItsRequest) {
+  auto badMsg = std::make_unique<GenericNetlinkMessage>(
+      GenericNetlinkFamily::NLCTRL(), CTRL_CMD_GETFAMILY);
+  nla_put_string(*badMsg, CTRL_ATTR_FAMILY_NAME, "fbmeshd-no-such-family");
+  auto bad = sock->sendCommand(
+      std::move(badMsg), [](const auto&) { return NL_OK; });
+
+  std::atomic<size_t> numReplies{0};
+  auto good = sock->sendCommand(
+      makeFamilyDumpMessage(), [&numReplies](const auto&) {
+        numReplies++;
+        return NL_OK;
+      });
+
+  EXPECT_THROW(std::move(bad).get(5s), std::runtime_error);
+  std::move(good).get(5s);
+  EXPECT_LT(0, numReplies);
+}
+
+int
+main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbmeshd/routing/GateIndex.h>
+
+using namespace fbmeshd;
+
+namespace {
+const folly::MacAddress kGate1{"02:00:00:00:00:01"};
+const folly::MacAddress kGate2{"02:00:00:00:00:02"};
+const folly::MacAddress kGate3{"02:00:00:00:00:03"};
+
+const auto kAllLive = [](folly::MacAddress) { return true; };
+} // namespace
+
+TEST(GateIndexTest, TopKFollowsMetricUpdates) {
+  GateIndex gates;
+  gates.set(kGate1, 100);
+  gates.set(kGate2, 200);
+  gates.set(kGate3, 300);
+  EXPECT_EQ(3, gates.size());
+
+  EXPECT_TRUE(gates.isInTopK(kGate1, 2, kAllLive));
+  EXPECT_TRUE(gates.isInTopK(kGate2, 2, kAllLive));
+  EXPECT_FALSE(gates.isInTopK(kGate3, 2, kAllLive));
+
+  gates.set(kGate3, 50);
+  EXPECT_EQ(3, gates.size());
+  EXPECT_TRUE(gates.isInTopK(kGate3, 2, kAllLive));
+  EXPECT_FALSE(gates.isInTopK(kGate2, 2, kAllLive));
+
+  gates.erase(kGate1);
+  EXPECT_EQ(2, gates.size());
+  EXPECT_TRUE(gates.isInTopK(kGate2, 2, kAllLive));
+}
+
+TEST(GateIndexTest, QueriesSkipStaleGates) {
+  GateIndex gates;
+  gates.set(kGate1, 100);
+  gates.set(kGate2, 200);
+  gates.set(kGate3, 300);
+
+  const auto gate1Stale = [](folly::MacAddress gate) { return gate != kGate1; };
+  EXPECT_FALSE(gates.isInTopK(kGate1, 2, gate1Stale));
+  EXPECT_TRUE(gates.isInTopK(kGate3, 2, gate1Stale));
+
+  EXPECT_EQ(2, gates.countNoWorseThan(250, kGate3, 10, kAllLive));
+  EXPECT_EQ(1, gates.countNoWorseThan(250, kGate3, 10, gate1Stale));
+  EXPECT_EQ(1, gates.countNoWorseThan(250, kGate1, 10, kAllLive));
+  EXPECT_EQ(1, gates.countNoWorseThan(300, kGate3, 1, kAllLive));
+}
+
+int
+main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
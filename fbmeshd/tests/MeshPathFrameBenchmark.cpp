@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/MacAddress.h>
+#include <folly/init/Init.h>
+
+#include <fbmeshd/routing/MeshPathFrame.h>
+
+using namespace fbmeshd;
+
+namespace {
+
+PannFrame
+makePann() {
+  PannFrame pann;
+  pann.origAddr = folly::MacAddress{"02:00:00:00:00:01"};
+  pann.origSn = 123456;
+  pann.hopCount = 3;
+  pann.ttl = 29;
+  pann.targetAddr = folly::MacAddress::BROADCAST;
+  pann.metric = 4000;
+  pann.isGate = true;
+  return pann;
+}
+
+void
+encode(uint32_t iters, MeshPathFrameType type) {
+  const auto pann = makePann();
+  for (uint32_t i = 0; i < iters; i++) {
+    folly::doNotOptimizeAway(encodePannFrame(pann, type));
+  }
+}
+
+void
+decode(uint32_t iters, MeshPathFrameType type) {
+  std::unique_ptr<folly::IOBuf> buf;
+  BENCHMARK_SUSPEND {
+    buf = encodePannFrame(makePann(), type);
+    buf->trimStart(1);
+  }
+  for (uint32_t i = 0; i < iters; i++) {
+    folly::doNotOptimizeAway(decodePannFrame(type, *buf));
+  }
+}
+
+} // namespace
+
+BENCHMARK(encodeThrift, iters) {
+  encode(iters, MeshPathFrameType::PANN);
+}
+BENCHMARK_RELATIVE(encodeFixed, iters) {
+  encode(iters, MeshPathFrameType::PANN_FIXED);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(decodeThrift, iters) {
+  decode(iters, MeshPathFrameType::PANN);
+}
+BENCHMARK_RELATIVE(decodeFixed, iters) {
+  decode(iters, MeshPathFrameType::PANN_FIXED);
+}
+
+int
+main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,195 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include <fbmeshd/if/gen-cpp2/fbmeshd_types.h>
+#include <fbmeshd/routing/MeshPathFrame.h>
+
+using namespace fbmeshd;
+
+namespace {
+PannFrame
+makePann() {
+  PannFrame pann;
+  pann.origAddr = folly::MacAddress{"02:00:00:00:00:01"};
+  pann.origSn = 0x0102030405060708;
+  pann.hopCount = 3;
+  pann.ttl = 29;
+  pann.targetAddr = folly::MacAddress::BROADCAST;
+  pann.metric = 0xdeadbeef;
+  pann.isGate = true;
+  pann.replyRequested = false;
+  return pann;
+}
+
+PannFrame
+makeGatePann() {
+  auto pann = makePann();
+  pann.gateLoad = GateLoad{100000, 42};
+  return pann;
+}
+
+void
+expectPannEq(const PannFrame& expected, const PannFrame& actual) {
+  EXPECT_EQ(expected.origAddr, actual.origAddr);
+  EXPECT_EQ(expected.origSn, actual.origSn);
+  EXPECT_EQ(expected.hopCount, actual.hopCount);
+  EXPECT_EQ(expected.ttl, actual.ttl);
+  EXPECT_EQ(expected.targetAddr, actual.targetAddr);
+  EXPECT_EQ(expected.metric, actual.metric);
+  EXPECT_EQ(expected.isGate, actual.isGate);
+  EXPECT_EQ(expected.replyRequested, actual.replyRequested);
+  EXPECT_TRUE(expected.gateLoad == actual.gateLoad);
+}
+
+// Strip the frame type byte like Routing::receivePacket() does
+MeshPathFrameType
+popFrameType(folly::IOBuf& buf) {
+  const auto type = static_cast<MeshPathFrameType>(*buf.data());
+  buf.trimStart(1);
+  return type;
+}
+} // namespace
+
+TEST(MeshPathFrameTest, FixedRoundTrip) {
+  const auto pann = makePann();
+  auto buf = encodePannFrame(pann, MeshPathFrameType::PANN_FIXED);
+  EXPECT_EQ(1 + kPannFrameFixedSize, buf->computeChainDataLength());
+
+  const auto type = popFrameType(*buf);
+  EXPECT_EQ(MeshPathFrameType::PANN_FIXED, type);
+  const auto decoded = decodePannFrame(type, *buf);
+  ASSERT_TRUE(decoded.hasValue());
+  expectPannEq(pann, *decoded);
+}
+
+TEST(MeshPathFrameTest, ThriftRoundTrip) {
+  const auto pann = makePann();
+  auto buf = encodePannFrame(pann, MeshPathFrameType::PANN);
+
+  const auto type = popFrameType(*buf);
+  EXPECT_EQ(MeshPathFrameType::PANN, type);
+  const auto decoded = decodePannFrame(type, *buf);
+  ASSERT_TRUE(decoded.hasValue());
+  expectPannEq(pann, *decoded);
+}
+
+TEST(MeshPathFrameTest, GateLoadRoundTrip) {
+  const auto pann = makeGatePann();
+  for (const auto frameType :
+       {MeshPathFrameType::PANN_FIXED, MeshPathFrameType::PANN}) {
+    auto buf = encodePannFrame(pann, frameType);
+    const auto decoded = decodePannFrame(popFrameType(*buf), *buf);
+    ASSERT_TRUE(decoded.hasValue());
+    expectPannEq(pann, *decoded);
+  }
+
+  auto buf = encodePannFrame(pann, MeshPathFrameType::PANN_FIXED);
+  EXPECT_EQ(
+      1 + kPannFrameFixedSize + kPannFrameGateLoadSize,
+      buf->computeChainDataLength());
+}
+
+TEST(MeshPathFrameTest, FixedGateLoadIsIgnoredByOlderNodes) {
+  auto buf = encodePannFrame(makeGatePann(), MeshPathFrameType::PANN_FIXED);
+  popFrameType(*buf);
+  // Older nodes only read the fixed part and the isGate and replyRequested
+  // flags, which must come out as without the gate load
+  auto withoutGateLoad =
+      encodePannFrame(makePann(), MeshPathFrameType::PANN_FIXED);
+  popFrameType(*withoutGateLoad);
+  const auto fixedPart = buf->cloneAsValue().moveToFbString();
+  const auto oldFixedPart = withoutGateLoad->moveToFbString();
+  EXPECT_EQ(
+      oldFixedPart.substr(0, kPannFrameFixedSize - 1),
+      fixedPart.substr(0, kPannFrameFixedSize - 1));
+  EXPECT_EQ(
+      oldFixedPart[kPannFrameFixedSize - 1],
+      fixedPart[kPannFrameFixedSize - 1] & 0x3);
+}
+
+TEST(MeshPathFrameTest, ThriftIsCompatibleWithOlderNodes) {
+  const auto pann = makePann();
+  thrift::MeshPathFramePANN thriftPann{
+      apache::thrift::FRAGILE,
+      pann.origAddr.u64NBO(),
+      pann.origSn,
+      pann.hopCount,
+      pann.ttl,
+      pann.targetAddr.u64NBO(),
+      pann.metric,
+      pann.isGate,
+      pann.replyRequested,
+      0,
+      0,
+  };
+  // Serialized like the schema before the optional gate load fields
+#ifdef USE_THRIFT_FIELD_REF_API
+  thriftPann.gateCapacityKbps_ref().reset();
+  thriftPann.gateUtilization_ref().reset();
+#else
+  thriftPann.__isset.gateCapacityKbps = false;
+  thriftPann.__isset.gateUtilization = false;
+#endif
+  std::string skb;
+  apache::thrift::CompactSerializer::serialize(thriftPann, &skb);
+
+  auto buf = encodePannFrame(pann, MeshPathFrameType::PANN);
+  popFrameType(*buf);
+  EXPECT_EQ(skb, buf->moveToFbString().toStdString());
+}
+
+TEST(MeshPathFrameTest, TruncatedFramesAreRejected) {
+  auto buf = encodePannFrame(makePann(), MeshPathFrameType::PANN_FIXED);
+  const auto type = popFrameType(*buf);
+  buf->trimEnd(1);
+  EXPECT_FALSE(decodePannFrame(type, *buf).hasValue());
+
+  auto thriftBuf = encodePannFrame(makePann(), MeshPathFrameType::PANN);
+  popFrameType(*thriftBuf);
+  thriftBuf->trimEnd(thriftBuf->length() / 2);
+  EXPECT_FALSE(
+      decodePannFrame(MeshPathFrameType::PANN, *thriftBuf).hasValue());
+
+  auto gateBuf =
+      encodePannFrame(makeGatePann(), MeshPathFrameType::PANN_FIXED);
+  popFrameType(*gateBuf);
+  gateBuf->trimEnd(1);
+  EXPECT_FALSE(
+      decodePannFrame(MeshPathFrameType::PANN_FIXED, *gateBuf).hasValue());
+}
+
+TEST(MeshPathFrameTest, AggregateRoundTrip) {
+  std::vector<std::unique_ptr<folly::IOBuf>> frames;
+  frames.push_back(encodePannFrame(makePann(), MeshPathFrameType::PANN_FIXED));
+  frames.push_back(encodePannFrame(makePann(), MeshPathFrameType::PANN));
+
+  auto buf = encodeAggregateFrame(frames);
+  EXPECT_EQ(MeshPathFrameType::AGGREGATE, popFrameType(*buf));
+  // Drop the last byte, the second frame is now truncated
+  buf->trimEnd(1);
+  const auto decoded = decodeAggregateFrame(*buf);
+  ASSERT_EQ(1, decoded.size());
+  EXPECT_EQ(
+      frames[0]->moveToFbString(), decoded[0]->cloneAsValue().moveToFbString());
+}
+
+int
+main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
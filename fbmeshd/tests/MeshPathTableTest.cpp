@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <chrono>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbmeshd/routing/MeshPathTable.h>
+
+using namespace fbmeshd;
+
+namespace {
+const folly::MacAddress kDst1{"02:00:00:00:00:01"};
+const folly::MacAddress kDst2{"02:00:00:00:00:02"};
+const folly::MacAddress kNextHop{"02:00:00:00:01:00"};
+
+folly::MacAddress
+nthMacAddress(uint64_t n) {
+  return folly::MacAddress::fromHBO(0x020000000000 | n);
+}
+} // namespace
+
+TEST(MeshPathTableTest, InsertFindErase) {
+  MeshPathTable table;
+  const auto now = std::chrono::steady_clock::now();
+
+  EXPECT_EQ(MeshPathTable::kNoSlot, table.find(kDst1));
+
+  const auto inserted = table.findOrInsert(kDst1, now);
+  EXPECT_TRUE(inserted.second);
+  EXPECT_EQ(1, table.size());
+  EXPECT_EQ(inserted.first, table.find(kDst1));
+  EXPECT_EQ(kDst1, table.dst(inserted.first));
+  EXPECT_EQ(folly::MacAddress::ZERO, table.nextHop(inserted.first));
+  EXPECT_TRUE(table.expired(inserted.first, now));
+
+  table.setNextHop(inserted.first, kNextHop);
+  table.metric(inserted.first) = 42;
+  table.cold(inserted.first).isGate = true;
+
+  const auto found = table.findOrInsert(kDst1, now);
+  EXPECT_FALSE(found.second);
+  EXPECT_EQ(inserted.first, found.first);
+
+  const auto mpath = table.get(found.first);
+  EXPECT_EQ(kDst1, mpath.dst);
+  EXPECT_EQ(kNextHop, mpath.nextHop);
+  EXPECT_EQ(42, mpath.metric);
+  EXPECT_TRUE(mpath.isGate);
+
+  table.findOrInsert(kDst2, now);
+  table.erase(table.find(kDst1));
+  EXPECT_EQ(1, table.size());
+  EXPECT_EQ(MeshPathTable::kNoSlot, table.find(kDst1));
+  EXPECT_NE(MeshPathTable::kNoSlot, table.find(kDst2));
+}
+
+TEST(MeshPathTableTest, GrowsAndKeepsPaths) {
+  MeshPathTable table;
+  const auto now = std::chrono::steady_clock::now();
+  const uint64_t numPaths{10000};
+
+  for (uint64_t i = 0; i < numPaths; i++) {
+    const auto slot = table.findOrInsert(nthMacAddress(i), now).first;
+    table.metric(slot) = i;
+  }
+  // Erase every other path so that lookups have to probe past erased slots
+  for (uint64_t i = 0; i < numPaths; i += 2) {
+    table.erase(table.find(nthMacAddress(i)));
+  }
+  EXPECT_EQ(numPaths / 2, table.size());
+
+  for (uint64_t i = 0; i < numPaths; i++) {
+    const auto slot = table.find(nthMacAddress(i));
+    if (i % 2 == 0) {
+      EXPECT_EQ(MeshPathTable::kNoSlot, slot);
+    } else {
+      ASSERT_NE(MeshPathTable::kNoSlot, slot);
+      EXPECT_EQ(i, table.metric(slot));
+    }
+  }
+
+  size_t visited{0};
+  table.forEach([&visited](size_t) { visited++; });
+  EXPECT_EQ(numPaths / 2, visited);
+
+  const auto snapshot =
+      table.snapshot([&table](size_t slot) { return table.metric(slot) < 10; });
+  EXPECT_EQ(5, snapshot.size());
+}
+
+int
+main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,300 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/MacAddress.h>
+#include <folly/init/Init.h>
+#include <folly/io/async/EventBase.h>
+
+#include <fbmeshd/gateway-connectivity-monitor/StatsClient.h>
+#include <fbmeshd/routing/GateIndex.h>
+#include <fbmeshd/routing/MeshPathFrame.h>
+#include <fbmeshd/routing/MeshPathTable.h>
+#include <fbmeshd/routing/MetricManager.h>
+#include <fbmeshd/routing/Routing.h>
+
+using namespace fbmeshd;
+
+namespace {
+
+const size_t kTopK{2};
+
+const size_t kNumDestinations{10000};
+
+const size_t kNumStations{32};
+const size_t kNumPannOrigins{1000};
+// PANNs processed per event loop iteration
+const size_t kPannsPerLoop{64};
+
+folly::MacAddress
+nthMacAddress(uint64_t n) {
+  return folly::MacAddress::fromHBO(0x020000000000 | n);
+}
+
+uint32_t
+nthMetric(uint64_t n) {
+  return static_cast<uint32_t>((n * 2654435761) % 100000);
+}
+
+// The per-query approach GateIndex replaced: collect every gate and sort
+bool
+isInTopKBySorting(
+    const std::unordered_map<folly::MacAddress, uint32_t>& gates,
+    folly::MacAddress mac) {
+  std::vector<std::pair<uint32_t, folly::MacAddress>> ret;
+  for (const auto& gate : gates) {
+    ret.emplace_back(gate.second, gate.first);
+  }
+  std::sort(ret.begin(), ret.end());
+  for (size_t i = 0; i < kTopK && i < ret.size(); i++) {
+    if (ret[i].second == mac) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+topKBySorting(uint32_t iters, size_t numGates) {
+  std::unordered_map<folly::MacAddress, uint32_t> gates;
+  BENCHMARK_SUSPEND {
+    for (size_t i = 0; i < numGates; i++) {
+      gates.emplace(nthMacAddress(i), nthMetric(i));
+    }
+  }
+  for (uint32_t i = 0; i < iters; i++) {
+    // A PANN refreshes one gate's metric and checks it before and after
+    const auto mac = nthMacAddress(i % numGates);
+    folly::doNotOptimizeAway(isInTopKBySorting(gates, mac));
+    gates[mac] = nthMetric(i + numGates);
+    folly::doNotOptimizeAway(isInTopKBySorting(gates, mac));
+  }
+}
+
+void
+topKByGateIndex(uint32_t iters, size_t numGates) {
+  GateIndex gates;
+  BENCHMARK_SUSPEND {
+    for (size_t i = 0; i < numGates; i++) {
+      gates.set(nthMacAddress(i), nthMetric(i));
+    }
+  }
+  const auto isLive = [](folly::MacAddress) { return true; };
+  for (uint32_t i = 0; i < iters; i++) {
+    const auto mac = nthMacAddress(i % numGates);
+    folly::doNotOptimizeAway(gates.isInTopK(mac, kTopK, isLive));
+    gates.set(mac, nthMetric(i + numGates));
+    folly::doNotOptimizeAway(gates.isInTopK(mac, kTopK, isLive));
+  }
+}
+
+void
+pannUpdateUnorderedMap(uint32_t iters) {
+  std::unordered_map<folly::MacAddress, MeshPath> paths;
+  const auto now = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iters; i++) {
+    const auto dst = nthMacAddress(i % kNumDestinations);
+    auto& mpath = paths
+                      .emplace(
+                          std::piecewise_construct,
+                          std::forward_as_tuple(dst),
+                          std::forward_as_tuple(dst))
+                      .first->second;
+    if (!mpath.expired(now) && mpath.sn > i) {
+      continue;
+    }
+    mpath.sn = i;
+    mpath.metric = nthMetric(i);
+    mpath.nextHop = nthMacAddress(i % 16);
+    mpath.expTime = now + std::chrono::seconds{30};
+  }
+  folly::doNotOptimizeAway(paths.size());
+}
+
+void
+pannUpdateMeshPathTable(uint32_t iters) {
+  MeshPathTable paths;
+  const auto now = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iters; i++) {
+    const auto slot =
+        paths.findOrInsert(nthMacAddress(i % kNumDestinations), now).first;
+    if (!paths.expired(slot, now) && paths.sn(slot) > i) {
+      continue;
+    }
+    paths.sn(slot) = i;
+    paths.metric(slot) = nthMetric(i);
+    paths.setNextHop(slot, nthMacAddress(i % 16));
+    paths.expTime(slot) = now + std::chrono::seconds{30};
+  }
+  folly::doNotOptimizeAway(paths.size());
+}
+
+// The copy Routing::getMeshPaths() used to make for every route sync
+void
+snapshotUnorderedMap(uint32_t iters) {
+  std::unordered_map<folly::MacAddress, MeshPath> paths;
+  const auto now = std::chrono::steady_clock::now();
+  BENCHMARK_SUSPEND {
+    for (size_t i = 0; i < kNumDestinations; i++) {
+      MeshPath mpath{nthMacAddress(i)};
+      mpath.nextHop = nthMacAddress(i % 16);
+      mpath.expTime = now + std::chrono::seconds{30};
+      paths.emplace(mpath.dst, mpath);
+    }
+  }
+  for (uint32_t i = 0; i < iters; i++) {
+    std::unordered_map<folly::MacAddress, MeshPath> snapshot;
+    for (const auto& m : paths) {
+      if (!m.second.expired(now)) {
+        snapshot.emplace(m.first, m.second);
+      }
+    }
+    folly::doNotOptimizeAway(snapshot.size());
+  }
+}
+
+void
+snapshotMeshPathTable(uint32_t iters) {
+  MeshPathTable paths;
+  const auto now = std::chrono::steady_clock::now();
+  BENCHMARK_SUSPEND {
+    for (size_t i = 0; i < kNumDestinations; i++) {
+      const auto slot = paths.findOrInsert(nthMacAddress(i), now).first;
+      paths.setNextHop(slot, nthMacAddress(i % 16));
+      paths.expTime(slot) = now + std::chrono::seconds{30};
+    }
+  }
+  for (uint32_t i = 0; i < iters; i++) {
+    const auto snapshot = paths.snapshot(
+        [&paths, now](size_t slot) { return !paths.expired(slot, now); });
+    folly::doNotOptimizeAway(snapshot.size());
+  }
+}
+
+// Builds the table on every call, like the station dump getLinkMetrics() did
+// for every PANN (minus the netlink round trip itself)
+class DumpingMetricManager : public MetricManager {
+ public:
+  std::unordered_map<folly::MacAddress, uint32_t>
+  getLinkMetrics() override {
+    std::unordered_map<folly::MacAddress, uint32_t> metrics;
+    for (size_t i = 0; i < kNumStations; i++) {
+      metrics.emplace(nthMacAddress(i), nthMetric(i));
+    }
+    return metrics;
+  }
+};
+
+class CachedMetricManager : public DumpingMetricManager {
+ public:
+  CachedMetricManager() {
+    auto linkMetrics = std::make_shared<LinkMetrics>();
+    linkMetrics->metrics = getLinkMetrics();
+    linkMetrics_ = std::move(linkMetrics);
+  }
+
+  std::shared_ptr<const LinkMetrics>
+  getLinkMetricTable() override {
+    return linkMetrics_;
+  }
+
+ private:
+  std::shared_ptr<const LinkMetrics> linkMetrics_;
+};
+
+void
+pannProcessing(uint32_t iters, MetricManager& metricManager) {
+  folly::EventBase evb;
+  StatsClient statsClient;
+  std::unique_ptr<Routing> routing;
+  std::vector<std::unique_ptr<folly::IOBuf>> frames;
+  BENCHMARK_SUSPEND {
+    routing = std::make_unique<Routing>(
+        &evb,
+        &metricManager,
+        nthMacAddress(kNumDestinations + kNumPannOrigins),
+        32,
+        std::chrono::seconds{30},
+        std::chrono::seconds{10},
+        MeshPathFrameType::PANN_FIXED,
+        std::chrono::milliseconds{0},
+        statsClient);
+    evb.loopOnce(EVLOOP_NONBLOCK);
+    for (size_t i = 0; i < kNumPannOrigins; i++) {
+      PannFrame pann;
+      pann.origAddr = nthMacAddress(kNumDestinations + i);
+      pann.origSn = 1;
+      pann.ttl = 32;
+      pann.targetAddr = folly::MacAddress::BROADCAST;
+      pann.metric = nthMetric(i);
+      frames.push_back(encodePannFrame(pann, MeshPathFrameType::PANN_FIXED));
+    }
+  }
+
+  const auto neighbor = nthMacAddress(0);
+  for (uint32_t i = 0; i < iters; i++) {
+    routing->receivePacket(neighbor, frames[i % frames.size()]->clone());
+    if (i % kPannsPerLoop == kPannsPerLoop - 1) {
+      evb.loopOnce(EVLOOP_NONBLOCK);
+    }
+  }
+
+  BENCHMARK_SUSPEND {
+    routing.reset();
+  }
+}
+
+} // namespace
+
+BENCHMARK(pannProcessingWithStationDump, iters) {
+  DumpingMetricManager metricManager;
+  pannProcessing(iters, metricManager);
+}
+BENCHMARK_RELATIVE(pannProcessingWithLinkMetricTable, iters) {
+  CachedMetricManager metricManager;
+  pannProcessing(iters, metricManager);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(pannUpdateUnorderedMap, iters) {
+  pannUpdateUnorderedMap(iters);
+}
+BENCHMARK_RELATIVE(pannUpdateMeshPathTable, iters) {
+  pannUpdateMeshPathTable(iters);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(snapshotUnorderedMap, iters) {
+  snapshotUnorderedMap(iters);
+}
+BENCHMARK_RELATIVE(snapshotMeshPathTable, iters) {
+  snapshotMeshPathTable(iters);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(topKBySorting, 10)
+BENCHMARK_RELATIVE_PARAM(topKByGateIndex, 10)
+BENCHMARK_PARAM(topKBySorting, 100)
+BENCHMARK_RELATIVE_PARAM(topKByGateIndex, 100)
+BENCHMARK_PARAM(topKBySorting, 1000)
+BENCHMARK_RELATIVE_PARAM(topKByGateIndex, 1000)
+
+int
+main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,359 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <folly/MacAddress.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventBase.h>
+
+#include <fbmeshd/routing/MeshPathFrame.h>
+#include <fbmeshd/routing/MetricManager.h>
+#include <fbmeshd/routing/Routing.h>
+
+using namespace std::chrono_literals;
+using namespace fbmeshd;
+
+namespace {
+const folly::MacAddress kNodeAddr{"02:00:00:00:00:01"};
+const folly::MacAddress kNeighborAddr{"02:00:00:00:00:02"};
+const folly::MacAddress kRemoteAddr{"02:00:00:00:00:03"};
+const folly::MacAddress kOtherNeighborAddr{"02:00:00:00:00:05"};
+const auto kActivePathTimeout{200ms};
+} // namespace
+
+class FakeMetricManager : public MetricManager {
+ public:
+  std::unordered_map<folly::MacAddress, uint32_t>
+  getLinkMetrics() override {
+    return linkMetrics;
+  }
+
+  std::unordered_map<folly::MacAddress, uint32_t> linkMetrics{
+      {kNeighborAddr, 100}, {kOtherNeighborAddr, 200}};
+};
+
+class RoutingTest : public ::testing::Test {
+ protected:
+  void
+  SetUp() override {
+    routing = std::make_unique<Routing>(
+        &evb,
+        &metricManager,
+        kNodeAddr,
+        32,
+        kActivePathTimeout,
+        std::chrono::milliseconds{10s},
+        Routing::MeshPathFrameType::PANN,
+        0ms,
+        statsClient);
+    evbThread = std::thread([this]() { evb.loopForever(); });
+    evb.waitUntilRunning();
+  }
+
+  void
+  TearDown() override {
+    evb.runInEventBaseThreadAndWait([this]() { routing.reset(); });
+    evb.terminateLoopSoon();
+    evbThread.join();
+  }
+
+  void
+  receivePann(
+      folly::MacAddress from,
+      folly::MacAddress origAddr,
+      bool isGate,
+      folly::Optional<GateLoad> gateLoad = folly::none) {
+    receivePacket(from, makePann(origAddr, isGate, gateLoad));
+  }
+
+  std::unique_ptr<folly::IOBuf>
+  makePann(
+      folly::MacAddress origAddr,
+      bool isGate,
+      folly::Optional<GateLoad> gateLoad = folly::none) {
+    PannFrame pann;
+    pann.origAddr = origAddr;
+    pann.origSn = ++origSn;
+    pann.hopCount = 0;
+    pann.ttl = 32;
+    pann.targetAddr = folly::MacAddress::BROADCAST;
+    pann.metric = 0;
+    pann.isGate = isGate;
+    pann.replyRequested = false;
+    pann.gateLoad = gateLoad;
+    return encodePannFrame(pann, Routing::MeshPathFrameType::PANN);
+  }
+
+  void
+  receivePacket(folly::MacAddress from, std::unique_ptr<folly::IOBuf> buf) {
+    const auto version = routing->getSnapshot()->version;
+    evb.runInEventBaseThreadAndWait([this, from, &buf]() {
+      routing->receivePacket(from, std::move(buf));
+    });
+    waitForSnapshot(version);
+  }
+
+  // Snapshots are published at the end of the loop iteration, which may be
+  // after runInEventBaseThreadAndWait() returns
+  void
+  waitForSnapshot(uint64_t version) {
+    while (routing->getSnapshot()->version == version) {
+      std::this_thread::sleep_for(1ms);
+    }
+  }
+
+  folly::EventBase evb;
+  std::thread evbThread;
+  FakeMetricManager metricManager;
+  StatsClient statsClient;
+  std::unique_ptr<Routing> routing;
+  uint64_t origSn{0};
+};
+
+TEST_F(RoutingTest, PathIsJournaledWhenAdded) {
+  receivePann(kNeighborAddr, kRemoteAddr, false);
+
+  const auto meshPaths = routing->getMeshPaths();
+  ASSERT_EQ(1, meshPaths.size());
+  EXPECT_EQ(kRemoteAddr, meshPaths[0].dst);
+  EXPECT_EQ(kNeighborAddr, meshPaths[0].nextHop);
+
+  const auto changes = routing->getMeshPathChanges();
+  EXPECT_FALSE(changes.fullSyncRequired);
+  ASSERT_EQ(1, changes.changes.size());
+  EXPECT_EQ(Routing::MeshPathChange::Type::ADDED, changes.changes[0].type);
+  EXPECT_EQ(kRemoteAddr, changes.changes[0].dst);
+  EXPECT_EQ(kNeighborAddr, changes.changes[0].nextHop);
+
+  // Refreshing the path without changing its next hop is not a change
+  receivePann(kNeighborAddr, kRemoteAddr, false);
+  EXPECT_TRUE(routing->getMeshPathChanges().changes.empty());
+}
+
+TEST_F(RoutingTest, JournaledPathsAreFilteredLikeFullDumps) {
+  receivePann(kNeighborAddr, kRemoteAddr, false);
+
+  // The next hop lost its metric before the change was drained
+  evb.runInEventBaseThreadAndWait(
+      [this]() { metricManager.linkMetrics.erase(kNeighborAddr); });
+  EXPECT_TRUE(routing->getMeshPaths().empty());
+
+  const auto changes = routing->getMeshPathChanges();
+  ASSERT_EQ(1, changes.changes.size());
+  EXPECT_EQ(Routing::MeshPathChange::Type::REMOVED, changes.changes[0].type);
+  EXPECT_EQ(kRemoteAddr, changes.changes[0].dst);
+  EXPECT_EQ(folly::MacAddress::ZERO, changes.changes[0].nextHop);
+}
+
+TEST_F(RoutingTest, PathsAreWithdrawnWhenTheirNextHopLosesItsMetric) {
+  receivePann(kNeighborAddr, kRemoteAddr, false);
+  routing->getMeshPathChanges();
+
+  // Nothing about the path changes, only whether it is routed
+  evb.runInEventBaseThreadAndWait(
+      [this]() { metricManager.linkMetrics.erase(kNeighborAddr); });
+  auto changes = routing->getMeshPathChanges();
+  ASSERT_EQ(1, changes.changes.size());
+  EXPECT_EQ(Routing::MeshPathChange::Type::REMOVED, changes.changes[0].type);
+  EXPECT_EQ(kRemoteAddr, changes.changes[0].dst);
+
+  evb.runInEventBaseThreadAndWait(
+      [this]() { metricManager.linkMetrics.emplace(kNeighborAddr, 100); });
+  changes = routing->getMeshPathChanges();
+  ASSERT_EQ(1, changes.changes.size());
+  EXPECT_EQ(Routing::MeshPathChange::Type::ADDED, changes.changes[0].type);
+  EXPECT_EQ(kNeighborAddr, changes.changes[0].nextHop);
+}
+
+TEST_F(RoutingTest, PathIsWithdrawnWhenItExpires) {
+  receivePann(kNeighborAddr, kRemoteAddr, false);
+  routing->getMeshPathChanges();
+
+  // Refresh halfway through, which must push the expiry out
+  std::this_thread::sleep_for(kActivePathTimeout / 2);
+  receivePann(kNeighborAddr, kRemoteAddr, false);
+  std::this_thread::sleep_for(kActivePathTimeout / 2 + 20ms);
+  EXPECT_EQ(1, routing->getMeshPaths().size());
+  EXPECT_TRUE(routing->getMeshPathChanges().changes.empty());
+
+  std::this_thread::sleep_for(kActivePathTimeout / 2 + 20ms);
+  EXPECT_TRUE(routing->getMeshPaths().empty());
+  const auto changes = routing->getMeshPathChanges();
+  ASSERT_EQ(1, changes.changes.size());
+  EXPECT_EQ(Routing::MeshPathChange::Type::REMOVED, changes.changes[0].type);
+  EXPECT_EQ(kRemoteAddr, changes.changes[0].dst);
+
+  // The expired path is still known to the routing table
+  const auto mpaths = routing->dumpMpaths();
+  ASSERT_EQ(1, mpaths.size());
+  EXPECT_EQ(kRemoteAddr, mpaths[0].dst);
+}
+
+TEST_F(RoutingTest, SnapshotIsPublishedOnChange) {
+  const auto initial = routing->getSnapshot();
+  EXPECT_FALSE(initial->isGate);
+  EXPECT_TRUE(initial->meshPaths.empty());
+
+  receivePann(kNeighborAddr, kRemoteAddr, true);
+  const auto afterPann = routing->getSnapshot();
+  EXPECT_LT(initial->version, afterPann->version);
+  ASSERT_EQ(1, afterPann->meshPaths.size());
+  EXPECT_EQ(kRemoteAddr, afterPann->meshPaths[0].dst);
+  EXPECT_TRUE(afterPann->meshPaths[0].isGate);
+  // Published snapshots are never modified
+  EXPECT_TRUE(initial->meshPaths.empty());
+
+  routing->setGatewayStatus(true);
+  waitForSnapshot(afterPann->version);
+  EXPECT_TRUE(routing->getGatewayStatus());
+  EXPECT_EQ(1, routing->getSnapshot()->meshPaths.size());
+}
+
+TEST_F(RoutingTest, GateStatusIsDrainedWithTheJournal) {
+  routing->getMeshPathChanges();
+  // The snapshot is rate limited, the journal is not
+  routing->setGatewayStatus(true);
+  EXPECT_TRUE(routing->getMeshPathChanges().isGate);
+  routing->setGatewayStatus(false);
+  EXPECT_FALSE(routing->getMeshPathChanges().isGate);
+}
+
+TEST_F(RoutingTest, AggregatedFramesAreUnpacked) {
+  const folly::MacAddress otherRemoteAddr{"02:00:00:00:00:04"};
+  std::vector<std::unique_ptr<folly::IOBuf>> frames;
+  frames.push_back(makePann(kRemoteAddr, false));
+  frames.push_back(makePann(otherRemoteAddr, false));
+  receivePacket(kNeighborAddr, encodeAggregateFrame(frames));
+
+  EXPECT_EQ(2, routing->getMeshPaths().size());
+  EXPECT_EQ(
+      2,
+      statsClient.getStats().at(
+          "fbmeshd.routing.rx_frames_per_datagram.avg.60"));
+}
+
+TEST_F(RoutingTest, PeerDownWithdrawsPaths) {
+  receivePann(kNeighborAddr, kRemoteAddr, false);
+  routing->getMeshPathChanges();
+
+  const auto version = routing->getSnapshot()->version;
+  routing->peerDown(kNeighborAddr);
+  waitForSnapshot(version);
+
+  EXPECT_TRUE(routing->getMeshPaths().empty());
+  const auto changes = routing->getMeshPathChanges();
+  ASSERT_EQ(1, changes.changes.size());
+  EXPECT_EQ(Routing::MeshPathChange::Type::REMOVED, changes.changes[0].type);
+  EXPECT_EQ(kRemoteAddr, changes.changes[0].dst);
+
+  // A new route is picked up right away rather than after the old one times
+  // out
+  receivePann(kOtherNeighborAddr, kRemoteAddr, false);
+  const auto meshPaths = routing->getMeshPaths();
+  ASSERT_EQ(1, meshPaths.size());
+  EXPECT_EQ(kOtherNeighborAddr, meshPaths[0].nextHop);
+}
+
+TEST_F(RoutingTest, PeerDownFallsBackToBackupRoute) {
+  receivePann(kNeighborAddr, kRemoteAddr, false);
+  // The same destination through a worse link does not replace the path, but
+  // is kept as its backup. It publishes nothing, so there is nothing to wait
+  // for.
+  auto worsePann = makePann(kRemoteAddr, false);
+  evb.runInEventBaseThreadAndWait([this, &worsePann]() {
+    routing->receivePacket(kOtherNeighborAddr, std::move(worsePann));
+  });
+  ASSERT_EQ(kNeighborAddr, routing->getMeshPaths().at(0).nextHop);
+  routing->getMeshPathChanges();
+
+  const auto version = routing->getSnapshot()->version;
+  routing->peerDown(kNeighborAddr);
+  waitForSnapshot(version);
+
+  const auto meshPaths = routing->getMeshPaths();
+  ASSERT_EQ(1, meshPaths.size());
+  EXPECT_EQ(kOtherNeighborAddr, meshPaths[0].nextHop);
+  const auto changes = routing->getMeshPathChanges();
+  ASSERT_EQ(1, changes.changes.size());
+  EXPECT_EQ(
+      Routing::MeshPathChange::Type::NEXT_HOP_CHANGED, changes.changes[0].type);
+  EXPECT_EQ(kOtherNeighborAddr, changes.changes[0].nextHop);
+  EXPECT_EQ(
+      1,
+      statsClient.getStats().at(
+          "fbmeshd.routing.peer_down.rerouted_paths.sum.60"));
+}
+
+TEST_F(RoutingTest, GateLoadIsRecordedAndForwarded) {
+  std::vector<PannFrame> sent;
+  routing->setSendPacketCallback(
+      [&sent](folly::MacAddress, std::unique_ptr<folly::IOBuf> buf) {
+        const auto type = static_cast<Routing::MeshPathFrameType>(*buf->data());
+        buf->trimStart(1);
+        sent.push_back(decodePannFrame(type, *buf).value());
+      });
+
+  const GateLoad gateLoad{50000, 30};
+  receivePann(kNeighborAddr, kRemoteAddr, true, gateLoad);
+  const auto gatePaths = routing->getGatePaths();
+  ASSERT_EQ(1, gatePaths.size());
+  EXPECT_TRUE(gatePaths[0].gateLoad == gateLoad);
+
+  routing->resetSendPacketCallback();
+  ASSERT_EQ(1, sent.size());
+  EXPECT_EQ(kRemoteAddr, sent[0].origAddr);
+  EXPECT_TRUE(sent[0].gateLoad == gateLoad);
+}
+
+TEST_F(RoutingTest, LoadedGatesDoNotCrowdOutIdleOnes) {
+  const folly::MacAddress loadedGate1{"02:00:00:00:00:06"};
+  const folly::MacAddress loadedGate2{"02:00:00:00:00:07"};
+  const GateLoad saturated{50000, 90};
+  receivePann(kNeighborAddr, loadedGate1, true, saturated);
+  receivePann(kNeighborAddr, loadedGate2, true, saturated);
+
+  // Same airtime metric as the loaded gates, which would otherwise already
+  // provide the redundancy we keep gates for
+  receivePann(kNeighborAddr, kRemoteAddr, true);
+  EXPECT_EQ(3, routing->getGatePaths().size());
+}
+
+TEST_F(RoutingTest, DegradedWanRaisesOwnGateMetric) {
+  std::vector<PannFrame> sent;
+  routing->setSendPacketCallback(
+      [&sent](folly::MacAddress, std::unique_ptr<folly::IOBuf> buf) {
+        const auto type = static_cast<Routing::MeshPathFrameType>(*buf->data());
+        buf->trimStart(1);
+        sent.push_back(decodePannFrame(type, *buf).value());
+      });
+
+  routing->setWanQuality(60);
+  const auto version = routing->getSnapshot()->version;
+  routing->setGatewayStatus(true);
+  waitForSnapshot(version);
+
+  routing->resetSendPacketCallback();
+  ASSERT_EQ(1, sent.size());
+  EXPECT_EQ(kNodeAddr, sent[0].origAddr);
+  EXPECT_TRUE(sent[0].isGate);
+  EXPECT_EQ(400, sent[0].metric);
+}
+
+int
+main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
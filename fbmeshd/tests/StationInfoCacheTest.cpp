@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <folly/futures/Future.h>
+
+#include <fbmeshd/802.11s/StationInfoCache.h>
+
+using namespace std::chrono_literals;
+using namespace fbmeshd;
+
+namespace {
+const folly::MacAddress kPeer1{"02:00:00:00:00:01"};
+const folly::MacAddress kPeer2{"02:00:00:00:00:02"};
+
+std::vector<StationInfo>
+makeStations(folly::MacAddress mac) {
+  return {StationInfo{mac, 0ms, -50, false, 1000}};
+}
+} // namespace
+
+// Hands out dumps that only complete when the test says so
+class StationInfoCacheTest : public ::testing::Test {
+ protected:
+  folly::SemiFuture<std::vector<StationInfo>>
+  dump() {
+    dumps.emplace_back();
+    return dumps.back().getSemiFuture();
+  }
+
+  std::vector<folly::Promise<std::vector<StationInfo>>> dumps;
+};
+
+TEST_F(StationInfoCacheTest, ConcurrentRequestsShareOneDump) {
+  StationInfoCache cache{[this]() { return dump(); }, 10s};
+
+  auto first = cache.get();
+  auto second = cache.get();
+  ASSERT_EQ(1, dumps.size());
+  EXPECT_FALSE(first.isReady());
+
+  dumps[0].setValue(makeStations(kPeer1));
+  EXPECT_EQ(kPeer1, std::move(first).get().at(0).macAddress);
+  EXPECT_EQ(kPeer1, std::move(second).get().at(0).macAddress);
+
+  // Served from the cache without another dump
+  EXPECT_EQ(kPeer1, cache.get().get().at(0).macAddress);
+  EXPECT_EQ(1, cache.getNumDumps());
+}
+
+TEST_F(StationInfoCacheTest, EntriesExpire) {
+  StationInfoCache cache{[this]() { return dump(); }, 50ms};
+
+  auto first = cache.get();
+  dumps[0].setValue(makeStations(kPeer1));
+  std::move(first).get();
+
+  std::this_thread::sleep_for(60ms);
+  auto second = cache.get();
+  ASSERT_EQ(2, dumps.size());
+  dumps[1].setValue(makeStations(kPeer2));
+  EXPECT_EQ(kPeer2, std::move(second).get().at(0).macAddress);
+}
+
+TEST_F(StationInfoCacheTest, InvalidateDropsCachedAndInFlightDumps) {
+  StationInfoCache cache{[this]() { return dump(); }, 10s};
+
+  auto first = cache.get();
+  dumps[0].setValue(makeStations(kPeer1));
+  std::move(first).get();
+
+  cache.invalidate();
+  auto second = cache.get();
+  ASSERT_EQ(2, dumps.size());
+
+  // A station event during the dump means it may already be stale; its
+  // waiters get it, but it is not cached
+  cache.invalidate();
+  dumps[1].setValue(makeStations(kPeer1));
+  std::move(second).get();
+
+  auto third = cache.get();
+  ASSERT_EQ(3, dumps.size());
+  dumps[2].setValue(makeStations(kPeer2));
+  EXPECT_EQ(kPeer2, std::move(third).get().at(0).macAddress);
+}
+
+TEST_F(StationInfoCacheTest, RequestsAfterInvalidateDoNotJoinStaleDumps) {
+  StationInfoCache cache{[this]() { return dump(); }, 10s};
+
+  auto stale = cache.get();
+  cache.invalidate();
+  auto fresh = cache.get();
+  ASSERT_EQ(2, dumps.size());
+
+  // The fresh dump completing first is cached, and the stale one completing
+  // afterwards neither replaces it nor reaches the fresh waiters
+  dumps[1].setValue(makeStations(kPeer2));
+  EXPECT_EQ(kPeer2, std::move(fresh).get().at(0).macAddress);
+  dumps[0].setValue(makeStations(kPeer1));
+  EXPECT_EQ(kPeer1, std::move(stale).get().at(0).macAddress);
+
+  EXPECT_EQ(kPeer2, cache.get().get().at(0).macAddress);
+  EXPECT_EQ(2, cache.getNumDumps());
+}
+
+TEST_F(StationInfoCacheTest, FailedDumpsAreNotCached) {
+  StationInfoCache cache{[this]() { return dump(); }, 10s};
+
+  auto first = cache.get();
+  auto second = cache.get();
+  dumps[0].setException(std::runtime_error("dump failed"));
+  EXPECT_THROW(std::move(first).get(), std::runtime_error);
+  EXPECT_THROW(std::move(second).get(), std::runtime_error);
+
+  auto third = cache.get();
+  ASSERT_EQ(2, dumps.size());
+  dumps[1].setValue(makeStations(kPeer1));
+  EXPECT_EQ(kPeer1, std::move(third).get().at(0).macAddress);
+}
+
+int
+main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <unordered_map>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbmeshd/routing/SyncRoutes80211s.h>
+
+using namespace fbmeshd;
+
+namespace {
+const folly::MacAddress kGate1{"02:00:00:00:00:01"};
+const folly::MacAddress kGate2{"02:00:00:00:00:02"};
+const folly::MacAddress kGate3{"02:00:00:00:00:03"};
+const folly::MacAddress kNextHop1{"02:00:00:00:00:11"};
+const folly::MacAddress kNextHop2{"02:00:00:00:00:12"};
+
+Routing::MeshPath
+makeGatePath(
+    folly::MacAddress dst, folly::MacAddress nextHop, uint32_t metric) {
+  Routing::MeshPath mpath{dst};
+  mpath.nextHop = nextHop;
+  mpath.metric = metric;
+  mpath.isGate = true;
+  return mpath;
+}
+} // namespace
+
+TEST(SyncRoutes80211sTest, GateWeightsFollowMetrics) {
+  const auto weights = SyncRoutes80211s::getGateNextHopWeights(
+      {makeGatePath(kGate1, kNextHop1, 100),
+       makeGatePath(kGate2, kNextHop2, 400)});
+  ASSERT_EQ(2, weights.size());
+  EXPECT_EQ(SyncRoutes80211s::kMaxGateWeight, weights.at(kNextHop1));
+  EXPECT_EQ(SyncRoutes80211s::kMaxGateWeight / 4, weights.at(kNextHop2));
+}
+
+TEST(SyncRoutes80211sTest, GateWeightsAddUpPerNextHop) {
+  const auto weights = SyncRoutes80211s::getGateNextHopWeights(
+      {makeGatePath(kGate1, kNextHop1, 200),
+       makeGatePath(kGate2, kNextHop1, 200),
+       makeGatePath(kGate3, kNextHop2, 200)});
+  ASSERT_EQ(2, weights.size());
+  EXPECT_EQ(SyncRoutes80211s::kMaxGateWeight, weights.at(kNextHop1));
+  EXPECT_EQ(SyncRoutes80211s::kMaxGateWeight / 2, weights.at(kNextHop2));
+}
+
+TEST(SyncRoutes80211sTest, GateWeightsFollowLoad) {
+  auto loadedGate = makeGatePath(kGate2, kNextHop2, 100);
+  loadedGate.gateLoad = GateLoad{100000, 50};
+  const auto weights = SyncRoutes80211s::getGateNextHopWeights(
+      {makeGatePath(kGate1, kNextHop1, 100), loadedGate});
+  EXPECT_EQ(SyncRoutes80211s::kMaxGateWeight, weights.at(kNextHop1));
+  EXPECT_EQ(SyncRoutes80211s::kMaxGateWeight / 2, weights.at(kNextHop2));
+}
+
+TEST(SyncRoutes80211sTest, GateWeightsFollowSpareCapacity) {
+  auto smallGate = makeGatePath(kGate1, kNextHop1, 100);
+  smallGate.gateLoad = GateLoad{10000, 10};
+  auto largeGate = makeGatePath(kGate2, kNextHop2, 100);
+  largeGate.gateLoad = GateLoad{1000000, 20};
+  const auto weights =
+      SyncRoutes80211s::getGateNextHopWeights({smallGate, largeGate});
+  EXPECT_EQ(SyncRoutes80211s::kMaxGateWeight, weights.at(kNextHop2));
+  EXPECT_GT(weights.at(kNextHop2), weights.at(kNextHop1));
+}
+
+TEST(SyncRoutes80211sTest, DistantGatesKeepMinimumWeight) {
+  const auto weights = SyncRoutes80211s::getGateNextHopWeights(
+      {makeGatePath(kGate1, kNextHop1, 10),
+       makeGatePath(kGate2, kNextHop2, 100000)});
+  EXPECT_EQ(1, weights.at(kNextHop2));
+}
+
+TEST(SyncRoutes80211sTest, SmallGateWeightChangesAreHeld) {
+  const std::unordered_map<folly::MacAddress, uint8_t> current{
+      {kNextHop1, 16}, {kNextHop2, 8}};
+  EXPECT_EQ(
+      current,
+      SyncRoutes80211s::stabilizeGateNextHopWeights(
+          current, {{kNextHop1, 16}, {kNextHop2, 7}}));
+
+  const std::unordered_map<folly::MacAddress, uint8_t> moved{
+      {kNextHop1, 16}, {kNextHop2, 4}};
+  EXPECT_EQ(
+      moved, SyncRoutes80211s::stabilizeGateNextHopWeights(current, moved));
+
+  const std::unordered_map<folly::MacAddress, uint8_t> otherNextHops{
+      {kNextHop1, 16}};
+  EXPECT_EQ(
+      otherNextHops,
+      SyncRoutes80211s::stabilizeGateNextHopWeights(current, otherNextHops));
+}
+
+int
+main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
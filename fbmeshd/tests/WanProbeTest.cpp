@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbmeshd/gateway-connectivity-monitor/WanProbe.h>
+
+#include <chrono>
+
+#include <folly/Optional.h>
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+using namespace fbmeshd;
+
+class WanProbeTest : public ::testing::Test {
+ protected:
+  static constexpr auto testInterface{"lo"};
+
+  // Runs a probe to completion on evb, and keeps its samples
+  Socket::Result
+  probe(
+      const std::vector<folly::SocketAddress>& addresses,
+      std::chrono::milliseconds timeout) {
+    WanProbe wanProbe{&evb, testInterface, addresses, 3, timeout};
+    folly::Optional<Socket::Result> result;
+    bool finished{false};
+    wanProbe.start(
+        [&result](const Socket::Result& r) { result = r; },
+        [&result, &finished]() {
+          EXPECT_TRUE(result.hasValue());
+          finished = true;
+        });
+    while (!finished) {
+      evb.loopOnce();
+    }
+    samples = wanProbe.getSamples();
+    return *result;
+  }
+
+  folly::EventBase evb;
+  std::vector<WanProbe::Sample> samples;
+};
+
+TEST_F(WanProbeTest, FailuresCompleteBeforeTheDeadline) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto result = probe(
+      {folly::SocketAddress{"127.0.0.1", 1}, folly::SocketAddress{"::1", 1}},
+      10s);
+  EXPECT_FALSE(result.success);
+  EXPECT_EQ(
+      getuid() != 0 ? "setsockopt_bindtodevice" : "err_non_zero",
+      result.errorMsg);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, 5s);
+}
+
+TEST_F(WanProbeTest, FirstSuccessWins) {
+  auto serverSocket = folly::AsyncServerSocket::newSocket(&evb);
+  serverSocket->bind(folly::SocketAddress{"127.0.0.1", 0});
+  serverSocket->listen(16);
+  folly::SocketAddress serverAddress;
+  serverSocket->getAddress(&serverAddress);
+
+  const auto result =
+      probe({folly::SocketAddress{"127.0.0.1", 1}, serverAddress}, 10s);
+
+  // Binding to the interface needs root, see SocketTest
+  if (getuid() == 0) {
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ("", result.errorMsg);
+  } else {
+    EXPECT_FALSE(result.success);
+  }
+
+  // The other attempts still ran, one sample each
+  ASSERT_EQ(6, samples.size());
+  for (const auto& sample : samples) {
+    const bool answered = getuid() == 0 && sample.address == serverAddress;
+    EXPECT_EQ(answered, sample.rtt.hasValue());
+    EXPECT_EQ(!answered, sample.lost);
+  }
+}
+
+TEST_F(WanProbeTest, NoAddresses) {
+  const auto result = probe({}, 10s);
+  EXPECT_FALSE(result.success);
+  EXPECT_EQ("no_addresses", result.errorMsg);
+}
+
+int
+main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
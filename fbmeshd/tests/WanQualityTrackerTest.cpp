@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <chrono>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbmeshd/gateway-connectivity-monitor/WanQualityTracker.h>
+
+using namespace std::chrono_literals;
+using namespace fbmeshd;
+
+namespace {
+const folly::SocketAddress kAddress1{"192.0.2.1", 443};
+const folly::SocketAddress kAddress2{"192.0.2.2", 443};
+
+WanProbe::Sample
+makeRtt(const folly::SocketAddress& address, std::chrono::microseconds rtt) {
+  return WanProbe::Sample{address, rtt, false};
+}
+
+WanProbe::Sample
+makeLost(const folly::SocketAddress& address) {
+  return WanProbe::Sample{address, folly::none, true};
+}
+} // namespace
+
+TEST(WanQualityTrackerTest, Percentiles) {
+  WanQualityTracker tracker{100};
+  EXPECT_FALSE(tracker.getRttPercentile(50).hasValue());
+
+  for (int i = 1; i <= 10; i++) {
+    tracker.addSamples({makeRtt(kAddress1, i * 1ms)});
+  }
+  tracker.addSamples({makeRtt(kAddress2, 100ms)});
+
+  EXPECT_EQ(6ms, tracker.getRttPercentile(50).value());
+  EXPECT_EQ(10ms, tracker.getRttPercentile(90).value());
+  EXPECT_EQ(100ms, tracker.getRttPercentile(99).value());
+  EXPECT_EQ(10ms, tracker.getRttPercentile(kAddress1, 99).value());
+  EXPECT_EQ(100ms, tracker.getRttPercentile(kAddress2, 50).value());
+}
+
+TEST(WanQualityTrackerTest, WindowDropsOldSamples) {
+  WanQualityTracker tracker{2};
+  tracker.addSamples({makeLost(kAddress1)});
+  tracker.addSamples({makeRtt(kAddress1, 10ms)});
+  EXPECT_DOUBLE_EQ(0.5, tracker.getLossRate());
+
+  tracker.addSamples({makeRtt(kAddress1, 20ms)});
+  EXPECT_DOUBLE_EQ(0, tracker.getLossRate());
+  EXPECT_EQ(10ms, tracker.getRttPercentile(50).value());
+}
+
+TEST(WanQualityTrackerTest, UnansweredAddressesAddNoSamples) {
+  WanQualityTracker tracker{10};
+  tracker.addSamples(
+      {makeRtt(kAddress1, 10ms), WanProbe::Sample{kAddress2, folly::none}});
+  EXPECT_DOUBLE_EQ(0, tracker.getLossRate());
+  EXPECT_FALSE(tracker.getRttPercentile(kAddress2, 50).hasValue());
+}
+
+TEST(WanQualityTrackerTest, QualityDegradesWithRttAndLoss) {
+  WanQualityTracker fast{10};
+  WanQualityTracker slow{10};
+  WanQualityTracker lossy{10};
+  for (int i = 0; i < 50; i++) {
+    fast.addSamples({makeRtt(kAddress1, WanQualityTracker::kGoodRtt)});
+    slow.addSamples({makeRtt(kAddress1, 275ms)});
+    lossy.addSamples({i % 10 == 0 ? makeLost(kAddress1)
+                                  : makeRtt(kAddress1, 10ms)});
+  }
+  EXPECT_EQ(100, fast.getQuality());
+  EXPECT_EQ(50, slow.getQuality());
+  EXPECT_EQ(50, lossy.getQuality());
+}
+
+TEST(WanQualityTrackerTest, QualityIsSmoothed) {
+  WanQualityTracker tracker{10};
+  tracker.addSamples({makeLost(kAddress1)});
+  EXPECT_GT(tracker.getQuality(), 50);
+  EXPECT_LT(tracker.getQuality(), 100);
+
+  for (int i = 0; i < 50; i++) {
+    tracker.addSamples({makeLost(kAddress1)});
+  }
+  EXPECT_EQ(0, tracker.getQuality());
+}
+
+int
+main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  return RUN_ALL_TESTS();
+}